@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace base {
+
+// Returns the number of bytes of this process that are currently resident in physical memory.
+// Returns 0 if the platform can't report it.
+size_t resident_memory_bytes();
+
+// Returns the high-water mark of `resident_memory_bytes()` over the lifetime of the process, or
+// since the last successful `reset_peak_resident_memory()`.
+size_t peak_resident_memory_bytes();
+
+// Resets the high-water mark to the current resident size. Returns false if the platform can't
+// reset it, in which case the peak still covers the whole process lifetime.
+bool reset_peak_resident_memory();
+
+}  // namespace base
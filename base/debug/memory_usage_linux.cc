@@ -0,0 +1,46 @@
+#include "base/debug/memory_usage.h"
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace base {
+
+size_t resident_memory_bytes() {
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (!fp) return 0;
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    int matched = fscanf(fp, "%zu %zu", &total_pages, &resident_pages);
+    fclose(fp);
+    if (matched != 2) return 0;
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+size_t peak_resident_memory_bytes() {
+    // `getrusage()` isn't affected by `reset_peak_resident_memory()`, but VmHWM is.
+    FILE* fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        size_t peak_kb = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %zu kB", &peak_kb) == 1) break;
+        }
+        fclose(fp);
+        if (peak_kb) return peak_kb * 1024;
+    }
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    // Linux reports kilobytes.
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+bool reset_peak_resident_memory() {
+    // See "clear_refs" in proc(5). Writing 5 resets the peak resident set size.
+    FILE* fp = fopen("/proc/self/clear_refs", "w");
+    if (!fp) return false;
+    bool ok = fputs("5", fp) >= 0;
+    return fclose(fp) == 0 && ok;
+}
+
+}  // namespace base
@@ -0,0 +1,31 @@
+#include "base/debug/memory_usage.h"
+#include <mach/mach.h>
+
+namespace base {
+
+namespace {
+
+bool get_task_info(mach_task_basic_info_data_t* info) {
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    kern_return_t kr = task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                                 reinterpret_cast<task_info_t>(info), &count);
+    return kr == KERN_SUCCESS;
+}
+
+}  // namespace
+
+size_t resident_memory_bytes() {
+    mach_task_basic_info_data_t info;
+    if (!get_task_info(&info)) return 0;
+    return info.resident_size;
+}
+
+size_t peak_resident_memory_bytes() {
+    mach_task_basic_info_data_t info;
+    if (!get_task_info(&info)) return 0;
+    return info.resident_size_max;
+}
+
+bool reset_peak_resident_memory() { return false; }
+
+}  // namespace base
@@ -0,0 +1,30 @@
+#include "base/debug/memory_usage.h"
+#include <windows.h>
+
+#include <psapi.h>
+
+namespace base {
+
+namespace {
+
+bool get_memory_counters(PROCESS_MEMORY_COUNTERS* counters) {
+    return ::GetProcessMemoryInfo(::GetCurrentProcess(), counters, sizeof(*counters));
+}
+
+}  // namespace
+
+size_t resident_memory_bytes() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!get_memory_counters(&counters)) return 0;
+    return counters.WorkingSetSize;
+}
+
+size_t peak_resident_memory_bytes() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!get_memory_counters(&counters)) return 0;
+    return counters.PeakWorkingSetSize;
+}
+
+bool reset_peak_resident_memory() { return false; }
+
+}  // namespace base
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "base/files/file_path.h"
+#include "build/build_config.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace base {
+
+// A read-only mapping of an entire file into memory. The mapping is released on destruction.
+//
+// On Windows the file is opened without write sharing, so other processes can't modify it while it
+// is mapped. POSIX has no mandatory equivalent: another process may rewrite the file in place (the
+// mapping then reflects the new bytes) or truncate it (pages past the new end lose their backing).
+// Instead of raising SIGBUS, reads of such pages see zeros, so offsets computed at open time stay
+// in bounds even though the contents may no longer match.
+class MemoryMappedFile {
+public:
+    MemoryMappedFile() = default;
+    ~MemoryMappedFile();
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    // Opens and maps `path`. Returns false if the file can't be opened or mapped. An empty file
+    // maps successfully with a null `data()`.
+    bool Initialize(const FilePath& path);
+
+    // Hints to the OS that the whole mapping is about to be read front to back, so it should read
+    // ahead aggressively.
+    void PrefetchSequential() const;
+    // Hints that `[offset, offset + length)` will be read soon, so the OS can start reading it in.
+    void Prefetch(size_t offset, size_t length) const;
+    // Drops the pages covering `[offset, offset + length)` from this process's resident memory.
+    // Only whole pages inside the range are dropped. The contents stay readable: the next access
+    // reads them back from the file (or from the OS file cache, if they are still there).
+    void Evict(size_t offset, size_t length) const;
+
+    bool IsValid() const { return valid_; }
+    const uint8_t* data() const { return data_; }
+    size_t length() const { return length_; }
+    std::span<const uint8_t> bytes() const { return {data_, length_}; }
+    std::string_view str() const { return {reinterpret_cast<const char*>(data_), length_}; }
+
+private:
+    void CloseHandles();
+
+    uint8_t* data_ = nullptr;
+    size_t length_ = 0;
+    bool valid_ = false;
+
+#if BUILDFLAG(IS_WIN)
+    // Win32 HANDLEs, kept as `void*` so this header doesn't pull in <windows.h>.
+    void* file_ = nullptr;
+    void* file_mapping_ = nullptr;
+#endif
+};
+
+}  // namespace base
@@ -0,0 +1,160 @@
+#include "base/compiler_specific.h"
+#include "base/files/file.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/posix/eintr_wrapper.h"
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace base {
+
+namespace {
+
+// Address ranges of live mappings. Reading a page of a mapping whose file was truncated underneath
+// it raises SIGBUS; the handler below replaces such pages with zeros instead of crashing. Slots are
+// claimed by CAS on `begin`, so the handler only ever sees fully published or empty ranges.
+struct GuardedRange {
+    std::atomic<uintptr_t> begin = 0;
+    std::atomic<uintptr_t> end = 0;
+};
+constexpr size_t kMaxGuardedRanges = 64;
+GuardedRange g_guarded_ranges[kMaxGuardedRanges];
+uintptr_t g_page_size = 0;
+struct sigaction g_previous_sigbus_action;
+
+void sigbus_handler(int signal, siginfo_t* info, void* context) {
+    auto addr = reinterpret_cast<uintptr_t>(info->si_addr);
+    for (auto& range : g_guarded_ranges) {
+        uintptr_t begin = range.begin.load(std::memory_order_acquire);
+        if (begin && begin <= addr && addr < range.end.load(std::memory_order_acquire)) {
+            // Map a zero page over the one that lost its backing; the faulting read then retries.
+            void* page = reinterpret_cast<void*>(addr & ~(g_page_size - 1));
+            void* zeros = mmap(page, g_page_size, PROT_READ,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+            if (zeros != MAP_FAILED) return;
+            break;
+        }
+    }
+
+    // Not one of ours. Hand the signal to whoever was installed before us (or the default action,
+    // which terminates) by restoring it and letting the faulting instruction retry.
+    sigaction(SIGBUS, &g_previous_sigbus_action, nullptr);
+}
+
+void install_sigbus_handler() {
+    static const bool installed = [] {
+        g_page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        struct sigaction action = {};
+        action.sa_sigaction = sigbus_handler;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        return sigaction(SIGBUS, &action, &g_previous_sigbus_action) == 0;
+    }();
+    (void)installed;
+}
+
+void guard_range(const void* data, size_t length) {
+    install_sigbus_handler();
+    auto begin = reinterpret_cast<uintptr_t>(data);
+    for (auto& range : g_guarded_ranges) {
+        uintptr_t expected = 0;
+        if (range.begin.compare_exchange_strong(expected, begin, std::memory_order_acq_rel)) {
+            range.end.store(begin + length, std::memory_order_release);
+            return;
+        }
+    }
+    // Out of slots: this mapping goes unguarded and truncation will raise SIGBUS as usual.
+}
+
+void unguard_range(const void* data) {
+    auto begin = reinterpret_cast<uintptr_t>(data);
+    for (auto& range : g_guarded_ranges) {
+        if (range.begin.load(std::memory_order_acquire) == begin) {
+            range.end.store(0, std::memory_order_release);
+            range.begin.store(0, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+size_t page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+}  // namespace
+
+MemoryMappedFile::~MemoryMappedFile() { CloseHandles(); }
+
+bool MemoryMappedFile::Initialize(const FilePath& path) {
+    CloseHandles();
+
+    int fd = HANDLE_EINTR(open(path.value().c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) return false;
+
+    stat_wrapper_t file_info;
+    if (File::Fstat(fd, &file_info) != 0 || !S_ISREG(file_info.st_mode)) {
+        IGNORE_EINTR(close(fd));
+        return false;
+    }
+
+    length_ = static_cast<size_t>(file_info.st_size);
+    if (length_ > 0) {
+        void* addr = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            length_ = 0;
+            IGNORE_EINTR(close(fd));
+            return false;
+        }
+        data_ = static_cast<uint8_t*>(addr);
+        guard_range(data_, length_);
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    IGNORE_EINTR(close(fd));
+    valid_ = true;
+    return true;
+}
+
+void MemoryMappedFile::PrefetchSequential() const {
+    if (!data_) return;
+    madvise(data_, length_, MADV_SEQUENTIAL);
+    madvise(data_, length_, MADV_WILLNEED);
+}
+
+void MemoryMappedFile::Prefetch(size_t offset, size_t length) const {
+    if (!data_ || offset >= length_) return;
+    // madvise() wants a page-aligned start, so widen the range down to one.
+    size_t aligned = offset & ~(page_size() - 1);
+    length = std::min(length, length_ - offset) + (offset - aligned);
+    madvise(UNSAFE_TODO(data_ + aligned), length, MADV_WILLNEED);
+}
+
+void MemoryMappedFile::Evict(size_t offset, size_t length) const {
+    if (!data_ || offset >= length_) return;
+    // Unlike `Prefetch()`, narrow the range to the pages it fully covers. The mapping's last page
+    // counts as full, since the bytes past the end of the file aren't readable anyway.
+    size_t mask = page_size() - 1;
+    size_t first = (offset + mask) & ~mask;
+    size_t end = offset + std::min(length, length_ - offset);
+    if (end != length_) end &= ~mask;
+    if (first >= end) return;
+    // The mapping is shared and read-only, so the pages are clean and nothing is lost.
+    madvise(UNSAFE_TODO(data_ + first), end - first, MADV_DONTNEED);
+}
+
+void MemoryMappedFile::CloseHandles() {
+    if (data_) {
+        unguard_range(data_);
+        munmap(data_, length_);
+    }
+    data_ = nullptr;
+    length_ = 0;
+    valid_ = false;
+}
+
+}  // namespace base
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include "base/files/file_reader.h"
+#include "base/files/memory_mapped_file.h"
+#include "build/build_config.h"
+#include <cstdio>
+#include <string>
+
+#if BUILDFLAG(IS_POSIX)
+#include <unistd.h>
+#endif
+
+namespace base {
+
+namespace {
+constexpr std::string_view kFileName = "memory_mapped_file_unittest.txt";
+const FilePath kFilePath{FILE_PATH_LITERAL("memory_mapped_file_unittest.txt")};
+}  // namespace
+
+TEST(MemoryMappedFileTest, MapsContents) {
+    WriteFile(kFileName, "Hello world!\nSecond line\n");
+
+    MemoryMappedFile file;
+    ASSERT_TRUE(file.Initialize(kFilePath));
+    EXPECT_TRUE(file.IsValid());
+    EXPECT_EQ(file.str(), "Hello world!\nSecond line\n");
+    EXPECT_EQ(file.length(), 25);
+    file.PrefetchSequential();
+
+    std::remove(kFileName.data());
+}
+
+TEST(MemoryMappedFileTest, MappingOutlivesFile) {
+    WriteFile(kFileName, "contents");
+
+    MemoryMappedFile file;
+    ASSERT_TRUE(file.Initialize(kFilePath));
+    std::remove(kFileName.data());
+    EXPECT_EQ(file.str(), "contents");
+}
+
+TEST(MemoryMappedFileTest, EmptyFile) {
+    fclose(fopen(kFileName.data(), "wb"));
+
+    MemoryMappedFile file;
+    ASSERT_TRUE(file.Initialize(kFilePath));
+    EXPECT_TRUE(file.IsValid());
+    EXPECT_EQ(file.data(), nullptr);
+    EXPECT_EQ(file.length(), 0);
+    EXPECT_TRUE(file.str().empty());
+
+    std::remove(kFileName.data());
+}
+
+TEST(MemoryMappedFileTest, EvictedPagesReadBack) {
+    std::string contents;
+    for (int i = 0; i < 100'000; ++i) contents += std::to_string(i) + '\n';
+    WriteFile(kFileName, contents);
+
+    MemoryMappedFile file;
+    ASSERT_TRUE(file.Initialize(kFilePath));
+    ASSERT_EQ(file.str(), contents);
+    // Unaligned ranges, ranges past the end, and the whole file.
+    file.Evict(12345, 67890);
+    file.Evict(contents.size() - 10, 1000);
+    file.Evict(contents.size() + 10, 1000);
+    EXPECT_EQ(file.str(), contents);
+    file.Prefetch(100, 5000);
+    file.Evict(0, contents.size());
+    EXPECT_EQ(file.str(), contents);
+
+    std::remove(kFileName.data());
+}
+
+#if BUILDFLAG(IS_POSIX)
+// Another process can truncate a mapped file on POSIX. Pages past the new end must read as zeros
+// rather than raising SIGBUS.
+TEST(MemoryMappedFileTest, TruncatedFileReadsAsZeros) {
+    std::string contents(3 * sysconf(_SC_PAGESIZE), 'a');
+    WriteFile(kFileName, contents);
+
+    MemoryMappedFile file;
+    ASSERT_TRUE(file.Initialize(kFilePath));
+    ASSERT_EQ(truncate(kFileName.data(), 0), 0);
+
+    EXPECT_EQ(file.length(), contents.size());
+    EXPECT_EQ(file.data()[0], 0);
+    EXPECT_EQ(file.data()[file.length() - 1], 0);
+
+    std::remove(kFileName.data());
+}
+#endif
+
+TEST(MemoryMappedFileTest, MissingFile) {
+    MemoryMappedFile file;
+    EXPECT_FALSE(file.Initialize(FilePath{FILE_PATH_LITERAL("does_not_exist.txt")}));
+    EXPECT_FALSE(file.IsValid());
+}
+
+}  // namespace base
@@ -0,0 +1,81 @@
+#include "base/compiler_specific.h"
+#include "base/files/memory_mapped_file.h"
+#include <algorithm>
+#include <windows.h>
+
+namespace base {
+
+MemoryMappedFile::~MemoryMappedFile() { CloseHandles(); }
+
+bool MemoryMappedFile::Initialize(const FilePath& path) {
+    CloseHandles();
+
+    HANDLE file = ::CreateFile(path.value().c_str(), GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    file_ = file;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file_, &size)) {
+        CloseHandles();
+        return false;
+    }
+
+    length_ = static_cast<size_t>(size.QuadPart);
+    if (length_ > 0) {
+        file_mapping_ = ::CreateFileMapping(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!file_mapping_) {
+            CloseHandles();
+            return false;
+        }
+        data_ = static_cast<uint8_t*>(::MapViewOfFile(file_mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (!data_) {
+            CloseHandles();
+            return false;
+        }
+    }
+
+    valid_ = true;
+    return true;
+}
+
+void MemoryMappedFile::PrefetchSequential() const {
+    if (!data_) return;
+    WIN32_MEMORY_RANGE_ENTRY range = {data_, length_};
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+}
+
+void MemoryMappedFile::Prefetch(size_t offset, size_t length) const {
+    if (!data_ || offset >= length_) return;
+    WIN32_MEMORY_RANGE_ENTRY range = {UNSAFE_TODO(data_ + offset),
+                                      std::min(length, length_ - offset)};
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+}
+
+void MemoryMappedFile::Evict(size_t offset, size_t length) const {
+    if (!data_ || offset >= length_) return;
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    size_t mask = info.dwPageSize - 1;
+    size_t first = (offset + mask) & ~mask;
+    size_t end = offset + std::min(length, length_ - offset);
+    if (end != length_) end &= ~mask;
+    if (first >= end) return;
+    // Unlocking pages that aren't locked removes them from the working set. They stay in the
+    // standby list, so reading them again is cheap unless memory runs short.
+    ::VirtualUnlock(UNSAFE_TODO(data_ + first), end - first);
+}
+
+void MemoryMappedFile::CloseHandles() {
+    if (data_) ::UnmapViewOfFile(data_);
+    if (file_mapping_) ::CloseHandle(file_mapping_);
+    if (file_) ::CloseHandle(file_);
+    data_ = nullptr;
+    length_ = 0;
+    valid_ = false;
+    file_mapping_ = nullptr;
+    file_ = nullptr;
+}
+
+}  // namespace base
@@ -0,0 +1,230 @@
+#include "base/strings/line_index.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+// AVX2 is not part of the x86-64 baseline, so it is compiled with a function-level target and
+// selected at runtime. MSVC-style toolchains lack `__builtin_cpu_supports` and stay on SSE2.
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__) && !defined(_WIN32)
+#define LINE_INDEX_HAS_AVX2 1
+#else
+#define LINE_INDEX_HAS_AVX2 0
+#endif
+
+namespace base {
+
+namespace {
+
+// Below this many bytes per chunk, thread startup costs more than the scan itself.
+constexpr size_t kMinBytesPerThread = 16 * 1024 * 1024;
+
+// Each kernel compares one block of `kBlockSize` bytes against '\n' and returns a bitmask where
+// bit `i * kMaskStride` is set iff byte `i` is a newline.
+#if defined(__x86_64__) || defined(_M_X64)
+struct Sse2Kernel {
+    static constexpr size_t kBlockSize = 16;
+    static constexpr size_t kMaskStride = 1;
+
+    static inline uint64_t mask(const char* p) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i eq = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        return static_cast<uint32_t>(_mm_movemask_epi8(eq));
+    }
+};
+using BaselineKernel = Sse2Kernel;
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+struct NeonKernel {
+    static constexpr size_t kBlockSize = 16;
+    static constexpr size_t kMaskStride = 4;
+
+    // NEON has no movemask. Narrowing each 16-bit lane by 4 packs the comparison into one nibble
+    // per byte; keeping only the top bit of each nibble leaves one bit per byte.
+    static inline uint64_t mask(const char* p) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t eq = vceqq_u8(v, vdupq_n_u8('\n'));
+        uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+        return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888;
+    }
+};
+using BaselineKernel = NeonKernel;
+#else
+struct ScalarKernel {
+    static constexpr size_t kBlockSize = 8;
+    static constexpr size_t kMaskStride = 1;
+
+    static inline uint64_t mask(const char* p) {
+        uint64_t m = 0;
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            m |= static_cast<uint64_t>(p[i] == '\n') << i;
+        }
+        return m;
+    }
+};
+using BaselineKernel = ScalarKernel;
+#endif
+
+template <typename Kernel>
+[[gnu::always_inline]] inline size_t count_newlines_impl(const char* p, size_t n) {
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + Kernel::kBlockSize <= n; i += Kernel::kBlockSize) {
+        count += std::popcount(Kernel::mask(p + i));
+    }
+    for (; i < n; ++i) {
+        count += p[i] == '\n';
+    }
+    return count;
+}
+
+// Writes `offset + i + 1` for every newline at `p[i]` and returns the end of the written range.
+template <typename Kernel>
+[[gnu::always_inline]] inline size_t* write_line_starts_impl(const char* p,
+                                                             size_t n,
+                                                             size_t offset,
+                                                             size_t* out) {
+    size_t i = 0;
+    for (; i + Kernel::kBlockSize <= n; i += Kernel::kBlockSize) {
+        for (uint64_t m = Kernel::mask(p + i); m; m &= m - 1) {
+            *out++ = offset + i + std::countr_zero(m) / Kernel::kMaskStride + 1;
+        }
+    }
+    for (; i < n; ++i) {
+        if (p[i] == '\n') *out++ = offset + i + 1;
+    }
+    return out;
+}
+
+size_t count_newlines_baseline(const char* p, size_t n) {
+    return count_newlines_impl<BaselineKernel>(p, n);
+}
+
+size_t* write_line_starts_baseline(const char* p, size_t n, size_t offset, size_t* out) {
+    return write_line_starts_impl<BaselineKernel>(p, n, offset, out);
+}
+
+#if LINE_INDEX_HAS_AVX2
+struct Avx2Kernel {
+    static constexpr size_t kBlockSize = 32;
+    static constexpr size_t kMaskStride = 1;
+
+    [[gnu::target("avx2")]] static inline uint64_t mask(const char* p) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i eq = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+    }
+};
+
+[[gnu::target("avx2")]] size_t count_newlines_avx2(const char* p, size_t n) {
+    return count_newlines_impl<Avx2Kernel>(p, n);
+}
+
+[[gnu::target("avx2")]] size_t* write_line_starts_avx2(const char* p,
+                                                       size_t n,
+                                                       size_t offset,
+                                                       size_t* out) {
+    return write_line_starts_impl<Avx2Kernel>(p, n, offset, out);
+}
+
+bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+size_t count_newlines_serial(std::string_view str) {
+#if LINE_INDEX_HAS_AVX2
+    if (has_avx2()) return count_newlines_avx2(str.data(), str.size());
+#endif
+    return count_newlines_baseline(str.data(), str.size());
+}
+
+size_t* write_line_starts_serial(std::string_view str, size_t offset, size_t* out) {
+#if LINE_INDEX_HAS_AVX2
+    if (has_avx2()) return write_line_starts_avx2(str.data(), str.size(), offset, out);
+#endif
+    return write_line_starts_baseline(str.data(), str.size(), offset, out);
+}
+
+size_t hardware_thread_count() {
+    static const size_t count = std::max(std::thread::hardware_concurrency(), 1U);
+    return count;
+}
+
+// Runs `f(i)` for each i in [0, count), using the calling thread for i == 0.
+template <typename F>
+void run_parallel(size_t count, F&& f) {
+    std::vector<std::thread> threads;
+    threads.reserve(count - 1);
+    for (size_t i = 1; i < count; ++i) {
+        threads.emplace_back(f, i);
+    }
+    f(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+}  // namespace
+
+size_t count_newlines(std::string_view str) {
+    return count_newlines_serial(str);
+}
+
+std::vector<size_t> find_line_starts(std::string_view str) {
+    // Keystroke-sized inputs (the common case) must not pay for any of the thread machinery.
+    if (str.size() < 2 * kMinBytesPerThread) {
+        return internal::find_line_starts(str, 1);
+    }
+    size_t chunks = std::min(str.size() / kMinBytesPerThread, hardware_thread_count());
+    return internal::find_line_starts(str, chunks);
+}
+
+namespace internal {
+
+std::vector<size_t> find_line_starts(std::string_view str, size_t chunks) {
+    if (chunks <= 1) {
+        std::vector<size_t> starts(count_newlines_serial(str) + 1);
+        starts[0] = 0;
+        write_line_starts_serial(str, 0, starts.data() + 1);
+        return starts;
+    }
+
+    size_t chunk_size = str.size() / chunks;
+    auto chunk_at = [&](size_t i) {
+        size_t begin = i * chunk_size;
+        size_t end = i + 1 == chunks ? str.size() : begin + chunk_size;
+        return str.substr(begin, end - begin);
+    };
+
+    // Chunk boundaries need no alignment to line boundaries: each newline belongs to exactly one
+    // chunk, so counting per chunk and writing at the prefix-summed position stitches the chunks
+    // back together without any fix-up.
+    std::vector<size_t> counts(chunks);
+    run_parallel(chunks, [&](size_t i) { counts[i] = count_newlines_serial(chunk_at(i)); });
+
+    std::vector<size_t> starts_at(chunks);
+    size_t total = 1;
+    for (size_t i = 0; i < chunks; ++i) {
+        starts_at[i] = total;
+        total += counts[i];
+    }
+
+    std::vector<size_t> starts(total);
+    starts[0] = 0;
+    run_parallel(chunks, [&](size_t i) {
+        write_line_starts_serial(chunk_at(i), i * chunk_size, starts.data() + starts_at[i]);
+    });
+    return starts;
+}
+
+}  // namespace internal
+
+}  // namespace base
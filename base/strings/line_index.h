@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace base {
+
+// Returns the number of '\n' characters in |str|.
+size_t count_newlines(std::string_view str);
+
+// Returns the offset of every line start in |str|: 0, followed by the offset just past each '\n'.
+// The result is sized exactly from a counting pass. Large inputs are split into chunks that are
+// scanned on separate threads and written into disjoint ranges of the result.
+std::vector<size_t> find_line_starts(std::string_view str);
+
+namespace internal {
+
+// Same as `find_line_starts()`, but splits |str| into exactly |chunks| chunks (one per thread)
+// regardless of its size or the number of cores. Exposed for tests and benchmarks.
+std::vector<size_t> find_line_starts(std::string_view str, size_t chunks);
+
+}  // namespace internal
+
+}  // namespace base
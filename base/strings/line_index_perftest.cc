@@ -0,0 +1,52 @@
+#include "base/debug/profiler.h"
+#include "base/strings/line_index.h"
+#include "base/test/perf_test_data.h"
+#include <gtest/gtest.h>
+#include <print>
+#include <thread>
+
+namespace base {
+
+namespace {
+
+// The previous implementation: one `find` call and one `push_back` per line.
+std::vector<size_t> find_line_starts_scalar(std::string_view str) {
+    std::vector<size_t> starts;
+    starts.push_back(0);
+    size_t pos = 0;
+    while ((pos = str.find('\n', pos)) != std::string_view::npos) {
+        starts.push_back(pos + 1);
+        ++pos;
+    }
+    return starts;
+}
+
+}  // namespace
+
+TEST(LineIndexPerfTest, Index1Gb) {
+    const std::string str = make_1gb_sample();
+
+    auto p1 = Profiler{"Scalar line starts (1GB)"};
+    auto expected = find_line_starts_scalar(str);
+    p1.stop_mili();
+
+    auto p2 = Profiler{"Count newlines (1GB)"};
+    size_t newlines = count_newlines(str);
+    p2.stop_mili();
+
+    // One chunk: the vectorized scan on its own, without any threading.
+    auto p3 = Profiler{"Vectorized line starts, serial (1GB)"};
+    auto serial = internal::find_line_starts(str, 1);
+    p3.stop_mili();
+
+    auto p4 = Profiler{"Vectorized line starts, parallel (1GB)"};
+    auto starts = find_line_starts(str);
+    p4.stop_mili();
+
+    std::println("Hardware threads: {}", std::thread::hardware_concurrency());
+    EXPECT_EQ(newlines, kPerfTestLongLineCount);
+    EXPECT_EQ(serial, expected);
+    EXPECT_EQ(starts, expected);
+}
+
+}  // namespace base
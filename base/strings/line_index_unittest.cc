@@ -0,0 +1,85 @@
+#include "base/rand_util.h"
+#include "base/strings/line_index.h"
+#include <gtest/gtest.h>
+
+namespace base {
+
+namespace {
+
+std::vector<size_t> naive_line_starts(std::string_view str) {
+    std::vector<size_t> starts = {0};
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] == '\n') starts.push_back(i + 1);
+    }
+    return starts;
+}
+
+}  // namespace
+
+TEST(LineIndexTest, Empty) {
+    EXPECT_EQ(count_newlines(""), 0);
+    EXPECT_EQ(find_line_starts(""), std::vector<size_t>{0});
+}
+
+TEST(LineIndexTest, Simple) {
+    EXPECT_EQ(count_newlines("abc"), 0);
+    EXPECT_EQ(find_line_starts("abc"), std::vector<size_t>{0});
+    EXPECT_EQ(count_newlines("\n\n\n"), 3);
+    EXPECT_EQ(find_line_starts("\n\n\n"), (std::vector<size_t>{0, 1, 2, 3}));
+    EXPECT_EQ(find_line_starts("ab\ncd\n"), (std::vector<size_t>{0, 3, 6}));
+}
+
+// Exercises every block alignment and the scalar tail of the vectorized scanner.
+TEST(LineIndexTest, AllAlignments) {
+    for (size_t length = 0; length <= 100; ++length) {
+        for (size_t k = 0; k <= std::min<size_t>(length, 10); ++k) {
+            std::string str = rand_string_with_newlines(length, k);
+            for (size_t offset = 0; offset < 4 && offset <= str.size(); ++offset) {
+                std::string_view view = std::string_view(str).substr(offset);
+                auto expected = naive_line_starts(view);
+                EXPECT_EQ(count_newlines(view), expected.size() - 1);
+                EXPECT_EQ(find_line_starts(view), expected);
+            }
+        }
+    }
+}
+
+TEST(LineIndexTest, NewlinesAtEveryPosition) {
+    for (size_t i = 0; i < 64; ++i) {
+        std::string str(64, 'a');
+        str[i] = '\n';
+        EXPECT_EQ(find_line_starts(str), (std::vector<size_t>{0, i + 1}));
+    }
+    std::string all(64, '\n');
+    EXPECT_EQ(find_line_starts(all), naive_line_starts(all));
+}
+
+// The public entry point only splits inputs that are tens of megabytes, and never into more chunks
+// than there are cores. Force the chunk count so the stitching is tested on any machine.
+TEST(LineIndexTest, ChunkedMatchesSerial) {
+    for (size_t length : {0, 1, 7, 8, 100, 4096, 100'003}) {
+        std::string str = rand_string_with_newlines(length, length / 10);
+        for (size_t chunks = 1; chunks <= 8; ++chunks) {
+            EXPECT_EQ(internal::find_line_starts(str, chunks), naive_line_starts(str))
+                << "chunks = " << chunks << ", length = " << length;
+        }
+    }
+}
+
+TEST(LineIndexTest, ChunkedNewlinesOnBoundaries) {
+    constexpr size_t kSize = 1024 * 1024 + 7;
+    for (size_t chunks = 2; chunks <= 8; ++chunks) {
+        std::string str(kSize, 'a');
+        size_t chunk_size = kSize / chunks;
+        for (size_t i = 1; i < chunks; ++i) {
+            str[i * chunk_size - 1] = '\n';
+            str[i * chunk_size] = '\n';
+        }
+        str.front() = '\n';
+        str.back() = '\n';
+        EXPECT_EQ(internal::find_line_starts(str, chunks), naive_line_starts(str))
+            << "chunks = " << chunks;
+    }
+}
+
+}  // namespace base
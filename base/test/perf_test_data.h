@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace base {
+
+// One ~100-byte line of text, repeated to build large benchmark inputs.
+inline constexpr std::string_view kPerfTestLongLine =
+    R"(aldksfjasldkfjalksdfjlkadsfjklasfjlskfoiewfnfmxcnvadslfkjasnkli02ijdsfklasjdflafoiwenlskdafnlksdfln
+)";
+
+// Number of `kPerfTestLongLine`s in the 1 GB sample.
+inline constexpr size_t kPerfTestLongLineCount = 10'000'000;
+
+// Returns the 1 GB sample: `kPerfTestLongLine` repeated `kPerfTestLongLineCount` times.
+inline std::string make_1gb_sample() {
+    std::string result;
+    result.reserve(kPerfTestLongLine.size() * kPerfTestLongLineCount);
+    for (size_t i = 0; i < kPerfTestLongLineCount; ++i) {
+        result += kPerfTestLongLine;
+    }
+    return result;
+}
+
+}  // namespace base
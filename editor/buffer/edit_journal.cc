@@ -0,0 +1,457 @@
+#include "base/check.h"
+#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/hash/hash.h"
+#include "build/build_config.h"
+#include "editor/buffer/edit_journal.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+#if BUILDFLAG(IS_POSIX)
+#include "base/posix/eintr_wrapper.h"
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace editor {
+
+namespace {
+
+// The file starts with a header, followed by batches of operations:
+//
+//     header: "EDJRNL01", u64 document length, u64 document hash
+//     batch:  u32 payload size, u32 checksum, payload
+//
+// Integers in headers are little endian. The checksum is the low half of the payload's rapidhash.
+// A payload is a sequence of operations, each an `Op` byte followed by its arguments as LEB128
+// varints; text is a varint length followed by the bytes.
+constexpr std::string_view kMagic = "EDJRNL01";
+constexpr size_t kHeaderSize = kMagic.size() + 16;
+constexpr size_t kBatchHeaderSize = 8;
+
+enum class Op : uint8_t {
+    kInsert = 1,           // offset, text
+    kErase,                // offset, count
+    kEdits,                // edit count, then offset, count, text for each
+    kUndo,                 //
+    kRedo,                 //
+    kBeginTransaction,     //
+    kEndTransaction,       //
+    kBreakUndoCoalescing,  //
+    kUndoLimits,           // max entries, max bytes
+};
+
+constexpr size_t kHashBlockSize = 1024 * 1024;
+
+void put_fixed(std::string& out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out += static_cast<char>(value >> (8 * i));
+    }
+}
+
+void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void put_text(std::string& out, std::string_view text) {
+    put_varint(out, text.size());
+    out += text;
+}
+
+uint32_t checksum(std::string_view payload) {
+    return static_cast<uint32_t>(base::hash_string(payload));
+}
+
+// Reads what the `put_*()` functions wrote. Reading past the end clears `ok`.
+class Reader {
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    bool ok() const { return ok_; }
+    bool exhausted() const { return data_.empty(); }
+    size_t remaining() const { return data_.size(); }
+
+    uint64_t fixed(size_t size) {
+        if (data_.size() < size) return fail();
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i) {
+            value |= uint64_t{static_cast<uint8_t>(data_[i])} << (8 * i);
+        }
+        data_.remove_prefix(size);
+        return value;
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (size_t shift = 0; shift < 64; shift += 7) {
+            if (data_.empty()) return fail();
+            auto byte = static_cast<uint8_t>(data_.front());
+            data_.remove_prefix(1);
+            value |= uint64_t{byte & 0x7fu} << shift;
+            if (byte < 0x80) return value;
+        }
+        return fail();
+    }
+
+    std::string_view bytes(size_t size) {
+        if (data_.size() < size) {
+            fail();
+            return {};
+        }
+        std::string_view result = data_.substr(0, size);
+        data_.remove_prefix(size);
+        return result;
+    }
+
+    std::string_view text() { return bytes(varint()); }
+
+private:
+    uint64_t fail() {
+        ok_ = false;
+        data_ = {};
+        return 0;
+    }
+
+    std::string_view data_;
+    bool ok_ = true;
+};
+
+// Decodes the operations in `payload`, and applies them to `tree` unless it is null. Returns false
+// if the payload is malformed.
+bool replay_batch(std::string_view payload, PieceTree* tree) {
+    Reader reader{payload};
+    std::vector<Edit> edits;
+    while (reader.ok() && !reader.exhausted()) {
+        auto op = static_cast<Op>(reader.fixed(1));
+        switch (op) {
+        case Op::kInsert: {
+            size_t offset = reader.varint();
+            std::string_view text = reader.text();
+            if (tree && reader.ok()) tree->insert(offset, text);
+            break;
+        }
+        case Op::kErase: {
+            size_t offset = reader.varint();
+            size_t count = reader.varint();
+            if (tree && reader.ok()) tree->erase(offset, count);
+            break;
+        }
+        case Op::kEdits: {
+            size_t count = reader.varint();
+            // Each edit takes at least three bytes, so this bounds the reservation.
+            if (count > reader.remaining() / 3) return false;
+            edits.clear();
+            edits.reserve(count);
+            for (size_t i = 0; i < count && reader.ok(); ++i) {
+                Edit& edit = edits.emplace_back();
+                edit.offset = reader.varint();
+                edit.count = reader.varint();
+                edit.text = reader.text();
+            }
+            if (tree && reader.ok()) tree->apply_edits(edits);
+            break;
+        }
+        case Op::kUndo:
+            if (tree) tree->undo();
+            break;
+        case Op::kRedo:
+            if (tree) tree->redo();
+            break;
+        case Op::kBeginTransaction:
+            if (tree) tree->begin_transaction();
+            break;
+        case Op::kEndTransaction:
+            if (tree) tree->end_transaction();
+            break;
+        case Op::kBreakUndoCoalescing:
+            if (tree) tree->break_undo_coalescing();
+            break;
+        case Op::kUndoLimits: {
+            size_t max_entries = reader.varint();
+            size_t max_bytes = reader.varint();
+            if (tree && reader.ok()) tree->set_undo_limits(max_entries, max_bytes);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return reader.ok();
+}
+
+}  // namespace
+
+std::unique_ptr<EditJournal> EditJournal::create(const base::FilePath& path,
+                                                 const PieceTree& tree) {
+    std::string header{kMagic};
+    put_fixed(header, tree.length(), 8);
+    put_fixed(header, content_hash(tree), 8);
+
+    FILE* file = base::OpenFile(path, "wb");
+    if (!file) {
+        spdlog::error("EditJournal::create() error: cannot create the journal");
+        return nullptr;
+    }
+    auto journal = std::unique_ptr<EditJournal>(new EditJournal(file));
+    if (fwrite(header.data(), 1, header.size(), file) != header.size() || fflush(file) != 0 ||
+        !journal->sync()) {
+        spdlog::error("EditJournal::create() error: cannot write the header");
+        return nullptr;
+    }
+    return journal;
+}
+
+std::unique_ptr<EditJournal> EditJournal::recover(const base::FilePath& path, PieceTree& tree) {
+    DCHECK(!tree.journal());
+
+    // Copy out the intact batches, so the mapping can be closed before the file is truncated.
+    std::string batches;
+    size_t valid_length = 0;
+    size_t file_length = 0;
+    {
+        base::MemoryMappedFile file;
+        if (!file.Initialize(path)) {
+            spdlog::error("EditJournal::recover() error: cannot open the journal");
+            return nullptr;
+        }
+        Reader reader{file.str()};
+        file_length = file.length();
+        if (reader.bytes(kMagic.size()) != kMagic) {
+            spdlog::error("EditJournal::recover() error: not a journal");
+            return nullptr;
+        }
+        uint64_t length = reader.fixed(8);
+        uint64_t hash = reader.fixed(8);
+        if (!reader.ok() || length != tree.length() || hash != content_hash(tree)) {
+            spdlog::error("EditJournal::recover() error: the journal is for a different document");
+            return nullptr;
+        }
+
+        valid_length = kHeaderSize;
+        while (reader.remaining() >= kBatchHeaderSize) {
+            size_t size = reader.fixed(4);
+            uint32_t expected_checksum = static_cast<uint32_t>(reader.fixed(4));
+            std::string_view payload = reader.bytes(size);
+            if (!reader.ok() || checksum(payload) != expected_checksum ||
+                !replay_batch(payload, nullptr)) {
+                break;
+            }
+            valid_length += kBatchHeaderSize + size;
+        }
+        batches = file.str().substr(kHeaderSize, valid_length - kHeaderSize);
+    }
+
+    if (valid_length < file_length) {
+        spdlog::warn("EditJournal::recover(): dropping {} bytes of torn or corrupt batches",
+                     file_length - valid_length);
+        std::error_code error;
+        std::filesystem::resize_file(std::filesystem::path{path.value()}, valid_length, error);
+        if (error) {
+            spdlog::error("EditJournal::recover() error: cannot truncate the journal");
+            return nullptr;
+        }
+    }
+    FILE* file = base::OpenFile(path, "ab");
+    if (!file) {
+        spdlog::error("EditJournal::recover() error: cannot reopen the journal");
+        return nullptr;
+    }
+
+    Reader reader{batches};
+    while (!reader.exhausted()) {
+        size_t size = reader.fixed(4);
+        reader.fixed(4);
+        replay_batch(reader.bytes(size), &tree);
+    }
+    return std::unique_ptr<EditJournal>(new EditJournal(file));
+}
+
+EditJournal::EditJournal(FILE* file) : file_(file) { writer_ = std::thread{[this] { run(); }}; }
+
+EditJournal::~EditJournal() {
+    {
+        std::lock_guard lock{mutex_};
+        stopping_ = true;
+    }
+    work_ready_.notify_one();
+    writer_.join();
+    base::CloseFile(file_);
+}
+
+template <typename F>
+void EditJournal::record(F&& encode) {
+    std::lock_guard lock{mutex_};
+    if (failed_) return;
+    size_t old_size = pending_.size();
+    encode(pending_);
+    recorded_bytes_ += pending_.size() - old_size;
+    if (writer_idle_) {
+        writer_idle_ = false;
+        work_ready_.notify_one();
+    }
+}
+
+void EditJournal::record_insert(size_t offset, std::string_view txt) {
+    record([&](std::string& out) {
+        out += static_cast<char>(Op::kInsert);
+        put_varint(out, offset);
+        put_text(out, txt);
+    });
+}
+
+void EditJournal::record_erase(size_t offset, size_t count) {
+    record([&](std::string& out) {
+        out += static_cast<char>(Op::kErase);
+        put_varint(out, offset);
+        put_varint(out, count);
+    });
+}
+
+void EditJournal::record_edits(std::span<const Edit> edits) {
+    record([&](std::string& out) {
+        out += static_cast<char>(Op::kEdits);
+        put_varint(out, edits.size());
+        for (const auto& edit : edits) {
+            put_varint(out, edit.offset);
+            put_varint(out, edit.count);
+            put_text(out, edit.text);
+        }
+    });
+}
+
+void EditJournal::record_undo() {
+    record([](std::string& out) { out += static_cast<char>(Op::kUndo); });
+}
+
+void EditJournal::record_redo() {
+    record([](std::string& out) { out += static_cast<char>(Op::kRedo); });
+}
+
+void EditJournal::record_begin_transaction() {
+    record([](std::string& out) { out += static_cast<char>(Op::kBeginTransaction); });
+}
+
+void EditJournal::record_end_transaction() {
+    record([](std::string& out) { out += static_cast<char>(Op::kEndTransaction); });
+}
+
+void EditJournal::record_break_undo_coalescing() {
+    record([](std::string& out) { out += static_cast<char>(Op::kBreakUndoCoalescing); });
+}
+
+void EditJournal::record_undo_limits(size_t max_entries, size_t max_bytes) {
+    record([&](std::string& out) {
+        out += static_cast<char>(Op::kUndoLimits);
+        put_varint(out, max_entries);
+        put_varint(out, max_bytes);
+    });
+}
+
+bool EditJournal::flush() {
+    std::unique_lock lock{mutex_};
+    uint64_t target = recorded_bytes_;
+    sync_requested_ = true;
+    work_ready_.notify_one();
+    work_done_.wait(lock, [&] { return synced_bytes_ >= target || failed_; });
+    return !failed_;
+}
+
+uint64_t EditJournal::recorded_bytes() const {
+    std::lock_guard lock{mutex_};
+    return recorded_bytes_;
+}
+
+uint64_t EditJournal::content_hash(const TextBuffer& buffer) {
+    uint64_t result = base::hash_combine(0, buffer.length());
+    // Gathers blocks that span chunks.
+    std::string block;
+    buffer.for_each_chunk(0, buffer.length(), [&](std::string_view chunk) {
+        while (!chunk.empty()) {
+            if (block.empty() && chunk.size() >= kHashBlockSize) {
+                uint64_t block_hash = base::hash_string(chunk.substr(0, kHashBlockSize));
+                result = base::hash_combine(result, block_hash);
+                chunk.remove_prefix(kHashBlockSize);
+                continue;
+            }
+            size_t count = std::min(kHashBlockSize - block.size(), chunk.size());
+            block += chunk.substr(0, count);
+            chunk.remove_prefix(count);
+            if (block.size() == kHashBlockSize) {
+                result = base::hash_combine(result, base::hash_string(block));
+                block.clear();
+            }
+        }
+        return true;
+    });
+    if (!block.empty()) result = base::hash_combine(result, base::hash_string(block));
+    return result;
+}
+
+void EditJournal::run() {
+    using Clock = std::chrono::steady_clock;
+    std::string batch;
+    auto last_write = Clock::now() - kSyncInterval;
+
+    std::unique_lock lock{mutex_};
+    while (true) {
+        // Sleep until the first operation after a quiet spell. Records only wake an idle writer,
+        // so a burst of typing costs one wakeup.
+        while (pending_.empty() && !sync_requested_ && !stopping_) {
+            writer_idle_ = true;
+            work_ready_.wait(lock);
+        }
+        writer_idle_ = false;
+        // Let the burst accumulate into one batch, unless someone is waiting for it.
+        work_ready_.wait_until(lock, last_write + kSyncInterval,
+                               [&] { return sync_requested_ || stopping_; });
+
+        batch.swap(pending_);
+        uint64_t end = recorded_bytes_;
+        sync_requested_ = false;
+        lock.unlock();
+
+        bool ok = (batch.empty() || write_batch(batch)) && sync();
+        batch.clear();
+        last_write = Clock::now();
+
+        lock.lock();
+        if (!ok && !failed_) {
+            spdlog::error("EditJournal error: cannot write the journal: {}", strerror(errno));
+            failed_ = true;
+            pending_.clear();
+        }
+        synced_bytes_ = end;
+        work_done_.notify_all();
+        if (stopping_ && pending_.empty()) return;
+    }
+}
+
+bool EditJournal::write_batch(std::string_view batch) {
+    if (batch.size() > UINT32_MAX) {
+        errno = EFBIG;
+        return false;
+    }
+    std::string header;
+    put_fixed(header, batch.size(), 4);
+    put_fixed(header, checksum(batch), 4);
+    return fwrite(header.data(), 1, header.size(), file_) == header.size() &&
+           fwrite(batch.data(), 1, batch.size(), file_) == batch.size() && fflush(file_) == 0;
+}
+
+bool EditJournal::sync() {
+#if BUILDFLAG(IS_POSIX)
+    return HANDLE_EINTR(fsync(fileno(file_))) == 0;
+#else
+    return _commit(_fileno(file_)) == 0;
+#endif
+}
+
+}  // namespace editor
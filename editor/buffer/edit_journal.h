@@ -0,0 +1,101 @@
+#pragma once
+
+#include "base/files/file_path.h"
+#include "editor/buffer/piece_tree.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace editor {
+
+// An append-only log of the operations applied to a `PieceTree`, for recovering unsaved work after
+// a crash without periodically writing out the whole document. A tree journals into the journal
+// set with `PieceTree::set_journal()`.
+//
+// The journal starts with the length and `content_hash()` of the document it was created for.
+// Recovery replays it onto a fresh tree holding that document: edits, undo, redo and transaction
+// boundaries are all logged, so both the document and its undo history come back as they were.
+//
+// Recording only encodes the operation into a buffer. A background thread appends the buffer to
+// the file as a checksummed batch and fsyncs it, at most once every `kSyncInterval`, so a crash
+// loses at most that much work. A batch torn by a crash fails its checksum, and recovery stops
+// just before it.
+class EditJournal {
+public:
+    static constexpr std::chrono::milliseconds kSyncInterval{100};
+
+    // Creates a journal at `path` for the current contents of `tree`, replacing any existing file.
+    // Returns null on failure.
+    static std::unique_ptr<EditJournal> create(const base::FilePath& path, const PieceTree& tree);
+
+    // Replays the journal at `path` onto `tree`, which must hold the document the journal was
+    // created for, and reopens the journal to keep appending to it. Returns null and leaves `tree`
+    // untouched if the journal can't be read or belongs to a different document. A torn batch at
+    // the end is dropped from the file.
+    static std::unique_ptr<EditJournal> recover(const base::FilePath& path, PieceTree& tree);
+
+    // Writes out and syncs everything recorded so far. Detach the journal from its tree first.
+    ~EditJournal();
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    // Recording. Called by `PieceTree` for each operation that changes it.
+    void record_insert(size_t offset, std::string_view txt);
+    void record_erase(size_t offset, size_t count);
+    void record_edits(std::span<const Edit> edits);
+    void record_undo();
+    void record_redo();
+    void record_begin_transaction();
+    void record_end_transaction();
+    void record_break_undo_coalescing();
+    void record_undo_limits(size_t max_entries, size_t max_bytes);
+
+    // Blocks until everything recorded so far is written and synced. Returns false if a write has
+    // failed, after which the journal records nothing more.
+    bool flush();
+    // Bytes of encoded operations recorded so far, excluding headers.
+    uint64_t recorded_bytes() const;
+
+    // The hash stored in the header: rapidhash of each 1 MiB block of the text, combined.
+    static uint64_t content_hash(const TextBuffer& buffer);
+
+private:
+    explicit EditJournal(FILE* file);
+
+    // Appends one operation to `pending_`, encoded by `encode`.
+    template <typename F>
+    void record(F&& encode);
+
+    // The writer thread.
+    void run();
+    bool write_batch(std::string_view batch);
+    bool sync();
+
+    FILE* file_;
+    std::thread writer_;
+
+    mutable std::mutex mutex_;
+    // Signals the writer that there is work, and waiters in `flush()` that it has been done.
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+    // Encoded operations waiting for the writer.
+    std::string pending_;
+    // Bytes of operations recorded and synced over the journal's lifetime.
+    uint64_t recorded_bytes_ = 0;
+    uint64_t synced_bytes_ = 0;
+    // Whether the writer is waiting for operations, and so needs waking up for the next one.
+    bool writer_idle_ = false;
+    bool sync_requested_ = false;
+    bool stopping_ = false;
+    bool failed_ = false;
+};
+
+}  // namespace editor
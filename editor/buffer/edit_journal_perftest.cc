@@ -0,0 +1,116 @@
+#include "base/debug/profiler.h"
+#include "base/files/file_reader.h"
+#include "base/rand_util.h"
+#include "base/test/perf_test_data.h"
+#include "editor/buffer/edit_journal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <print>
+
+namespace editor {
+
+namespace {
+
+constexpr size_t N = 100'000;
+
+constexpr std::string_view kJournalName = "edit_journal_perftest.journal";
+const base::FilePath kJournalPath{FILE_PATH_LITERAL("edit_journal_perftest.journal")};
+constexpr std::string_view kFileName = "edit_journal_perftest_1gb.txt";
+const base::FilePath kFilePath{FILE_PATH_LITERAL("edit_journal_perftest_1gb.txt")};
+
+// Types `N` characters with line breaks, and returns the mean time per keystroke.
+std::chrono::nanoseconds type_keystrokes(PieceTree& tree) {
+    size_t caret = tree.length() / 2;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(caret, i % 80 == 79 ? "\n" : "a");
+        ++caret;
+    }
+    return (std::chrono::steady_clock::now() - start) / N;
+}
+
+PieceTree open_1gb_file() {
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    EXPECT_TRUE(file->Initialize(kFilePath));
+    return PieceTree{std::move(file)};
+}
+
+}  // namespace
+
+// The time journaling adds to each keystroke on the editing thread. Writes and syncs happen on the
+// journal's own thread.
+TEST(EditJournalPerfTest, KeystrokeCost) {
+    std::string text = base::rand_string_with_newlines(N * 10, N / 5);
+
+    PieceTree plain{text};
+    std::println("Keystroke without a journal: {} ns", type_keystrokes(plain).count());
+
+    PieceTree tree{text};
+    auto journal = EditJournal::create(kJournalPath, tree);
+    ASSERT_TRUE(journal);
+    tree.set_journal(journal.get());
+    std::println("Keystroke with a journal: {} ns", type_keystrokes(tree).count());
+    std::println("Journal bytes per keystroke: {:.1f}",
+                 static_cast<double>(journal->recorded_bytes()) / N);
+
+    auto p = base::Profiler{"Flushing the journal after typing"};
+    EXPECT_TRUE(journal->flush());
+    p.stop_micro();
+
+    tree.set_journal(nullptr);
+    journal.reset();
+    std::remove(kJournalName.data());
+}
+
+// Recovery replays the journal onto the freshly opened file instead of re-reading a saved copy.
+TEST(EditJournalPerfTest, Recover1GBFileWith100kEdits) {
+    base::WriteFile(kFileName, base::make_1gb_sample());
+
+    uint64_t expected_hash;
+    {
+        PieceTree tree = open_1gb_file();
+        auto p1 = base::Profiler{"Creating a journal for a 1 GB file"};
+        auto journal = EditJournal::create(kJournalPath, tree);
+        p1.stop_mili();
+        ASSERT_TRUE(journal);
+        tree.set_journal(journal.get());
+
+        // Bursts of typing and deleting at random places, with the occasional undo.
+        size_t caret = 0;
+        for (size_t i = 0; i < N; i++) {
+            if (i % 50 == 0) {
+                caret = base::rand_int(0, tree.length());
+                tree.break_undo_coalescing();
+            }
+            int action = base::rand_int(0, 99);
+            if (action < 80) {
+                tree.insert(caret, i % 40 == 39 ? "\n" : "x");
+                ++caret;
+            } else if (action < 98) {
+                if (caret > 0) tree.erase(--caret, 1);
+            } else {
+                tree.undo();
+                caret = std::min(caret, tree.length());
+            }
+        }
+        EXPECT_TRUE(journal->flush());
+        tree.set_journal(nullptr);
+        expected_hash = EditJournal::content_hash(tree);
+        std::println("Journal: {} KB for {} edits", journal->recorded_bytes() / 1024, N);
+    }
+
+    auto p2 = base::Profiler{"Recovering 100k edits to a 1 GB file, including opening it"};
+    PieceTree recovered = open_1gb_file();
+    auto journal = EditJournal::recover(kJournalPath, recovered);
+    p2.stop_mili();
+    ASSERT_TRUE(journal);
+    EXPECT_EQ(EditJournal::content_hash(recovered), expected_hash);
+
+    journal.reset();
+    std::remove(kJournalName.data());
+    std::remove(kFileName.data());
+}
+
+}  // namespace editor
@@ -0,0 +1,199 @@
+#include "base/files/file_reader.h"
+#include "base/rand_util.h"
+#include "editor/buffer/edit_journal.h"
+#include <cstdio>
+#include <filesystem>
+#include <gtest/gtest.h>
+
+namespace editor {
+
+namespace {
+
+constexpr std::string_view kFileName = "edit_journal_unittest.journal";
+const base::FilePath kFilePath{FILE_PATH_LITERAL("edit_journal_unittest.journal")};
+
+constexpr std::string_view kText = "Hello world!\nSecond line\n";
+
+// Undoes everything in `tree`, collecting the document after each step.
+std::vector<std::string> undo_all(PieceTree& tree) {
+    std::vector<std::string> states{tree.str()};
+    while (tree.undo()) states.push_back(tree.str());
+    return states;
+}
+
+}  // namespace
+
+TEST(EditJournalTest, RecoversDocumentAndUndoHistory) {
+    PieceTree tree{kText};
+    {
+        auto journal = EditJournal::create(kFilePath, tree);
+        ASSERT_TRUE(journal);
+        tree.set_journal(journal.get());
+
+        tree.set_undo_limits(100, 1000);
+        tree.insert(5, ",");
+        tree.insert(6, " dear");
+        tree.break_undo_coalescing();
+        tree.erase(0, 1);
+        tree.insert(0, "J");
+        tree.undo();
+        tree.undo();
+        tree.redo();
+        tree.begin_transaction();
+        tree.insert(tree.length(), "Third line\n");
+        tree.erase(0, 6);
+        tree.end_transaction();
+        std::vector<Edit> edits = {{0, 1, "X"}, {4, 0, "++"}};
+        tree.apply_edits(edits);
+
+        EXPECT_TRUE(journal->flush());
+        tree.set_journal(nullptr);
+    }
+
+    PieceTree recovered{kText};
+    auto journal = EditJournal::recover(kFilePath, recovered);
+    ASSERT_TRUE(journal);
+    EXPECT_EQ(recovered.str(), tree.str());
+    EXPECT_EQ(undo_all(recovered), undo_all(tree));
+
+    journal.reset();
+    std::remove(kFileName.data());
+}
+
+TEST(EditJournalTest, KeepsAppendingAfterRecovery) {
+    PieceTree tree{kText};
+    {
+        auto journal = EditJournal::create(kFilePath, tree);
+        ASSERT_TRUE(journal);
+        tree.set_journal(journal.get());
+        tree.insert(0, "first ");
+        tree.set_journal(nullptr);
+    }
+    {
+        PieceTree recovered{kText};
+        auto journal = EditJournal::recover(kFilePath, recovered);
+        ASSERT_TRUE(journal);
+        recovered.set_journal(journal.get());
+        recovered.insert(0, "second ");
+        recovered.set_journal(nullptr);
+    }
+
+    PieceTree recovered{kText};
+    ASSERT_TRUE(EditJournal::recover(kFilePath, recovered));
+    EXPECT_EQ(recovered.str(), "second first Hello world!\nSecond line\n");
+    std::remove(kFileName.data());
+}
+
+TEST(EditJournalTest, RejectsOtherDocuments) {
+    PieceTree tree{kText};
+    ASSERT_TRUE(EditJournal::create(kFilePath, tree));
+
+    PieceTree other{"Hello world!\nSecond line!"};
+    EXPECT_FALSE(EditJournal::recover(kFilePath, other));
+    PieceTree shorter{"Hello"};
+    EXPECT_FALSE(EditJournal::recover(kFilePath, shorter));
+
+    base::WriteFile(kFileName, "not a journal");
+    EXPECT_FALSE(EditJournal::recover(kFilePath, tree));
+    std::remove(kFileName.data());
+    EXPECT_FALSE(EditJournal::recover(kFilePath, tree));
+    EXPECT_EQ(tree.str(), kText);
+}
+
+// A crash in the middle of writing a batch leaves a torn tail, which recovery drops.
+TEST(EditJournalTest, DropsTornBatch) {
+    PieceTree tree{kText};
+    std::string after_first_batch;
+    {
+        auto journal = EditJournal::create(kFilePath, tree);
+        ASSERT_TRUE(journal);
+        tree.set_journal(journal.get());
+        tree.insert(0, "kept ");
+        ASSERT_TRUE(journal->flush());
+        after_first_batch = tree.str();
+        tree.insert(0, "torn ");
+        tree.set_journal(nullptr);
+    }
+    std::string contents = base::ReadFile(kFileName);
+    base::WriteFile(kFileName, std::string_view{contents}.substr(0, contents.size() - 2));
+
+    PieceTree recovered{kText};
+    ASSERT_TRUE(EditJournal::recover(kFilePath, recovered));
+    EXPECT_EQ(recovered.str(), after_first_batch);
+    // The torn batch was cut off, so later batches aren't hidden behind it.
+    EXPECT_LT(std::filesystem::file_size(kFileName), contents.size() - 2);
+    std::remove(kFileName.data());
+}
+
+TEST(EditJournalTest, CopiesDontRecord) {
+    PieceTree tree{kText};
+    auto journal = EditJournal::create(kFilePath, tree);
+    ASSERT_TRUE(journal);
+    tree.set_journal(journal.get());
+
+    PieceTree copy = tree;
+    EXPECT_EQ(copy.journal(), nullptr);
+    copy.insert(0, "copy ");
+    EXPECT_EQ(tree.snapshot()->journal(), nullptr);
+
+    PieceTree moved = std::move(tree);
+    EXPECT_EQ(moved.journal(), journal.get());
+    moved.assign("new document");
+    EXPECT_EQ(moved.journal(), nullptr);
+    EXPECT_EQ(journal->recorded_bytes(), uint64_t{0});
+
+    journal.reset();
+    std::remove(kFileName.data());
+}
+
+TEST(EditJournalTest, RandomEdits) {
+    std::string text = base::rand_string_with_newlines(10'000, 200);
+    PieceTree tree{text};
+    {
+        auto journal = EditJournal::create(kFilePath, tree);
+        ASSERT_TRUE(journal);
+        tree.set_journal(journal.get());
+        for (int i = 0; i < 2000; ++i) {
+            int action = base::rand_int(0, 9);
+            size_t offset = base::rand_int(0, static_cast<int>(tree.length()));
+            if (action == 0) {
+                tree.undo();
+            } else if (action == 1) {
+                tree.redo();
+            } else if (action == 2) {
+                tree.break_undo_coalescing();
+            } else if (action % 2 == 0) {
+                size_t length = base::rand_int(1, 20);
+                tree.insert(offset, base::rand_string_with_newlines(length, length / 5));
+            } else {
+                tree.erase(offset, base::rand_int(1, 20));
+            }
+            // Exercise batches of every size.
+            if (base::rand_int(0, 99) == 0) ASSERT_TRUE(journal->flush());
+        }
+        tree.set_journal(nullptr);
+    }
+
+    PieceTree recovered{text};
+    ASSERT_TRUE(EditJournal::recover(kFilePath, recovered));
+    EXPECT_EQ(recovered.str(), tree.str());
+    EXPECT_EQ(undo_all(recovered), undo_all(tree));
+    std::remove(kFileName.data());
+}
+
+TEST(EditJournalTest, ContentHash) {
+    // The hash depends on the text, not on how it is split into pieces.
+    std::string text = base::rand_string_with_newlines(3 * 1024 * 1024, 1000);
+    PieceTree whole{text};
+    PieceTree pieces{text.substr(0, 1000)};
+    for (size_t offset = 1000; offset < text.size(); offset += 777) {
+        pieces.insert(offset, std::string_view{text}.substr(offset, 777));
+    }
+    ASSERT_EQ(pieces.str(), text);
+    EXPECT_EQ(EditJournal::content_hash(whole), EditJournal::content_hash(pieces));
+
+    pieces.insert(text.size() / 2, "x");
+    EXPECT_NE(EditJournal::content_hash(whole), EditJournal::content_hash(pieces));
+}
+
+}  // namespace editor
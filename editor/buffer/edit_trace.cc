@@ -0,0 +1,140 @@
+#include "base/files/memory_mapped_file.h"
+#include "editor/buffer/edit_trace.h"
+#include <charconv>
+#include <format>
+#include <spdlog/spdlog.h>
+
+namespace editor {
+
+namespace {
+
+// Parses a number followed by a space, and advances `str` past both.
+template <typename T>
+bool consume_number(std::string_view& str, T& result, int base = 10) {
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), result, base);
+    if (ec != std::errc{}) return false;
+    str.remove_prefix(static_cast<size_t>(ptr - str.data()));
+    if (!str.empty() && str.front() == ' ') str.remove_prefix(1);
+    return true;
+}
+
+bool unescape(std::string_view str, std::string& result) {
+    result.clear();
+    result.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] != '\\') {
+            result += str[i];
+            continue;
+        }
+        if (++i == str.size()) return false;
+        switch (str[i]) {
+        case 'n':
+            result += '\n';
+            break;
+        case 'r':
+            result += '\r';
+            break;
+        case 't':
+            result += '\t';
+            break;
+        case '\\':
+            result += '\\';
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+void append_escaped(std::string& out, std::string_view str) {
+    for (char ch : str) {
+        switch (ch) {
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        default:
+            out += ch;
+        }
+    }
+}
+
+}  // namespace
+
+uint64_t edit_trace_hash(std::string_view str) {
+    uint64_t result = 0xcbf29ce484222325;
+    for (char ch : str) {
+        result = (result ^ static_cast<uint8_t>(ch)) * 0x100000001b3;
+    }
+    return result;
+}
+
+std::optional<EditTrace> parse_edit_trace(std::string_view contents) {
+    EditTrace trace;
+    bool has_header = false;
+    size_t line_number = 0;
+    while (!contents.empty()) {
+        size_t end = contents.find('\n');
+        std::string_view line = contents.substr(0, end);
+        contents.remove_prefix(end == std::string_view::npos ? contents.size() : end + 1);
+        ++line_number;
+        // Raw carriage returns are always escaped, so this one comes from a CRLF checkout.
+        if (line.ends_with('\r')) line.remove_suffix(1);
+
+        if (line.starts_with('#')) continue;
+
+        bool valid;
+        if (!has_header) {
+            valid = line.starts_with("final ");
+            line.remove_prefix(valid ? 6 : 0);
+            valid = valid && consume_number(line, trace.final_length) &&
+                    consume_number(line, trace.final_line_feed_count) &&
+                    consume_number(line, trace.final_hash, 16) && line.empty();
+            has_header = true;
+        } else {
+            TraceEdit& edit = trace.edits.emplace_back();
+            valid = consume_number(line, edit.offset) && consume_number(line, edit.erase_count) &&
+                    unescape(line, edit.text);
+        }
+        if (!valid) {
+            spdlog::error("parse_edit_trace() error: malformed line {}", line_number);
+            return std::nullopt;
+        }
+    }
+    if (!has_header) {
+        spdlog::error("parse_edit_trace() error: missing the `final` line");
+        return std::nullopt;
+    }
+    return trace;
+}
+
+std::optional<EditTrace> read_edit_trace(const base::FilePath& path) {
+    base::MemoryMappedFile file;
+    if (!file.Initialize(path)) {
+        spdlog::error("read_edit_trace() error: could not open the trace");
+        return std::nullopt;
+    }
+    return parse_edit_trace(file.str());
+}
+
+std::string format_edit_trace(const EditTrace& trace) {
+    std::string out = std::format("final {} {} {:016x}\n", trace.final_length,
+                                  trace.final_line_feed_count, trace.final_hash);
+    for (const auto& edit : trace.edits) {
+        std::format_to(std::back_inserter(out), "{} {} ", edit.offset, edit.erase_count);
+        append_escaped(out, edit.text);
+        out += '\n';
+    }
+    return out;
+}
+
+}  // namespace editor
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "base/files/file_path.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+// One recorded edit: erase `erase_count` bytes at `offset`, then insert `text` there.
+struct TraceEdit {
+    size_t offset = 0;
+    size_t erase_count = 0;
+    std::string text;
+
+    friend bool operator==(const TraceEdit&, const TraceEdit&) = default;
+};
+
+// A recorded editing session, replayed from an empty buffer by the edit trace benchmarks.
+//
+// Traces are UTF-8 text files:
+//
+//     # Lines starting with '#' are comments.
+//     final <length> <line feed count> <hash>
+//     <offset> <erase count> <text>
+//     ...
+//
+// The `final` line describes the buffer after the last edit, with its `edit_trace_hash()` in hex,
+// so a replay can be checked without a reference implementation. Every following line is one
+// edit. Offsets are in bytes and always fall on codepoint boundaries. `text` is the rest of the
+// line after the second space, with `\n`, `\r`, `\t` and `\\` escaped, and may be empty.
+struct EditTrace {
+    size_t final_length = 0;
+    size_t final_line_feed_count = 0;
+    uint64_t final_hash = 0;
+    std::vector<TraceEdit> edits;
+};
+
+// 64-bit FNV-1a. Slow, but simple enough to reimplement in the script that generates traces.
+uint64_t edit_trace_hash(std::string_view str);
+
+// Returns std::nullopt if `contents` is malformed, logging the offending line.
+std::optional<EditTrace> parse_edit_trace(std::string_view contents);
+// Returns std::nullopt if the file can't be read or is malformed.
+std::optional<EditTrace> read_edit_trace(const base::FilePath& path);
+// The inverse of `parse_edit_trace()`, without comments.
+std::string format_edit_trace(const EditTrace& trace);
+
+}  // namespace editor
@@ -0,0 +1,131 @@
+#include "base/check.h"
+#include "base/debug/memory_usage.h"
+#include "base/path_service.h"
+#include "editor/buffer/edit_trace.h"
+#include "editor/buffer/text_buffer.h"
+#include "experiments/fuzz/string_buffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <gtest/gtest.h>
+#include <print>
+#include <vector>
+
+namespace editor {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The buffers traces are replayed on. `StringBuffer` is the naive baseline.
+enum class ReplayTarget { kStringBuffer, kPieceTree, kRope };
+
+std::string_view to_string(ReplayTarget target) {
+    switch (target) {
+    case ReplayTarget::kStringBuffer:
+        return "string_buffer";
+    case ReplayTarget::kPieceTree:
+        return "piece_tree";
+    case ReplayTarget::kRope:
+        return "rope";
+    }
+    NOTREACHED();
+}
+
+// The traces are copied next to the test binary by the `edit_traces` GN target.
+std::optional<EditTrace> load_trace(const base::FilePath::CharType* file_name) {
+    base::FilePath exe_path;
+    base::PathService::get(base::PathKey::kFileExe, &exe_path);
+    return read_edit_trace(
+        exe_path.DirName().Append(FILE_PATH_LITERAL("edit_traces")).Append(file_name));
+}
+
+double to_micros(int64_t nanos) { return static_cast<double>(nanos) / 1000.0; }
+
+// Replays `trace` on the buffer `make()` returns, prints its throughput, per-edit latency and the
+// peak resident memory the replay added, and returns the final contents.
+template <typename F>
+std::string replay(std::string_view label, const EditTrace& trace, F&& make) {
+    std::vector<int64_t> latencies(trace.edits.size());
+
+    bool peak_was_reset = base::reset_peak_resident_memory();
+    size_t peak_before = base::peak_resident_memory_bytes();
+
+    auto buffer = make();
+    auto start = Clock::now();
+    for (size_t i = 0; i < trace.edits.size(); ++i) {
+        const TraceEdit& edit = trace.edits[i];
+        auto t1 = Clock::now();
+        if (edit.erase_count > 0) buffer->erase(edit.offset, edit.erase_count);
+        if (!edit.text.empty()) buffer->insert(edit.offset, edit.text);
+        auto t2 = Clock::now();
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    size_t peak_after = base::peak_resident_memory_bytes();
+
+    std::ranges::sort(latencies);
+    size_t count = latencies.size();
+    std::println("{}: {} edits, {:.0f} ops/s, p50 {:.2f} µs, p99 {:.2f} µs, max {:.0f} µs", label,
+                 count, static_cast<double>(count) / seconds, to_micros(latencies[count / 2]),
+                 to_micros(latencies[count * 99 / 100]), to_micros(latencies.back()));
+    if (peak_was_reset) {
+        std::println("{}: peak resident delta {:.1f} MB", label,
+                     static_cast<double>(peak_after - peak_before) / 1024 / 1024);
+    } else {
+        std::println("{}: peak resident (process lifetime) {} MB", label,
+                     peak_after / 1024 / 1024);
+    }
+    return buffer->str();
+}
+
+// Each test replays one trace on one buffer, so it can run on its own with --gtest_filter. Do that
+// for comparable peaks: within one process, memory an earlier replay freed is reused without
+// raising the peak.
+class EditTracePerfTest : public testing::TestWithParam<ReplayTarget> {
+protected:
+    void replay_trace(std::string_view name, const base::FilePath::CharType* file_name) {
+        auto trace = load_trace(file_name);
+        ASSERT_TRUE(trace.has_value());
+        ASSERT_FALSE(trace->edits.empty());
+
+        std::string label = std::format("{} {}", name, to_string(GetParam()));
+        std::string result;
+        if (GetParam() == ReplayTarget::kStringBuffer) {
+            result = replay(label, *trace, [] { return std::make_unique<StringBuffer>(); });
+        } else {
+            auto backend = GetParam() == ReplayTarget::kPieceTree ? TextBufferBackend::kPieceTree
+                                                                  : TextBufferBackend::kRope;
+            result = replay(label, *trace, [backend] { return make_text_buffer(backend, ""); });
+        }
+
+        // Not EXPECT_EQ on the contents, which would print the whole document.
+        EXPECT_EQ(result.size(), trace->final_length);
+        EXPECT_EQ(static_cast<size_t>(std::ranges::count(result, '\n')),
+                  trace->final_line_feed_count);
+        EXPECT_EQ(edit_trace_hash(result), trace->final_hash);
+    }
+};
+
+}  // namespace
+
+// Writing a file from scratch, one codepoint at a time.
+TEST_P(EditTracePerfTest, Compose) { replay_trace("compose", FILE_PATH_LITERAL("compose.txt")); }
+
+// Small edits, line moves and pastes all over a large file.
+TEST_P(EditTracePerfTest, Revise) { replay_trace("revise", FILE_PATH_LITERAL("revise.txt")); }
+
+// Renames and reindents, sweeping front to back through a large file.
+TEST_P(EditTracePerfTest, Refactor) {
+    replay_trace("refactor", FILE_PATH_LITERAL("refactor.txt"));
+}
+
+INSTANTIATE_TEST_SUITE_P(Buffers,
+                         EditTracePerfTest,
+                         testing::Values(ReplayTarget::kStringBuffer,
+                                         ReplayTarget::kPieceTree,
+                                         ReplayTarget::kRope),
+                         [](const auto& info) { return std::string{to_string(info.param)}; });
+
+}  // namespace editor
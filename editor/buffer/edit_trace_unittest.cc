@@ -0,0 +1,61 @@
+#include "editor/buffer/edit_trace.h"
+#include <gtest/gtest.h>
+
+namespace editor {
+
+TEST(EditTraceTest, Parse) {
+    auto trace = parse_edit_trace("# A comment.\n"
+                                  "final 9 1 00000000000000ff\n"
+                                  "0 0 hello\\tworld\n"
+                                  "5 1  \\\\\n"
+                                  "0 5 \n"
+                                  "0 0 a\\nb\r\n");
+    ASSERT_TRUE(trace.has_value());
+    EXPECT_EQ(trace->final_length, size_t{9});
+    EXPECT_EQ(trace->final_line_feed_count, size_t{1});
+    EXPECT_EQ(trace->final_hash, uint64_t{255});
+    std::vector<TraceEdit> expected = {
+        {0, 0, "hello\tworld"},
+        {5, 1, " \\"},
+        {0, 5, ""},
+        {0, 0, "a\nb"},
+    };
+    EXPECT_EQ(trace->edits, expected);
+}
+
+TEST(EditTraceTest, RoundTrip) {
+    EditTrace trace{
+        .final_length = 4,
+        .final_line_feed_count = 1,
+        .final_hash = 0xfedcba9876543210,
+        .edits = {{0, 0, "ab\r\n"}, {1, 2, ""}, {0, 0, " é😄"}, {3, 0, "\\n"}},
+    };
+    auto parsed = parse_edit_trace(format_edit_trace(trace));
+    ASSERT_TRUE(parsed.has_value());
+    EXPECT_EQ(parsed->final_length, trace.final_length);
+    EXPECT_EQ(parsed->final_line_feed_count, trace.final_line_feed_count);
+    EXPECT_EQ(parsed->final_hash, trace.final_hash);
+    EXPECT_EQ(parsed->edits, trace.edits);
+}
+
+TEST(EditTraceTest, Malformed) {
+    EXPECT_FALSE(parse_edit_trace(""));
+    EXPECT_FALSE(parse_edit_trace("# Only a comment.\n"));
+    EXPECT_FALSE(parse_edit_trace("0 0 a\n"));
+    EXPECT_FALSE(parse_edit_trace("final 1 0\n"));
+    EXPECT_FALSE(parse_edit_trace("final 1 0 ab extra\n"));
+    EXPECT_FALSE(parse_edit_trace("final 1 0 ab\n0\n"));
+    EXPECT_FALSE(parse_edit_trace("final 1 0 ab\n0 x a\n"));
+    EXPECT_FALSE(parse_edit_trace("final 1 0 ab\n0 0 bad \\escape\n"));
+    EXPECT_FALSE(parse_edit_trace("final 1 0 ab\n0 0 trailing\\\n"));
+    EXPECT_TRUE(parse_edit_trace("final 0 0 cbf29ce484222325\n"));
+}
+
+TEST(EditTraceTest, Hash) {
+    // Reference values for 64-bit FNV-1a.
+    EXPECT_EQ(edit_trace_hash(""), uint64_t{0xcbf29ce484222325});
+    EXPECT_EQ(edit_trace_hash("a"), uint64_t{0xaf63dc4c8601ec8c});
+    EXPECT_EQ(edit_trace_hash("foobar"), uint64_t{0x85944171f73967e8});
+}
+
+}  // namespace editor
@@ -0,0 +1,147 @@
+#include "base/check.h"
+#include "base/compiler_specific.h"
+#include "editor/buffer/line_start_index.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace editor {
+
+LineStartIndex::LineStartIndex(std::span<const size_t> starts) : size_(starts.size()) {
+    // Starts are sorted, so the widest offset in each block is its last one.
+    auto block_width = [&](size_t first, size_t last) {
+        return width_for(starts[last] - starts[first]);
+    };
+    size_t data_size = 0;
+    for (size_t first = 0; first < starts.size(); first += kBlockSize) {
+        size_t last = std::min(first + kBlockSize, starts.size()) - 1;
+        data_size += (last - first) * block_width(first, last);
+    }
+    blocks_.reserve((starts.size() + kBlockSize - 1) / kBlockSize);
+    data_.reserve(data_size);
+
+    for (size_t first = 0; first < starts.size(); first += kBlockSize) {
+        size_t last = std::min(first + kBlockSize, starts.size()) - 1;
+        size_t width = block_width(first, last);
+        blocks_.push_back({.base = starts[first], .data_offset = data_.size(), .width = width});
+        for (size_t i = first + 1; i <= last; ++i) {
+            DCHECK_GE(starts[i], starts[i - 1]);
+            write_delta(starts[i] - starts[first], width);
+        }
+    }
+}
+
+void LineStartIndex::push_back(size_t start) {
+    DCHECK(empty() || start >= back());
+    size_t j = size_ % kBlockSize;
+    if (j == 0) {
+        blocks_.push_back({.base = start, .data_offset = data_.size(), .width = 1});
+        ++size_;
+        return;
+    }
+
+    Block& block = blocks_.back();
+    size_t delta = start - block.base;
+    size_t width = width_for(delta);
+    if (width > block.width) {
+        // Offsets only grow within a block, so this happens at most three times per block.
+        std::array<size_t, kBlockSize> deltas;
+        for (size_t k = 1; k < j; ++k) deltas[k] = delta_at(block, k);
+        data_.resize(block.data_offset);
+        block.width = width;
+        for (size_t k = 1; k < j; ++k) write_delta(deltas[k], width);
+    }
+    write_delta(delta, block.width);
+    ++size_;
+}
+
+size_t LineStartIndex::operator[](size_t i) const {
+    DCHECK_LT(i, size_);
+    const Block& block = blocks_[i / kBlockSize];
+    size_t j = i % kBlockSize;
+    return j == 0 ? block.base : block.base + delta_at(block, j);
+}
+
+size_t LineStartIndex::line_containing(size_t offset) const {
+    DCHECK(!empty());
+    DCHECK_LE(blocks_.front().base, offset);
+    auto it = std::ranges::upper_bound(blocks_, offset, {}, &Block::base);
+    size_t b = static_cast<size_t>(it - blocks_.begin()) - 1;
+    const Block& block = blocks_[b];
+    size_t delta = offset - block.base;
+
+    // Entry `low` is at or before `offset`; entry `high` (if any) is past it.
+    size_t low = 0;
+    size_t high = std::min(kBlockSize, size_ - b * kBlockSize);
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (delta_at(block, mid) <= delta) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return b * kBlockSize + low;
+}
+
+size_t LineStartIndex::memory_bytes() const {
+    return blocks_.capacity() * sizeof(Block) + data_.capacity();
+}
+
+size_t LineStartIndex::width_for(size_t delta) {
+    if (delta <= UINT8_MAX) return 1;
+    if (delta <= UINT16_MAX) return 2;
+    if (delta <= UINT32_MAX) return 4;
+    return 8;
+}
+
+size_t LineStartIndex::delta_at(const Block& block, size_t j) const {
+    const uint8_t* p = UNSAFE_TODO(data_.data() + block.data_offset + (j - 1) * block.width);
+    switch (block.width) {
+    case 1:
+        return *p;
+    case 2: {
+        uint16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    case 4: {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    default: {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    }
+}
+
+void LineStartIndex::write_delta(size_t delta, size_t width) {
+    // Native byte order: the index only ever lives in memory.
+    uint8_t bytes[sizeof(uint64_t)];
+    switch (width) {
+    case 1:
+        bytes[0] = static_cast<uint8_t>(delta);
+        break;
+    case 2: {
+        auto value = static_cast<uint16_t>(delta);
+        std::memcpy(bytes, &value, sizeof(value));
+        break;
+    }
+    case 4: {
+        auto value = static_cast<uint32_t>(delta);
+        std::memcpy(bytes, &value, sizeof(value));
+        break;
+    }
+    default: {
+        uint64_t value = delta;
+        std::memcpy(bytes, &value, sizeof(value));
+        break;
+    }
+    }
+    data_.insert(data_.end(), bytes, UNSAFE_TODO(bytes + width));
+}
+
+}  // namespace editor
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace editor {
+
+// The line starts of a buffer, compressed with block-delta encoding. Entries are grouped into
+// blocks of `kBlockSize`. Each block stores its first entry in full, and the others as offsets
+// from it in the fewest bytes (1, 2, 4 or 8) that fit the whole block. With lines of up to about
+// a kilobyte, that is 2 bytes per line plus a 16-byte header per block, instead of 8 bytes per
+// line. Any entry is decoded in O(1).
+class LineStartIndex {
+public:
+    static constexpr size_t kBlockSize = 64;
+
+    LineStartIndex() = default;
+    // `starts` must be sorted.
+    explicit LineStartIndex(std::span<const size_t> starts);
+
+    // Appends `start`, which must not be less than `back()`. The last block is re-encoded when
+    // `start` needs a wider offset, so appends take amortized O(1).
+    void push_back(size_t start);
+
+    size_t operator[](size_t i) const;
+    size_t back() const { return (*this)[size_ - 1]; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // The index of the last entry that is not greater than `offset`, i.e. the line containing it.
+    // The first entry must not be greater than `offset`. Takes O(log n).
+    size_t line_containing(size_t offset) const;
+
+    // Heap memory used, including spare capacity.
+    size_t memory_bytes() const;
+
+private:
+    struct Block {
+        uint64_t base;
+        // Where the block's offsets start in `data_`, and their width in bytes.
+        uint64_t data_offset : 56;
+        uint64_t width : 8;
+    };
+
+    static size_t width_for(size_t delta);
+    // The offset of entry `j` (at least 1) of `block` from its base.
+    size_t delta_at(const Block& block, size_t j) const;
+    void write_delta(size_t delta, size_t width);
+
+    std::vector<Block> blocks_;
+    std::vector<uint8_t> data_;
+    size_t size_ = 0;
+};
+
+}  // namespace editor
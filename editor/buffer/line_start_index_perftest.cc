@@ -0,0 +1,72 @@
+#include "base/debug/profiler.h"
+#include "base/rand_util.h"
+#include "editor/buffer/line_start_index.h"
+#include <algorithm>
+#include <format>
+#include <gtest/gtest.h>
+#include <print>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+namespace {
+
+constexpr size_t N = 1'000'000;
+
+// Line starts for `count` lines of 1 to `2 * mean_length - 1` bytes.
+std::vector<size_t> make_line_starts(size_t count, size_t mean_length) {
+    std::vector<size_t> starts;
+    starts.reserve(count);
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        starts.push_back(offset);
+        offset += 1 + base::rand_generator(2 * mean_length - 1);
+    }
+    return starts;
+}
+
+// Prints the memory of both representations and the time of `N` random accesses and line
+// lookups on each.
+void compare(std::string_view corpus, size_t count, size_t mean_length) {
+    std::vector<size_t> starts = make_line_starts(count, mean_length);
+    LineStartIndex index{starts};
+    std::println("{}: {} lines, vector {:.1f} MB, index {:.1f} MB ({:.2f} bytes per line)", corpus,
+                 count, static_cast<double>(starts.size() * sizeof(size_t)) / 1024 / 1024,
+                 static_cast<double>(index.memory_bytes()) / 1024 / 1024,
+                 static_cast<double>(index.memory_bytes()) / count);
+
+    std::vector<size_t> lines(N);
+    std::vector<size_t> offsets(N);
+    for (size_t i = 0; i < N; ++i) {
+        lines[i] = base::rand_generator(count);
+        offsets[i] = base::rand_generator(starts.back());
+    }
+
+    size_t sum = 0;
+    auto p1 = base::Profiler{std::format("{}: {} accesses (vector)", corpus, N)};
+    for (size_t line : lines) sum += starts[line];
+    p1.stop_mili();
+    auto p2 = base::Profiler{std::format("{}: {} accesses (index)", corpus, N)};
+    for (size_t line : lines) sum -= index[line];
+    p2.stop_mili();
+    EXPECT_EQ(sum, 0);
+
+    auto p3 = base::Profiler{std::format("{}: {} line lookups (vector)", corpus, N)};
+    for (size_t offset : offsets) sum += std::ranges::upper_bound(starts, offset) - starts.begin();
+    p3.stop_mili();
+    auto p4 = base::Profiler{std::format("{}: {} line lookups (index)", corpus, N)};
+    for (size_t offset : offsets) sum -= index.line_containing(offset) + 1;
+    p4.stop_mili();
+    EXPECT_EQ(sum, 0);
+}
+
+}  // namespace
+
+// Lines like code or logs.
+TEST(LineStartIndexPerfTest, ShortLines) { compare("40-byte lines", 100'000'000, 40); }
+
+// Lines like minified files or wide CSVs.
+TEST(LineStartIndexPerfTest, LongLines) { compare("4 KB lines", 1'000'000, 4096); }
+
+}  // namespace editor
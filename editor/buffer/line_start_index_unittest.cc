@@ -0,0 +1,91 @@
+#include "base/rand_util.h"
+#include "editor/buffer/line_start_index.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+namespace editor {
+
+namespace {
+
+// Sorted starts whose gaps mix every width, including blocks that span more than 4 GiB.
+std::vector<size_t> rand_line_starts(size_t count) {
+    std::vector<size_t> starts{0};
+    while (starts.size() < count) {
+        size_t gap;
+        switch (base::rand_int(0, 9)) {
+        case 0:
+            gap = base::rand_generator(size_t{1} << 33);
+            break;
+        case 1:
+        case 2:
+            gap = base::rand_generator(100'000);
+            break;
+        default:
+            gap = 1 + base::rand_generator(200);
+        }
+        starts.push_back(starts.back() + gap);
+    }
+    return starts;
+}
+
+void expect_matches(const LineStartIndex& index, const std::vector<size_t>& starts) {
+    ASSERT_EQ(index.size(), starts.size());
+    for (size_t i = 0; i < starts.size(); ++i) {
+        ASSERT_EQ(index[i], starts[i]) << "at " << i;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        size_t offset = base::rand_generator(starts.back() + 100);
+        size_t expected = std::ranges::upper_bound(starts, offset) - starts.begin() - 1;
+        ASSERT_EQ(index.line_containing(offset), expected) << "at offset " << offset;
+    }
+    // Exactly at each start, and just before the next.
+    for (size_t i = 0; i + 1 < starts.size(); ++i) {
+        ASSERT_EQ(index.line_containing(starts[i]), i);
+        if (starts[i + 1] > starts[i]) ASSERT_EQ(index.line_containing(starts[i + 1] - 1), i);
+    }
+}
+
+}  // namespace
+
+TEST(LineStartIndexTest, Empty) {
+    LineStartIndex index;
+    EXPECT_TRUE(index.empty());
+    EXPECT_EQ(index.size(), 0);
+}
+
+TEST(LineStartIndexTest, Basic) {
+    std::vector<size_t> starts = {0, 4, 8, 300, 70'000};
+    LineStartIndex index{starts};
+    expect_matches(index, starts);
+    EXPECT_EQ(index.back(), 70'000);
+}
+
+TEST(LineStartIndexTest, RandomStarts) {
+    for (size_t count : {1, 2, 63, 64, 65, 1000, 12'345}) {
+        auto starts = rand_line_starts(count);
+        expect_matches(LineStartIndex{starts}, starts);
+    }
+}
+
+// Appending re-encodes the last block as its offsets widen, and ends up with the same entries as
+// building all at once.
+TEST(LineStartIndexTest, PushBack) {
+    auto starts = rand_line_starts(5000);
+    LineStartIndex index;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        index.push_back(starts[i]);
+        ASSERT_EQ(index.back(), starts[i]);
+        if (i % 97 == 0) ASSERT_EQ(index[i / 2], starts[i / 2]);
+    }
+    expect_matches(index, starts);
+}
+
+TEST(LineStartIndexTest, ShortLinesTakeAboutTwoBytes) {
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < 100'000; ++i) starts.push_back(i * 80);
+    LineStartIndex index{starts};
+    expect_matches(index, starts);
+    EXPECT_LT(index.memory_bytes(), starts.size() * 5 / 2);
+}
+
+}  // namespace editor
@@ -0,0 +1,101 @@
+#include "base/check.h"
+#include "base/strings/line_index.h"
+#include "editor/buffer/mod_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace editor {
+
+ModChunk::ModChunk(size_t byte_capacity, size_t line_capacity)
+    : data_(std::make_unique_for_overwrite<char[]>(byte_capacity)),
+      byte_capacity_(byte_capacity),
+      line_starts_(std::make_unique_for_overwrite<uint32_t[]>(line_capacity)),
+      line_capacity_(line_capacity),
+      block_metrics_(std::make_unique<TextMetrics[]>(byte_capacity / kMetricsBlockSize + 1)) {
+    DCHECK_GE(line_capacity, 1);
+    CHECK_LE(byte_capacity, UINT32_MAX);
+    UNSAFE_BUFFERS(line_starts_[0]) = 0;
+}
+
+bool ModChunk::has_room(size_t bytes, size_t newlines) const {
+    return bytes <= byte_capacity_ - size() && newlines <= line_capacity_ - line_count();
+}
+
+TextMetrics ModChunk::append(std::string_view txt, std::span<const size_t> starts) {
+    DCHECK(!starts.empty());
+    DCHECK(has_room(txt.size(), starts.size() - 1));
+
+    // Only one thread appends, so relaxed loads of the counters are enough here.
+    size_t size = size_.load(std::memory_order_relaxed);
+    size_t line_count = line_count_.load(std::memory_order_relaxed);
+    // SAFETY: `has_room()` guarantees both arrays have space for the new bytes and line starts.
+    UNSAFE_BUFFERS(std::memcpy(data_.get() + size, txt.data(), txt.size()));
+    // NOTE: We drop the first start because it is always the (empty) start of `txt` itself.
+    for (size_t i = 1; i < starts.size(); ++i) {
+        UNSAFE_BUFFERS(line_starts_[line_count++]) = static_cast<uint32_t>(size + starts[i]);
+    }
+    // Record the metrics at each block boundary the new bytes reach.
+    TextMetrics appended;
+    size_t counted = 0;
+    size_t end = size + txt.size();
+    for (size_t boundary = (size / kMetricsBlockSize + 1) * kMetricsBlockSize; boundary <= end;
+         boundary += kMetricsBlockSize) {
+        appended += count_text_metrics(txt.substr(counted, boundary - size - counted));
+        counted = boundary - size;
+        // SAFETY: There is an entry for every boundary up to `byte_capacity_`.
+        UNSAFE_BUFFERS(block_metrics_[boundary / kMetricsBlockSize]) = metrics_ + appended;
+    }
+    appended += count_text_metrics(txt.substr(counted));
+    metrics_ += appended;
+    line_count_.store(line_count, std::memory_order_release);
+    size_.store(size + txt.size(), std::memory_order_release);
+    return appended;
+}
+
+BufferCursor ModChunk::end() const {
+    size_t last_line = line_count() - 1;
+    return {.line = last_line, .column = size() - line_starts()[last_line]};
+}
+
+Piece ModBuffer::append(std::string_view txt) {
+    DCHECK(!txt.empty());
+
+    auto starts = base::find_line_starts(txt);
+    size_t newlines = starts.size() - 1;
+    if (chunks_.empty() || !chunks_.back()->has_room(txt.size(), newlines)) {
+        size_t byte_capacity = std::max(ModChunk::kByteCapacity, txt.size());
+        size_t line_capacity = std::max(ModChunk::kLineCapacity, newlines + 1);
+        chunks_.push_back(std::make_shared<ModChunk>(byte_capacity, line_capacity));
+    }
+
+    auto& chunk = *chunks_.back();
+    auto first = chunk.end();
+    auto metrics = chunk.append(txt, starts);
+    auto last = chunk.end();
+    return {
+        .type = BufferType::Mod,
+        .chunk = chunks_.size() - 1,
+        .first = first,
+        .last = last,
+        .length = txt.size(),
+        .lf_count = last.line - first.line,
+        .metrics = metrics,
+    };
+}
+
+void ModBuffer::release_chunks(const std::vector<bool>& in_use) {
+    DCHECK_EQ(in_use.size(), chunks_.size());
+    for (size_t i = 0; i + 1 < chunks_.size(); ++i) {
+        if (!in_use[i]) chunks_[i].reset();
+    }
+}
+
+size_t ModBuffer::allocated_bytes() const {
+    size_t total = 0;
+    for (const auto& chunk : chunks_) {
+        if (chunk) total += chunk->capacity();
+    }
+    return total;
+}
+
+}  // namespace editor
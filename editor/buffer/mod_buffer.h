@@ -0,0 +1,105 @@
+#pragma once
+
+#include "base/check.h"
+#include "base/compiler_specific.h"
+#include "editor/buffer/red_black_tree.h"
+#include "editor/buffer/text_metrics.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+// A fixed-capacity slab of the mod buffer. Bytes and line starts are written in place and never
+// move, so pointers into a chunk stay valid while later edits keep appending to it. Line starts
+// are relative to the chunk, so they are stored in 32 bits, and chunks are limited to 4 GiB.
+//
+// Written bytes are never written again either. Other threads may read a chunk (through a
+// snapshot) while one thread appends to it: the sizes are published with release stores, so a
+// reader sees every byte up to the size it observes.
+class ModChunk {
+public:
+    // Typical capacities. A single insertion that doesn't fit gets a chunk sized to fit it.
+    static constexpr size_t kByteCapacity = 64 * 1024;
+    static constexpr size_t kLineCapacity = 4 * 1024;
+
+    ModChunk(size_t byte_capacity, size_t line_capacity);
+    ModChunk(const ModChunk&) = delete;
+    ModChunk& operator=(const ModChunk&) = delete;
+
+    // Whether `bytes` more bytes containing `newlines` line feeds fit without reallocating.
+    bool has_room(size_t bytes, size_t newlines) const;
+    // Appends `txt`, whose line starts (relative to `txt`, as returned by
+    // `base::find_line_starts()`) are `starts`. The chunk must have room for it. Returns the
+    // metrics of `txt`.
+    TextMetrics append(std::string_view txt, std::span<const size_t> starts);
+
+    // The position just past the last byte written.
+    BufferCursor end() const;
+    // Line starts are relative to the chunk and always begin with 0.
+    std::span<const uint32_t> line_starts() const {
+        // SAFETY: `line_starts_` holds `line_capacity_` >= `line_count_` elements.
+        return UNSAFE_BUFFERS(std::span<const uint32_t>(line_starts_.get(), line_count()));
+    }
+    std::string_view text() const {
+        // SAFETY: `data_` holds `byte_capacity_` >= `size_` bytes.
+        return UNSAFE_BUFFERS(std::string_view(data_.get(), size()));
+    }
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+    size_t capacity() const { return byte_capacity_; }
+    // The metrics of the chunk's prefix at every `kMetricsBlockSize` boundary within `text()`.
+    std::span<const TextMetrics> block_metrics() const {
+        // SAFETY: `block_metrics_` holds an entry for every boundary up to `byte_capacity_`.
+        return UNSAFE_BUFFERS(std::span<const TextMetrics>(block_metrics_.get(),
+                                                           size() / kMetricsBlockSize + 1));
+    }
+
+private:
+    size_t line_count() const { return line_count_.load(std::memory_order_acquire); }
+
+    std::unique_ptr<char[]> data_;
+    size_t byte_capacity_;
+    std::atomic<size_t> size_ = 0;
+
+    std::unique_ptr<uint32_t[]> line_starts_;
+    size_t line_capacity_;
+    std::atomic<size_t> line_count_ = 1;
+
+    std::unique_ptr<TextMetrics[]> block_metrics_;
+    // Metrics of all bytes written so far. Only touched by the appending thread.
+    TextMetrics metrics_;
+};
+
+// The append-only buffer that holds all inserted text, stored as a list of `ModChunk`s. Mod
+// pieces refer to their chunk by index, and every piece lies within a single chunk.
+//
+// Copies share chunks. That is safe because chunks are append-only: each append claims fresh bytes
+// at the end of the current chunk, so pieces built by different copies never overlap. Copies may
+// be read from any thread, but appends to shared chunks must come from one thread at a time.
+class ModBuffer {
+public:
+    // Appends `txt` and returns a piece spanning exactly those bytes. `txt` must not be empty.
+    Piece append(std::string_view txt);
+
+    // Drops this buffer's reference to every chunk whose entry in `in_use` is false. Released
+    // chunks keep their index, so existing pieces stay valid as long as they don't refer to a
+    // released chunk. The current (last) chunk is never released.
+    void release_chunks(const std::vector<bool>& in_use);
+
+    const ModChunk& chunk(size_t index) const {
+        DCHECK(chunks_[index]);
+        return *chunks_[index];
+    }
+    bool is_released(size_t index) const { return !chunks_[index]; }
+    size_t chunk_count() const { return chunks_.size(); }
+    // Total capacity of the chunks this buffer still holds.
+    size_t allocated_bytes() const;
+
+private:
+    std::vector<std::shared_ptr<ModChunk>> chunks_;
+};
+
+}  // namespace editor
@@ -0,0 +1,138 @@
+#include "editor/buffer/mod_buffer.h"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace editor {
+
+TEST(ModBufferTest, AppendReturnsPieceSpanningText) {
+    ModBuffer buffer;
+    auto p1 = buffer.append("abc\nde");
+    EXPECT_EQ(p1.type, BufferType::Mod);
+    EXPECT_EQ(p1.chunk, 0);
+    EXPECT_EQ(p1.first, (BufferCursor{0, 0}));
+    EXPECT_EQ(p1.last, (BufferCursor{1, 2}));
+    EXPECT_EQ(p1.length, 6);
+    EXPECT_EQ(p1.lf_count, 1);
+
+    auto p2 = buffer.append("f\n");
+    EXPECT_EQ(p2.chunk, 0);
+    EXPECT_EQ(p2.first, p1.last);
+    EXPECT_EQ(p2.last, (BufferCursor{2, 0}));
+    EXPECT_EQ(p2.lf_count, 1);
+
+    const auto& chunk = buffer.chunk(0);
+    EXPECT_EQ(chunk.text(), "abc\ndef\n");
+    EXPECT_EQ(std::vector<size_t>(chunk.line_starts().begin(), chunk.line_starts().end()),
+              (std::vector<size_t>{0, 4, 8}));
+}
+
+// Bytes already written must never move, no matter how much is appended afterwards.
+TEST(ModBufferTest, AddressesAreStable) {
+    ModBuffer buffer;
+    buffer.append("hello");
+    const char* data = buffer.chunk(0).text().data();
+    const uint32_t* starts = buffer.chunk(0).line_starts().data();
+
+    std::string line(99, 'x');
+    line += '\n';
+    for (size_t i = 0; i < 10'000; ++i) {
+        buffer.append(line);
+    }
+    EXPECT_GT(buffer.chunk_count(), 1);
+    EXPECT_EQ(buffer.chunk(0).text().data(), data);
+    EXPECT_EQ(buffer.chunk(0).line_starts().data(), starts);
+    EXPECT_EQ(buffer.chunk(0).text().substr(0, 5), "hello");
+}
+
+TEST(ModBufferTest, StartsNewChunkWhenFull) {
+    ModBuffer buffer;
+    std::string fill(ModChunk::kByteCapacity - 1, 'a');
+    buffer.append(fill);
+    auto p1 = buffer.append("b");
+    EXPECT_EQ(p1.chunk, 0);
+    EXPECT_EQ(buffer.chunk(0).size(), ModChunk::kByteCapacity);
+
+    auto p2 = buffer.append("c");
+    EXPECT_EQ(p2.chunk, 1);
+    EXPECT_EQ(p2.first, (BufferCursor{0, 0}));
+    EXPECT_EQ(buffer.chunk(1).text(), "c");
+}
+
+TEST(ModBufferTest, StartsNewChunkWhenOutOfLines) {
+    ModBuffer buffer;
+    std::string newlines(ModChunk::kLineCapacity - 1, '\n');
+    auto p1 = buffer.append(newlines);
+    EXPECT_EQ(p1.chunk, 0);
+    EXPECT_EQ(p1.lf_count, ModChunk::kLineCapacity - 1);
+
+    auto p2 = buffer.append("\n");
+    EXPECT_EQ(p2.chunk, 1);
+}
+
+TEST(ModBufferTest, OversizedAppendGetsItsOwnChunk) {
+    ModBuffer buffer;
+    buffer.append("a");
+    std::string big(ModChunk::kByteCapacity * 3, '\n');
+    auto piece = buffer.append(big);
+    EXPECT_EQ(piece.chunk, 1);
+    EXPECT_EQ(piece.length, big.size());
+    EXPECT_EQ(piece.lf_count, big.size());
+    EXPECT_EQ(buffer.chunk(1).text(), big);
+}
+
+// Copies share chunks, and appends from either copy claim disjoint bytes.
+TEST(ModBufferTest, CopiesAppendToDisjointRanges) {
+    ModBuffer a;
+    a.append("base");
+    ModBuffer b = a;
+
+    auto pa = a.append("A");
+    auto pb = b.append("B");
+    EXPECT_NE(pa.first, pb.first);
+    EXPECT_EQ(a.chunk(0).text(), "baseAB");
+    EXPECT_EQ(b.chunk(0).text(), "baseAB");
+}
+
+// Appends of assorted sizes cross block boundaries at every alignment, including in the middle
+// of a multi-byte sequence.
+TEST(ModBufferTest, TracksMetricsPerBlock) {
+    ModBuffer buffer;
+    TextMetrics total;
+    for (size_t i = 0; i < 2000; ++i) {
+        std::string text(i % 7, 'a');
+        text += "😀é";
+        auto piece = buffer.append(text);
+        EXPECT_EQ(piece.metrics, count_text_metrics(text));
+        total += piece.metrics;
+    }
+    ASSERT_EQ(buffer.chunk_count(), 1);
+    const auto& chunk = buffer.chunk(0);
+    auto blocks = chunk.block_metrics();
+    ASSERT_EQ(blocks.size(), chunk.size() / kMetricsBlockSize + 1);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        EXPECT_EQ(blocks[i], count_text_metrics(chunk.text().substr(0, i * kMetricsBlockSize)));
+    }
+    EXPECT_EQ(text_metrics_at(chunk.text(), blocks, chunk.size()), total);
+}
+
+TEST(ModBufferTest, ReleaseChunksKeepsIndicesAndCurrentChunk) {
+    ModBuffer buffer;
+    std::string big(ModChunk::kByteCapacity, 'a');
+    buffer.append(big);
+    buffer.append(big);
+    auto piece = buffer.append("tail");
+    EXPECT_EQ(buffer.chunk_count(), 3);
+    EXPECT_EQ(buffer.allocated_bytes(), 3 * ModChunk::kByteCapacity);
+
+    buffer.release_chunks({false, true, false});
+    EXPECT_TRUE(buffer.is_released(0));
+    EXPECT_FALSE(buffer.is_released(1));
+    EXPECT_FALSE(buffer.is_released(2));
+    EXPECT_EQ(buffer.allocated_bytes(), 2 * ModChunk::kByteCapacity);
+    EXPECT_EQ(buffer.chunk(piece.chunk).text(), "tail");
+
+    // New text keeps going into the current chunk, and indices don't shift.
+    EXPECT_EQ(buffer.append("more").chunk, 2);
+}
+
+}  // namespace editor
@@ -2,10 +2,14 @@
 #include "base/compiler_specific.h"
 #include "base/functional/scope_exit.h"
 #include "base/numeric/saturation_arithmetic.h"
+#include "base/strings/line_index.h"
 #include "base/unicode/utf8_decoder.h"
+#include "editor/buffer/edit_journal.h"
 #include "editor/buffer/piece_tree.h"
-#include "editor/search/aho_corasick.h"
+#include <cstdint>
+#include <ranges>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace editor {
@@ -19,30 +23,81 @@ struct NodePosition {
 
 namespace {
 
-const CharBuffer& get_buffer(const BufferCollection& buffers, BufferType type) {
-    return type == BufferType::Mod ? buffers.mod_buffer : buffers.orig_buffer;
+// The line starts of a piece's buffer: a mod chunk's plain array, or the original buffer's
+// compressed index.
+class LineStarts {
+public:
+    explicit LineStarts(std::span<const uint32_t> mod) : mod_(mod.data()), size_(mod.size()) {}
+    explicit LineStarts(const LineStartIndex& orig) : orig_(&orig), size_(orig.size()) {}
+
+    size_t operator[](size_t line) const {
+        DCHECK_LT(line, size_);
+        return mod_ ? UNSAFE_TODO(mod_[line]) : (*orig_)[line];
+    }
+    size_t size() const { return size_; }
+
+private:
+    const uint32_t* mod_ = nullptr;
+    const LineStartIndex* orig_ = nullptr;
+    size_t size_;
+};
+
+LineStarts get_line_starts(const BufferCollection& buffers, const Piece& piece) {
+    if (piece.type == BufferType::Mod) {
+        return LineStarts{buffers.mod_buffer.chunk(piece.chunk).line_starts()};
+    }
+    return LineStarts{buffers.orig_buffer->line_starts};
+}
+
+size_t get_offset(const BufferCollection& buffers, const Piece& piece, const BufferCursor& cursor) {
+    return get_line_starts(buffers, piece)[cursor.line] + cursor.column;
 }
 
-size_t get_offset(const BufferCollection& buffers, BufferType type, const BufferCursor& cursor) {
-    const auto& starts = get_buffer(buffers, type).line_starts;
-    return starts[cursor.line] + cursor.column;
+// The whole buffer the piece lies in. Callers must only read the piece's own bytes, plus the
+// metrics block it starts in.
+std::string_view get_text(const BufferCollection& buffers, const Piece& piece) {
+    if (piece.type == BufferType::Mod) return buffers.mod_buffer.chunk(piece.chunk).text();
+    const auto& orig = *buffers.orig_buffer;
+    if (orig.resident_pages) {
+        size_t first = get_offset(buffers, piece, piece.first);
+        size_t block_start = first - first % kMetricsBlockSize;
+        orig.resident_pages->touch(block_start, first - block_start + piece.length);
+    }
+    return orig.text();
 }
 
-std::vector<size_t> populate_line_starts(std::string_view buf) {
-    std::vector<size_t> starts;
-    starts.push_back(0);
-    size_t pos = 0;
-    while ((pos = buf.find('\n', pos)) != std::string_view::npos) {
-        starts.push_back(pos + 1);
-        ++pos;  // Continue after the newline.
+std::span<const TextMetrics> get_block_metrics(const BufferCollection& buffers,
+                                               const Piece& piece) {
+    if (piece.type == BufferType::Mod) {
+        return buffers.mod_buffer.chunk(piece.chunk).block_metrics();
     }
-    return starts;
+    return buffers.orig_buffer->block_metrics;
+}
+
+// The metrics of the piece's buffer between buffer offsets `start` and `end`.
+TextMetrics metrics_between(const BufferCollection& buffers,
+                            const Piece& piece,
+                            size_t start,
+                            size_t end) {
+    auto text = get_text(buffers, piece);
+    auto blocks = get_block_metrics(buffers, piece);
+    // Both ends usually share a block, and then only the bytes between them need counting.
+    if (start / kMetricsBlockSize == end / kMetricsBlockSize) {
+        return count_text_metrics(text.substr(start, end - start));
+    }
+    return text_metrics_at(text, blocks, end) - text_metrics_at(text, blocks, start);
+}
+
+// Whether `next` continues `existing` in the mod buffer, so the two can be merged into one piece.
+bool extends(const Piece& existing, const Piece& next) {
+    return existing.type == BufferType::Mod && next.type == BufferType::Mod &&
+           existing.chunk == next.chunk && existing.last == next.first;
 }
 
 BufferCursor buffer_position(const BufferCollection& buffers,
                              const Piece& piece,
                              size_t remainder) {
-    const auto& starts = get_buffer(buffers, piece.type).line_starts;
+    auto starts = get_line_starts(buffers, piece);
     auto start_offset = starts[piece.first.line] + piece.first.column;
     auto offset = start_offset + remainder;
 
@@ -73,62 +128,133 @@ BufferCursor buffer_position(const BufferCollection& buffers,
     return {.line = mid, .column = offset - mid_start};
 }
 
-NodePosition node_at(const RedBlackTree& root, const BufferCollection& buffers, size_t off) {
+// Moves `finger` up to the nearest subtree that `covers`, and returns where to start descending:
+// that subtree, or the root if there is none. The starting subtree is popped too, since the
+// descent pushes it again.
+template <typename Covers>
+const RedBlackTree* climb(const RedBlackTree& root,
+                          LookupFinger* finger,
+                          size_t* offset,
+                          size_t* line,
+                          size_t* visited,
+                          Covers covers) {
+    if (!finger) return &root;
+    auto& path = finger->path;
+    while (!path.empty() && !covers(path.back())) {
+        path.pop_back();
+        ++*visited;
+    }
+    if (path.empty()) return &root;
+    auto entry = path.back();
+    path.pop_back();
+    *offset = entry.offset;
+    *line = entry.line;
+    return entry.node;
+}
+
+void record_lookup(LookupFinger* finger, size_t visited) {
+    if (!finger) return;
+    ++finger->stats.lookups;
+    finger->stats.nodes_visited += visited;
+}
+
+NodePosition node_at(const RedBlackTree& root,
+                     const BufferCollection& buffers,
+                     size_t off,
+                     LookupFinger* finger = nullptr) {
     size_t node_start_offset = 0;
     size_t newline_count = 0;
+    size_t visited = 0;
 
-    auto node = root;
-    while (node) {
-        if (off < node.left_length()) {
-            node = node.left();
-        } else if (off < node.left_length() + node.piece().length) {
-            node_start_offset += node.left_length();
-            newline_count += node.left_line_feed_count();
+    auto covers = [off](const LookupFinger::Entry& entry) {
+        return entry.offset <= off && off - entry.offset < entry.node->length();
+    };
+    const RedBlackTree* node =
+        climb(root, finger, &node_start_offset, &newline_count, &visited, covers);
+    off -= node_start_offset;
+    base::ScopeExit guard{[&] { record_lookup(finger, visited); }};
+
+    while (*node) {
+        ++visited;
+        if (finger && node != &root) {
+            finger->path.push_back({node, node_start_offset, newline_count});
+        }
+        const auto& piece = node->piece();
+        if (off < node->left_length()) {
+            node = &node->left();
+        } else if (off < node->left_length() + piece.length) {
+            node_start_offset += node->left_length();
+            newline_count += node->left_line_feed_count();
             // Now we find the line within this piece.
-            auto remainder = off - node.left_length();
-            auto pos = buffer_position(buffers, node.piece(), remainder);
+            auto remainder = off - node->left_length();
+            auto pos = buffer_position(buffers, piece, remainder);
             // Note: since buffer_position will return us a newline relative to the buffer itself,
             // we need to retract it by the starting line of the piece to get the real difference.
-            newline_count += pos.line - node.piece().first.line;
+            newline_count += pos.line - piece.first.line;
             return {
-                .node = node,
+                .node = *node,
                 .remainder = remainder,
                 .start_offset = node_start_offset,
                 .line = newline_count,
             };
         } else {
             // If there are no more nodes to traverse to, return this final node.
-            if (!node.right()) {
-                auto offset_amount = node.left_length();
+            if (!node->right()) {
+                auto offset_amount = node->left_length();
                 node_start_offset += offset_amount;
-                newline_count += node.left_line_feed_count() + node.piece().lf_count;
+                newline_count += node->left_line_feed_count() + piece.lf_count;
                 // Now we find the line within this piece.
-                auto remainder = node.piece().length;
+                auto remainder = piece.length;
                 return {
-                    .node = node,
+                    .node = *node,
                     .remainder = remainder,
                     .start_offset = node_start_offset,
                     .line = newline_count,
                 };
             }
-            auto offset_amount = node.left_length() + node.piece().length;
+            auto offset_amount = node->left_length() + piece.length;
             off -= offset_amount;
             node_start_offset += offset_amount;
-            newline_count += node.left_line_feed_count() + node.piece().lf_count;
-            node = node.right();
+            newline_count += node->left_line_feed_count() + piece.lf_count;
+            node = &node->right();
         }
     }
     return {};
 }
 
+// The metrics of the document before `offset`.
+TextMetrics metrics_before(const RedBlackTree& root,
+                           const BufferCollection& buffers,
+                           size_t offset) {
+    TextMetrics metrics;
+    const RedBlackTree* node = &root;
+    while (*node) {
+        if (offset < node->left_length()) {
+            node = &node->left();
+            continue;
+        }
+        offset -= node->left_length();
+        metrics += node->left_metrics();
+        const auto& piece = node->piece();
+        if (offset < piece.length) {
+            size_t start = get_offset(buffers, piece, piece.first);
+            return metrics + metrics_between(buffers, piece, start, start + offset);
+        }
+        offset -= piece.length;
+        metrics += piece.metrics;
+        node = &node->right();
+    }
+    return metrics;
+}
+
 size_t lf_count_between_range(const BufferCollection& buffers,
-                              BufferType buffer_type,
+                              const Piece& piece,
                               const BufferCursor& start,
                               const BufferCursor& end) {
     // If the end position is the beginning of a new line, then we can just return the difference
     // in lines.
     if (end.column == 0) return end.line - start.line;
-    const auto& starts = get_buffer(buffers, buffer_type).line_starts;
+    auto starts = get_line_starts(buffers, piece);
     // It means, there is no LF after end.
     if (end.line == starts.size() - 1) return end.line - start.line;
     // Due to the check above, we know that there's at least one more line after 'end.line'.
@@ -145,10 +271,10 @@ size_t lf_count_between_range(const BufferCollection& buffers,
 Piece trim_piece_right(const BufferCollection& buffers,
                        const Piece& piece,
                        const BufferCursor& pos) {
-    auto orig_end_offset = get_offset(buffers, piece.type, piece.last);
+    auto orig_end_offset = get_offset(buffers, piece, piece.last);
 
-    auto new_end_offset = get_offset(buffers, piece.type, pos);
-    auto new_lf_count = lf_count_between_range(buffers, piece.type, piece.first, pos);
+    auto new_end_offset = get_offset(buffers, piece, pos);
+    auto new_lf_count = lf_count_between_range(buffers, piece, piece.first, pos);
 
     auto len_delta = orig_end_offset - new_end_offset;
     auto new_len = piece.length - len_delta;
@@ -157,6 +283,8 @@ Piece trim_piece_right(const BufferCollection& buffers,
     new_piece.last = pos;
     new_piece.lf_count = new_lf_count;
     new_piece.length = new_len;
+    new_piece.metrics = piece.metrics - metrics_between(buffers, piece, new_end_offset,
+                                                        orig_end_offset);
 
     return new_piece;
 }
@@ -164,10 +292,10 @@ Piece trim_piece_right(const BufferCollection& buffers,
 Piece trim_piece_left(const BufferCollection& buffers,
                       const Piece& piece,
                       const BufferCursor& pos) {
-    auto orig_start_offset = get_offset(buffers, piece.type, piece.first);
+    auto orig_start_offset = get_offset(buffers, piece, piece.first);
 
-    auto new_start_offset = get_offset(buffers, piece.type, pos);
-    auto new_lf_count = lf_count_between_range(buffers, piece.type, pos, piece.last);
+    auto new_start_offset = get_offset(buffers, piece, pos);
+    auto new_lf_count = lf_count_between_range(buffers, piece, pos, piece.last);
 
     auto len_delta = new_start_offset - orig_start_offset;
     auto new_len = piece.length - len_delta;
@@ -176,44 +304,63 @@ Piece trim_piece_left(const BufferCollection& buffers,
     new_piece.first = pos;
     new_piece.lf_count = new_lf_count;
     new_piece.length = new_len;
+    new_piece.metrics = piece.metrics - metrics_between(buffers, piece, orig_start_offset,
+                                                        new_start_offset);
 
     return new_piece;
 }
 
 using Accumulator = size_t (*)(const BufferCollection&, const Piece&, size_t);
 
+// The offset of the start of `line`, as measured by `accumulate`.
 template <Accumulator accumulate>
-void line_start(size_t* offset,
-                const BufferCollection& buffers,
-                const RedBlackTree& node,
-                size_t line) {
-    if (!node) return;
-    if (line <= node.left_line_feed_count()) {
-        line_start<accumulate>(offset, buffers, node.left(), line);
-    }
-    // The desired line is directly within the node.
-    else if (line <= node.left_line_feed_count() + node.piece().lf_count) {
-        line -= node.left_line_feed_count();
-        size_t len = node.left_length();
-        if (line != 0) {
-            len += (*accumulate)(buffers, node.piece(), line - 1);
+size_t line_start(const BufferCollection& buffers,
+                  const RedBlackTree& root,
+                  size_t line,
+                  LookupFinger* finger = nullptr) {
+    size_t offset = 0;
+    size_t lines_before = 0;
+    size_t visited = 0;
+
+    // Line 0 of a subtree is wherever the subtree starts, which is not where `accumulate` would
+    // put it, so only subtrees where the line is past their first line feed qualify.
+    auto covers = [line](const LookupFinger::Entry& entry) {
+        return entry.line < line && line - entry.line <= entry.node->line_feed_count();
+    };
+    const RedBlackTree* node = climb(root, finger, &offset, &lines_before, &visited, covers);
+    line -= lines_before;
+    base::ScopeExit guard{[&] { record_lookup(finger, visited); }};
+
+    while (*node) {
+        ++visited;
+        if (finger && node != &root) finger->path.push_back({node, offset, lines_before});
+        const auto& piece = node->piece();
+        if (line <= node->left_line_feed_count()) {
+            node = &node->left();
+        }
+        // The desired line is directly within the node.
+        else if (line <= node->left_line_feed_count() + piece.lf_count) {
+            line -= node->left_line_feed_count();
+            offset += node->left_length();
+            if (line != 0) offset += (*accumulate)(buffers, piece, line - 1);
+            return offset;
+        }
+        // Assemble the LHS and RHS.
+        else {
+            // This case implies that 'left_subtree_lf_count' is strictly < line.
+            // The content is somewhere in the middle.
+            line -= node->left_line_feed_count() + piece.lf_count;
+            lines_before += node->left_line_feed_count() + piece.lf_count;
+            offset += node->left_length() + piece.length;
+            node = &node->right();
         }
-        *offset += len;
-
-    }
-    // Assemble the LHS and RHS.
-    else {
-        // This case implies that 'left_subtree_lf_count' is strictly < line.
-        // The content is somewhere in the middle.
-        line -= node.left_line_feed_count() + node.piece().lf_count;
-        *offset += node.left_length() + node.piece().length;
-        line_start<accumulate>(offset, buffers, node.right(), line);
     }
+    return offset;
 }
 
 // Fetches the length of the piece starting from the first line to 'index' or to the end.
 size_t accumulate_value(const BufferCollection& buffers, const Piece& piece, size_t index) {
-    const auto& line_starts = get_buffer(buffers, piece.type).line_starts;
+    auto line_starts = get_line_starts(buffers, piece);
     // Extend it so we can capture the entire line content including newline.
     auto expected_start = piece.first.line + (index + 1);
     auto first = line_starts[piece.first.line] + piece.first.column;
@@ -227,49 +374,141 @@ size_t accumulate_value(const BufferCollection& buffers, const Piece& piece, siz
 
 // Fetches the length of the piece starting from the first line to 'index' or to the end.
 size_t accumulate_value_no_lf(const BufferCollection& buffers, const Piece& piece, size_t index) {
-    const auto& buffer = get_buffer(buffers, piece.type);
-    auto& line_starts = buffer.line_starts;
+    auto line_starts = get_line_starts(buffers, piece);
+    auto text = get_text(buffers, piece);
     // Extend it so we can capture the entire line content including newline.
     auto expected_start = piece.first.line + (index + 1);
     auto first = line_starts[piece.first.line] + piece.first.column;
     if (expected_start > piece.last.line) {
         auto last = line_starts[piece.last.line] + piece.last.column;
         if (last == first) return 0;
-        if (buffer.buffer[last - 1] == '\n') return last - 1 - first;
+        if (text[last - 1] == '\n') return last - 1 - first;
         return last - first;
     }
     auto last = line_starts[expected_start];
     if (last == first) return 0;
-    if (buffer.buffer[last - 1] == '\n') return last - 1 - first;
+    if (text[last - 1] == '\n') return last - 1 - first;
     return last - first;
 }
 
+// Marks the mod buffer chunks that `node` refers to. Versions share most of their nodes, so
+// subtrees in `visited` are skipped. Nodes are identified by the address of their piece.
+void mark_mod_chunks(const RedBlackTree& node,
+                     std::unordered_set<const Piece*>& visited,
+                     std::vector<bool>& in_use) {
+    if (!node || !visited.insert(&node.piece()).second) return;
+    if (node.piece().type == BufferType::Mod) in_use[node.piece().chunk] = true;
+    mark_mod_chunks(node.left(), visited, in_use);
+    mark_mod_chunks(node.right(), visited, in_use);
+}
+
+std::string_view get_piece_text(const BufferCollection& buffers, const Piece& piece) {
+    return get_text(buffers, piece).substr(get_offset(buffers, piece, piece.first), piece.length);
+}
+
+// Whether `next` starts right where `prev` ends in the same buffer.
+bool contiguous(const Piece& prev, const Piece& next) {
+    if (prev.type != next.type) return false;
+    if (prev.type == BufferType::Mod && prev.chunk != next.chunk) return false;
+    return prev.last == next.first;
+}
+
+void collect_pieces(const RedBlackTree& node, std::vector<Piece>& pieces) {
+    if (!node) return;
+    collect_pieces(node.left(), pieces);
+    pieces.push_back(node.piece());
+    collect_pieces(node.right(), pieces);
+}
+
+// The position of buffer offset `offset`, given the buffer's line starts.
+BufferCursor cursor_at(const LineStartIndex& line_starts, size_t offset) {
+    size_t line = line_starts.line_containing(offset);
+    return {.line = line, .column = offset - line_starts[line]};
+}
+
+CharBuffer paged_buffer(std::unique_ptr<base::MemoryMappedFile> file, size_t resident_budget) {
+    DCHECK(file->IsValid());
+    CharBuffer buffer{.mapped_file = std::move(file)};
+    buffer.resident_pages = std::make_unique<ResidentPages>(*buffer.mapped_file, resident_budget);
+    return buffer;
+}
+
+// Indexes a paged buffer one page at a time, evicting each page once it has been scanned, so
+// opening a file larger than memory doesn't push everything else out.
+void index_paged(CharBuffer& buffer) {
+    const auto& file = *buffer.mapped_file;
+    const auto txt = buffer.text();
+    constexpr size_t kPageSize = ResidentPages::kPageSize;
+    static_assert(kPageSize % kMetricsBlockSize == 0);
+
+    buffer.line_starts.push_back(0);
+    buffer.block_metrics = {TextMetrics{}};
+    for (size_t start = 0; start < txt.size(); start += kPageSize) {
+        // Have the OS read the next page while this one is scanned.
+        file.Prefetch(start + kPageSize, kPageSize);
+        auto page = txt.substr(start, kPageSize);
+        auto starts = base::find_line_starts(page);
+        for (size_t i = 1; i < starts.size(); ++i) buffer.line_starts.push_back(start + starts[i]);
+        // Pages are whole blocks, so the page's block index continues the buffer's.
+        auto blocks = index_text_metrics(page);
+        TextMetrics before = buffer.block_metrics.back();
+        for (size_t i = 1; i < blocks.size(); ++i) {
+            buffer.block_metrics.push_back(before + blocks[i]);
+        }
+        buffer.resident_pages->evict(start, page.size());
+    }
+}
+
 }  // namespace
 
-PieceTree::PieceTree(std::string_view txt) {
-    buffers_ = BufferCollection{.orig_buffer = {std::string{txt}, populate_line_starts(txt)}};
+PieceTree::PieceTree(std::string_view txt) : PieceTree(CharBuffer{.buffer = std::string{txt}}) {}
+
+PieceTree::PieceTree(std::unique_ptr<base::MemoryMappedFile> file)
+    : PieceTree(CharBuffer{.mapped_file = std::move(file)}) {}
 
-    // In order to maintain the invariant of other buffers, the mod_buffer needs a single
-    // line-start of 0.
-    buffers_.mod_buffer.line_starts.emplace_back(0);
-    last_insert_ = {};
+PieceTree::PieceTree(std::unique_ptr<base::MemoryMappedFile> file, size_t resident_budget)
+    : PieceTree(paged_buffer(std::move(file), resident_budget)) {}
 
-    const auto& buf = buffers_.orig_buffer;
+PieceTree::PieceTree(CharBuffer orig_buffer) {
+    if (orig_buffer.resident_pages) {
+        index_paged(orig_buffer);
+    } else {
+        if (orig_buffer.mapped_file) {
+            DCHECK(orig_buffer.mapped_file->IsValid());
+            // Indexing the line starts reads the whole mapping front to back.
+            orig_buffer.mapped_file->PrefetchSequential();
+        }
+        orig_buffer.line_starts = LineStartIndex{base::find_line_starts(orig_buffer.text())};
+        orig_buffer.block_metrics = index_text_metrics(orig_buffer.text());
+    }
+    buffers_ = BufferCollection{
+        .orig_buffer = std::make_shared<const CharBuffer>(std::move(orig_buffer)),
+    };
+
+    const auto& buf = *buffers_.orig_buffer;
+    const auto txt = buf.text();
     DCHECK(!buf.line_starts.empty());
-    // If this immutable buffer is empty, we can avoid creating a piece for it altogether.
-    if (!buf.buffer.empty()) {
-        size_t last_line = buf.line_starts.size() - 1;
-        // Create a new node that spans this buffer and retains an index to it.
-        // Insert the node into the balanced tree.
-        Piece piece = {
+    // Create nodes that span this immutable buffer, one per page in large-file mode. If it is
+    // empty, we can avoid creating a piece for it altogether.
+    size_t piece_size = buf.resident_pages ? ResidentPages::kPageSize : txt.size();
+    std::vector<Piece> pieces;
+    for (size_t start = 0; start < txt.size(); start += piece_size) {
+        size_t end = std::min(start + piece_size, txt.size());
+        BufferCursor first = cursor_at(buf.line_starts, start);
+        BufferCursor last = cursor_at(buf.line_starts, end);
+        pieces.push_back({
             .type = BufferType::Original,
-            .first = {.line = 0, .column = 0},
-            .last = {.line = last_line, .column = buf.buffer.size() - buf.line_starts[last_line]},
-            .length = buf.buffer.size(),
-            .lf_count = last_line,
-        };
-        root_ = root_.insert(0, {piece});
+            .first = first,
+            .last = last,
+            .length = end - start,
+            .lf_count = last.line - first.line,
+            .metrics = text_metrics_at(txt, buf.block_metrics, end) -
+                       text_metrics_at(txt, buf.block_metrics, start),
+        });
     }
+    root_ = RedBlackTree::build(*arena_, pieces);
+    // Reading the metrics of the last partial block brought its page back in.
+    if (buf.resident_pages) buf.resident_pages->evict(0, txt.size());
 }
 
 PieceTree& PieceTree::operator=(std::string_view txt) {
@@ -278,27 +517,17 @@ PieceTree& PieceTree::operator=(std::string_view txt) {
 }
 
 LineRange PieceTree::get_line_range(size_t line) const {
-    LineRange range;
-    line_start<&accumulate_value>(&range.first, buffers_, root_, line);
-    line_start<&accumulate_value_no_lf>(&range.last, buffers_, root_, line + 1);
-    return range;
+    return {
+        .first = line_start<&accumulate_value>(buffers_, root_, line, finger()),
+        .last = line_start<&accumulate_value_no_lf>(buffers_, root_, line + 1, finger()),
+    };
 }
 
 LineRange PieceTree::get_line_range_with_newline(size_t line) const {
-    LineRange range;
-    line_start<&accumulate_value>(&range.first, buffers_, root_, line);
-    line_start<&accumulate_value>(&range.last, buffers_, root_, line + 1);
-    return range;
-}
-
-std::string PieceTree::str() const {
-    std::string str;
-    str.reserve(length());
-    TreeWalker walker{*this};
-    while (!walker.exhausted()) {
-        str.push_back(walker.next());
-    }
-    return str;
+    return {
+        .first = line_start<&accumulate_value>(buffers_, root_, line, finger()),
+        .last = line_start<&accumulate_value>(buffers_, root_, line + 1, finger()),
+    };
 }
 
 std::string PieceTree::substr(size_t offset, size_t count) const {
@@ -308,33 +537,59 @@ std::string PieceTree::substr(size_t offset, size_t count) const {
     // aborts under -fno-exceptions).
     const size_t remaining = offset < length() ? length() - offset : 0;
     str.reserve(std::min(count, remaining));
-    TreeWalker walker{*this, offset};
-    for (size_t i = 0; i < count && !walker.exhausted(); ++i) {
-        str.push_back(walker.next());
+    ChunkIterator chunks{*this, offset, base::add_sat(offset, count)};
+    while (!chunks.exhausted()) {
+        str += chunks.next();
     }
     return str;
 }
 
-std::optional<size_t> PieceTree::find(std::string_view txt) const {
-    AhoCorasick ac({std::string(txt)});
-    auto result = ac.match(*this);
+size_t PieceTree::offset_to_utf16(size_t offset) const {
+    return metrics_before(root_, buffers_, offset).utf16_units;
+}
 
-    if (result.match_begin == -1) {
-        return std::nullopt;
-    } else {
-        return result.match_begin;
+size_t PieceTree::utf16_to_offset(size_t units) const {
+    size_t offset = 0;
+    const RedBlackTree* node = &root_;
+    while (*node) {
+        size_t left_units = node->left_metrics().utf16_units;
+        if (units < left_units) {
+            node = &node->left();
+            continue;
+        }
+        units -= left_units;
+        offset += node->left_length();
+        const auto& piece = node->piece();
+        if (units < piece.metrics.utf16_units) {
+            size_t start = get_offset(buffers_, piece, piece.first);
+            size_t end = get_offset(buffers_, piece, piece.last);
+            auto text = get_text(buffers_, piece).substr(0, end);
+            auto blocks = get_block_metrics(buffers_, piece);
+            return offset + utf16_offset_in_text(text, blocks, start, units) - start;
+        }
+        units -= piece.metrics.utf16_units;
+        offset += piece.length;
+        node = &node->right();
     }
+    return offset;
+}
+
+size_t PieceTree::codepoint_column_at(size_t offset) const {
+    auto [first, last] = get_line_range(line_at(offset));
+    offset = std::min(offset, last);
+    return metrics_before(root_, buffers_, offset).codepoints -
+           metrics_before(root_, buffers_, first).codepoints;
 }
 
 size_t PieceTree::line_at(size_t offset) const {
     if (empty()) return 0;
-    auto result = node_at(root_, buffers_, offset);
+    auto result = node_at(root_, buffers_, offset, finger());
     return result.line;
 }
 
 BufferCursor PieceTree::line_column_at(size_t offset) const {
     if (empty()) return {0, 0};
-    auto result = node_at(root_, buffers_, offset);
+    auto result = node_at(root_, buffers_, offset, finger());
     size_t line = result.line;
     auto [first, last] = get_line_range(line);
     size_t col = std::min(offset, last) - first;
@@ -347,98 +602,57 @@ size_t PieceTree::offset_at(size_t line, size_t column) const {
     return offset;
 }
 
-std::string PieceTree::get_line_content(size_t line) const {
-    if (!root_) return "";
-
-    std::string buf;
-    size_t line_offset = 0;
-    line_start<&accumulate_value>(&line_offset, buffers_, root_, line);
-    TreeWalker walker{*this, line_offset};
-    while (!walker.exhausted()) {
-        char c = walker.next();
-        if (c == '\n') break;
-        buf.push_back(c);
-    }
-    return buf;
-}
-
 std::string PieceTree::get_line_content_with_newline(size_t line) const {
     if (!root_) return "";
 
     std::string buf;
-    size_t line_offset = 0;
-    line_start<&accumulate_value>(&line_offset, buffers_, root_, line);
-    TreeWalker walker{*this, line_offset};
-    while (!walker.exhausted()) {
-        char c = walker.next();
-        buf.push_back(c);
-        if (c == '\n') break;
+    size_t line_offset = line_start<&accumulate_value>(buffers_, root_, line, finger());
+    ChunkIterator chunks{*this, line_offset};
+    while (!chunks.exhausted()) {
+        auto chunk = chunks.next();
+        size_t newline = chunk.find('\n');
+        if (newline != std::string_view::npos) {
+            buf += chunk.substr(0, newline + 1);
+            break;
+        }
+        buf += chunk;
     }
     return buf;
 }
 
-std::string PieceTree::get_line_content_for_layout_use(size_t line) const {
-    if (!root_) return "";
+void PieceTree::get_lines(size_t first, size_t count, LineBlock& lines) const {
+    if (first >= line_count() || count == 0) return TextBuffer::get_lines(first, count, lines);
+    size_t offset = line_start<&accumulate_value>(buffers_, root_, first, finger());
+    get_lines_from(first, offset, count, lines);
+}
 
-    std::string buf;
-    size_t line_offset = 0;
-    line_start<&accumulate_value>(&line_offset, buffers_, root_, line);
-    TreeWalker walker{*this, line_offset};
-    while (!walker.exhausted()) {
-        char c = walker.next();
-        if (c == '\n') {
-            buf.push_back(' ');
-            break;
-        } else {
-            buf.push_back(c);
-        }
-    }
-    return buf;
+TextChunk PieceTree::chunk_at(size_t offset) const {
+    DCHECK_LT(offset, length());
+    auto result = node_at(root_, buffers_, offset, finger());
+    return {result.start_offset, get_piece_text(buffers_, result.node.piece())};
 }
 
-Piece PieceTree::build_piece(std::string_view txt) {
-    auto& line_starts = buffers_.mod_buffer.line_starts;
-    auto& buffer = buffers_.mod_buffer.buffer;
-
-    auto start_offset = buffer.size();
-    auto scratch_starts = populate_line_starts(txt);
-    auto start = last_insert_;
-    // Offset the new starts relative to the existing buffer.
-    for (auto& new_start : scratch_starts) {
-        new_start += start_offset;
-    }
-    // Append new starts.
-    // NOTE: We drop the first start because the algorithm always adds an empty start.
-    line_starts.insert(line_starts.end(), scratch_starts.begin() + 1, scratch_starts.end());
-    buffer.append(txt);
-
-    // Build the new piece for the inserted buffer.
-    auto end_offset = buffer.size();
-    auto end_index = line_starts.size() - 1;
-    auto end_col = end_offset - line_starts[end_index];
-    BufferCursor end_pos = {.line = end_index, .column = end_col};
-    Piece piece = {
-        .type = BufferType::Mod,
-        .first = start,
-        .last = end_pos,
-        .length = end_offset - start_offset,
-        .lf_count = lf_count_between_range(buffers_, BufferType::Mod, start, end_pos),
-    };
-    // Update the last insertion.
-    last_insert_ = end_pos;
-    return piece;
+void PieceTree::for_each_chunk(size_t first,
+                               size_t last,
+                               const std::function<bool(std::string_view)>& visit) const {
+    ChunkIterator chunks{*this, first, last};
+    while (!chunks.exhausted()) {
+        if (!visit(chunks.next())) return;
+    }
 }
 
 void PieceTree::combine_pieces(NodePosition existing, Piece new_piece) {
     // This transformation is only valid under the following conditions.
     DCHECK_EQ(existing.node.piece().type, BufferType::Mod);
-    // This assumes that the piece was just built.
-    DCHECK_EQ(existing.node.piece().last, new_piece.first);
+    // This assumes that the piece was just appended right after the existing one.
+    DCHECK(extends(existing.node.piece(), new_piece));
     auto old_piece = existing.node.piece();
     new_piece.first = old_piece.first;
     new_piece.lf_count = new_piece.lf_count + old_piece.lf_count;
     new_piece.length = new_piece.length + old_piece.length;
-    root_ = root_.remove(existing.start_offset).insert(existing.start_offset, {new_piece});
+    new_piece.metrics = new_piece.metrics + old_piece.metrics;
+    root_ = root_.remove(existing.start_offset);
+    root_ = root_.insert(*arena_, existing.start_offset, {new_piece});
 }
 
 void PieceTree::remove_node_range(NodePosition first, size_t length) {
@@ -468,17 +682,19 @@ void PieceTree::remove_node_range(NodePosition first, size_t length) {
 }
 
 void PieceTree::insert(size_t offset, std::string_view txt) {
-    base::ScopeExit guard{[&] { DCHECK(root_.satisfies_red_black_invariants()); }};
-
     if (txt.empty()) return;
 
-    // Can't redo if we're creating a new undo entry.
-    if (!redo_stack_.empty()) redo_stack_.clear();
-    undo_stack_.push_front(root_);
+    if (journal_.journal) journal_.journal->record_insert(offset, txt);
+    record_edit(EditKind::Insert, offset, txt.size());
+    insert_internal(offset, txt);
+}
+
+void PieceTree::insert_internal(size_t offset, std::string_view txt) {
+    base::ScopeExit guard{[&] { DCHECK(root_.satisfies_red_black_invariants()); }};
 
     if (!root_) {
-        auto piece = build_piece(txt);
-        root_ = root_.insert(0, {piece});
+        auto piece = buffers_.mod_buffer.append(txt);
+        root_ = root_.insert(*arena_, 0, {piece});
         return;
     }
 
@@ -498,46 +714,41 @@ void PieceTree::insert(size_t offset, std::string_view txt) {
 
     // Case #1.
     if (node_start_offset == offset) {
-        // There's a bonus case here.  If our last insertion point was the same as this piece's
-        // last and it inserted into the mod buffer, then we can simply 'extend' this piece by the
-        // following process:
-        // 1. Fetch the previous node (if we can) and compare.
-        // 2. Build the new piece.
+        // There's a bonus case here.  If the new text landed in the mod buffer right after the
+        // previous piece's text, then we can simply 'extend' that piece by the following process:
+        // 1. Build the new piece.
+        // 2. Fetch the previous node (if we can) and compare.
         // 3. Remove the old piece.
         // 4. Extend the old piece's length to the length of the newly created piece.
         // 5. Re-insert the new piece.
+        auto piece = buffers_.mod_buffer.append(txt);
         if (offset != 0) {
             auto prev_node_result = node_at(root_, buffers_, offset - 1);
-            if (prev_node_result.node.piece().type == BufferType::Mod &&
-                prev_node_result.node.piece().last == last_insert_) {
-                auto new_piece = build_piece(txt);
-                combine_pieces(prev_node_result, new_piece);
+            if (extends(prev_node_result.node.piece(), piece)) {
+                combine_pieces(prev_node_result, piece);
                 return;
             }
         }
-        auto piece = build_piece(txt);
-        root_ = root_.insert(offset, {piece});
+        root_ = root_.insert(*arena_, offset, {piece});
         return;
     }
 
     // Case #2.
     const bool inside_node = offset < node_start_offset + node.piece().length;
     if (!inside_node) {
-        // There's a bonus case here.  If our last insertion point was the same as this piece's
-        // last and it inserted into the mod buffer, then we can simply 'extend' this piece by
-        // the following process:
+        // There's a bonus case here.  If the new text landed in the mod buffer right after this
+        // piece's text, then we can simply 'extend' this piece by the following process:
         // 1. Build the new piece.
         // 2. Remove the old piece.
         // 3. Extend the old piece's length to the length of the newly created piece.
         // 4. Re-insert the new piece.
-        if (node.piece().type == BufferType::Mod && node.piece().last == last_insert_) {
-            auto new_piece = build_piece(txt);
-            combine_pieces(result, new_piece);
+        auto piece = buffers_.mod_buffer.append(txt);
+        if (extends(node.piece(), piece)) {
+            combine_pieces(result, piece);
             return;
         }
         // Insert the new piece at the end.
-        auto piece = build_piece(txt);
-        root_ = root_.insert(offset, {piece});
+        root_ = root_.insert(*arena_, offset, {piece});
         return;
     }
 
@@ -545,44 +756,47 @@ void PieceTree::insert(size_t offset, std::string_view txt) {
     // The basic approach here is to split the existing node into two pieces and insert the new
     // piece in between them.
     auto insert_pos = buffer_position(buffers_, node.piece(), remainder);
-    auto new_len_right = get_offset(buffers_, node.piece().type, node.piece().last) -
-                         get_offset(buffers_, node.piece().type, insert_pos);
+    auto new_len_right = get_offset(buffers_, node.piece(), node.piece().last) -
+                         get_offset(buffers_, node.piece(), insert_pos);
     auto new_piece_right = node.piece();
     new_piece_right.first = insert_pos;
     new_piece_right.length = new_len_right;
     new_piece_right.lf_count =
-        lf_count_between_range(buffers_, node.piece().type, insert_pos, node.piece().last);
+        lf_count_between_range(buffers_, node.piece(), insert_pos, node.piece().last);
 
     // Remove the original node tail.
     auto new_piece_left = trim_piece_right(buffers_, node.piece(), insert_pos);
+    new_piece_right.metrics = node.piece().metrics - new_piece_left.metrics;
 
-    auto new_piece = build_piece(txt);
+    auto new_piece = buffers_.mod_buffer.append(txt);
 
     // Remove the original node.
     root_ = root_.remove(node_start_offset);
 
     // Insert the left.
-    root_ = root_.insert(node_start_offset, {new_piece_left});
+    root_ = root_.insert(*arena_, node_start_offset, {new_piece_left});
 
     // Insert the new mid.
     node_start_offset = node_start_offset + new_piece_left.length;
-    root_ = root_.insert(node_start_offset, {new_piece});
+    root_ = root_.insert(*arena_, node_start_offset, {new_piece});
 
     // Insert remainder.
     node_start_offset = node_start_offset + new_piece.length;
-    root_ = root_.insert(node_start_offset, {new_piece_right});
+    root_ = root_.insert(*arena_, node_start_offset, {new_piece_right});
 }
 
 void PieceTree::erase(size_t offset, size_t count) {
-    base::ScopeExit guard{[&] { DCHECK(root_.satisfies_red_black_invariants()); }};
-
     if (offset >= length()) return;
     count = std::min(count, length() - offset);
     if (count == 0 || !root_) return;
 
-    // Can't redo if we're creating a new undo entry.
-    if (!redo_stack_.empty()) redo_stack_.clear();
-    undo_stack_.push_front(root_);
+    if (journal_.journal) journal_.journal->record_erase(offset, count);
+    record_edit(EditKind::Erase, offset, count);
+    erase_internal(offset, count);
+}
+
+void PieceTree::erase_internal(size_t offset, size_t count) {
+    base::ScopeExit guard{[&] { DCHECK(root_.satisfies_red_black_invariants()); }};
 
     auto first = node_at(root_, buffers_, offset);
     auto last = node_at(root_, buffers_, offset + count);
@@ -603,8 +817,8 @@ void PieceTree::erase(size_t offset, size_t count) {
         root_ = root_.remove(first.start_offset);
         // Note: We insert right first so that the 'left' will be inserted to the right node's
         // left.
-        if (right.length > 0) root_ = root_.insert(first.start_offset, {right});
-        if (left.length > 0) root_ = root_.insert(first.start_offset, {left});
+        if (right.length > 0) root_ = root_.insert(*arena_, first.start_offset, {right});
+        if (left.length > 0) root_ = root_.insert(*arena_, first.start_offset, {left});
         return;
     }
 
@@ -628,32 +842,428 @@ void PieceTree::erase(size_t offset, size_t count) {
         // this scenario to avoid inserting a duplicate of 'last'.
         if (last.remainder != 0) {
             if (new_last.length != 0) {
-                root_ = root_.insert(first.start_offset, {new_last});
+                root_ = root_.insert(*arena_, first.start_offset, {new_last});
             }
         }
     }
 
     if (new_first.length != 0) {
-        root_ = root_.insert(first.start_offset, {new_first});
+        root_ = root_.insert(*arena_, first.start_offset, {new_first});
+    }
+}
+
+void PieceTree::apply_edits(std::span<const Edit> edits) {
+    // Clamp to the document like `erase()` does, and drop edits that change nothing.
+    std::vector<Edit> clamped;
+    clamped.reserve(edits.size());
+    size_t bytes = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        DCHECK(i == 0 || edits[i - 1].offset + edits[i - 1].count <= edits[i].offset);
+        Edit edit = edits[i];
+        edit.offset = std::min(edit.offset, length());
+        edit.count = std::min(edit.count, length() - edit.offset);
+        if (edit.count == 0 && edit.text.empty()) continue;
+        bytes += edit.count + edit.text.size();
+        clamped.push_back(edit);
     }
+    if (clamped.empty()) return;
+
+    if (journal_.journal) journal_.journal->record_edits(clamped);
+    record_edit(EditKind::Replace, clamped.front().offset, bytes);
+
+    // Each separate edit copies about two root-to-leaf paths, while a rebuild copies every piece
+    // once. A tree of black height h holds at least 2^h - 1 pieces, which is enough to tell a
+    // handful of edits from one that touches a sizable fraction of the pieces.
+    size_t black_height = 0;
+    for (auto node = root_; node; node = node.left()) {
+        if (node.is_black()) ++black_height;
+    }
+    size_t min_pieces = black_height >= 64 ? SIZE_MAX : (size_t{1} << black_height) - 1;
+    if (clamped.size() * 4 * (black_height + 1) < min_pieces) {
+        // Going right to left keeps the offsets of the remaining edits valid.
+        for (const auto& edit : std::views::reverse(clamped)) {
+            if (edit.count > 0) erase_internal(edit.offset, edit.count);
+            if (!edit.text.empty()) insert_internal(edit.offset, edit.text);
+        }
+    } else {
+        rebuild_with_edits(clamped);
+    }
+}
+
+void PieceTree::rebuild_with_edits(std::span<const Edit> edits) {
+    std::vector<Piece> pieces;
+    collect_pieces(root_, pieces);
+
+    std::vector<Piece> result;
+    result.reserve(pieces.size() + edits.size() * 2);
+    size_t i = 0;
+    size_t piece_start = 0;  // Document offset of `pieces[i]`.
+    auto skip_to = [&](size_t offset, bool keep) {
+        while (i < pieces.size() && piece_start + pieces[i].length <= offset) {
+            if (keep) result.push_back(pieces[i]);
+            piece_start += pieces[i].length;
+            ++i;
+        }
+    };
+
+    for (const auto& edit : edits) {
+        skip_to(edit.offset, true);
+        // Keep the part of the piece before the edit.
+        if (i < pieces.size() && edit.offset > piece_start) {
+            auto pos = buffer_position(buffers_, pieces[i], edit.offset - piece_start);
+            result.push_back(trim_piece_right(buffers_, pieces[i], pos));
+        }
+        if (!edit.text.empty()) {
+            result.push_back(buffers_.mod_buffer.append(edit.text));
+        }
+        // Drop the erased pieces, and trim the part of the last one that is erased.
+        size_t end = edit.offset + edit.count;
+        skip_to(end, false);
+        if (i < pieces.size() && end > piece_start) {
+            auto pos = buffer_position(buffers_, pieces[i], end - piece_start);
+            pieces[i] = trim_piece_left(buffers_, pieces[i], pos);
+            piece_start = end;
+        }
+    }
+    result.insert(result.end(), pieces.begin() + i, pieces.end());
+
+    root_ = RedBlackTree::build(*arena_, result);
+    DCHECK(root_.satisfies_red_black_invariants());
+}
+
+std::shared_ptr<const PieceTree> PieceTree::snapshot() const {
+    auto snapshot = std::make_shared<PieceTree>();
+    snapshot->buffers_ = buffers_;
+    snapshot->arena_ = arena_;
+    snapshot->root_ = root_;
+    snapshot->is_snapshot_ = true;
+    return snapshot;
+}
+
+size_t PieceTree::resident_file_bytes() const {
+    const auto& pages = buffers_.orig_buffer->resident_pages;
+    return pages ? pages->resident_bytes() : 0;
+}
+
+LookupFinger* PieceTree::finger() const {
+    if (is_snapshot_) return nullptr;
+    if (finger_.generation != generation_ || !finger_.enabled) {
+        finger_.path.clear();
+        finger_.generation = generation_;
+    }
+    return &finger_;
+}
+
+void Compaction::run() {
+    DCHECK(!done_);
+
+    // Merge contiguous pieces, remembering which input pieces each merged piece covers.
+    struct Merged {
+        Piece piece;
+        size_t first_input;
+        size_t end_input;
+    };
+    std::vector<Merged> merged;
+    for (size_t i = 0; i < pieces_.size(); ++i) {
+        const auto& piece = pieces_[i];
+        bool page_start = !page_starts_.empty() && page_starts_[i];
+        if (!merged.empty() && !page_start && contiguous(merged.back().piece, piece)) {
+            auto& back = merged.back();
+            back.piece.last = piece.last;
+            back.piece.length += piece.length;
+            back.piece.lf_count += piece.lf_count;
+            back.piece.metrics += piece.metrics;
+            back.end_input = i + 1;
+        } else {
+            merged.push_back({piece, i, i + 1});
+        }
+    }
+
+    result_.clear();
+    result_.reserve(merged.size());
+    if (!options_.rewrite_fragments) {
+        for (const auto& m : merged) result_.emplace_back(m.piece);
+        done_ = true;
+        return;
+    }
+
+    // Copy each run of two or more short pieces into one string.
+    size_t i = 0;
+    while (i < merged.size()) {
+        size_t run_end = i;
+        while (run_end < merged.size() &&
+               merged[run_end].piece.length < options_.fragment_length) {
+            ++run_end;
+        }
+        if (run_end - i < 2) {
+            result_.emplace_back(merged[i].piece);
+            ++i;
+            continue;
+        }
+        std::string text;
+        for (size_t j = merged[i].first_input; j < merged[run_end - 1].end_input; ++j) {
+            text += texts_[j];
+        }
+        result_.emplace_back(std::move(text));
+        i = run_end;
+    }
+    done_ = true;
+}
+
+void PieceTree::compact(const CompactOptions& options) {
+    auto compaction = begin_compaction(options);
+    compaction.run();
+    bool finished = finish_compaction(std::move(compaction));
+    DCHECK(finished);
+}
+
+Compaction PieceTree::begin_compaction(const CompactOptions& options) const {
+    Compaction compaction;
+    compaction.options_ = options;
+    compaction.generation_ = generation_;
+    collect_pieces(root_, compaction.pieces_);
+    if (buffers_.orig_buffer->resident_pages) {
+        compaction.page_starts_.reserve(compaction.pieces_.size());
+        for (const auto& piece : compaction.pieces_) {
+            size_t start = get_offset(buffers_, piece, piece.first);
+            compaction.page_starts_.push_back(piece.type == BufferType::Original &&
+                                              start % ResidentPages::kPageSize == 0);
+        }
+    }
+    if (options.rewrite_fragments) {
+        compaction.texts_.reserve(compaction.pieces_.size());
+        for (const auto& piece : compaction.pieces_) {
+            compaction.texts_.push_back(get_piece_text(buffers_, piece));
+        }
+        compaction.mod_buffer_ = buffers_.mod_buffer;
+    }
+    return compaction;
+}
+
+bool PieceTree::finish_compaction(Compaction&& compaction) {
+    DCHECK(compaction.done_);
+    if (!compaction.done_ || compaction.generation_ != generation_) return false;
+
+    std::vector<Piece> pieces;
+    pieces.reserve(compaction.result_.size());
+    for (auto& item : compaction.result_) {
+        if (auto* piece = std::get_if<Piece>(&item)) {
+            pieces.push_back(*piece);
+        } else {
+            pieces.push_back(buffers_.mod_buffer.append(std::get<std::string>(item)));
+        }
+    }
+    [[maybe_unused]] size_t old_length = length();
+    root_ = RedBlackTree::build(*arena_, pieces);
+    // The document is unchanged, so `generation_` stays, but the nodes are new.
+    finger_.path.clear();
+    DCHECK_EQ(length(), old_length);
+    return true;
 }
 
 bool PieceTree::undo() {
     if (undo_stack_.empty()) return false;
-    redo_stack_.push_front(root_);
-    root_ = undo_stack_.front();
-    undo_stack_.pop_front();
+    if (journal_.journal) journal_.journal->record_undo();
+    auto entry = std::move(undo_stack_.back());
+    undo_stack_.pop_back();
+    undo_bytes_ -= entry.bytes;
+    redo_stack_.push_back({root_, entry.bytes});
+    redo_bytes_ += entry.bytes;
+    root_ = std::move(entry.root);
+    ++generation_;
+    last_edit_ = {};
+    transaction_has_entry_ = false;
     return true;
 }
 
 bool PieceTree::redo() {
     if (redo_stack_.empty()) return false;
-    undo_stack_.push_front(root_);
-    root_ = redo_stack_.front();
-    redo_stack_.pop_front();
+    if (journal_.journal) journal_.journal->record_redo();
+    auto entry = std::move(redo_stack_.back());
+    redo_stack_.pop_back();
+    redo_bytes_ -= entry.bytes;
+    undo_stack_.push_back({root_, entry.bytes});
+    undo_bytes_ += entry.bytes;
+    root_ = std::move(entry.root);
+    ++generation_;
+    last_edit_ = {};
+    transaction_has_entry_ = false;
     return true;
 }
 
+void PieceTree::begin_transaction() {
+    if (journal_.journal) journal_.journal->record_begin_transaction();
+    if (transaction_depth_++ == 0) {
+        last_edit_ = {};
+        transaction_has_entry_ = false;
+    }
+}
+
+void PieceTree::end_transaction() {
+    DCHECK_GT(transaction_depth_, 0);
+    if (journal_.journal) journal_.journal->record_end_transaction();
+    if (--transaction_depth_ == 0) {
+        last_edit_ = {};
+        transaction_has_entry_ = false;
+        enforce_undo_limits();
+    }
+}
+
+void PieceTree::break_undo_coalescing() {
+    // Only journal breaks that change what the next edit merges with.
+    if (journal_.journal && last_edit_.kind != EditKind::None) {
+        journal_.journal->record_break_undo_coalescing();
+    }
+    last_edit_ = {};
+}
+
+void PieceTree::set_undo_limits(size_t max_entries, size_t max_bytes) {
+    if (journal_.journal) journal_.journal->record_undo_limits(max_entries, max_bytes);
+    max_undo_entries_ = max_entries;
+    max_undo_bytes_ = max_bytes;
+    enforce_undo_limits();
+}
+
+void PieceTree::record_edit(EditKind kind, size_t offset, size_t count) {
+    ++generation_;
+
+    // Can't redo if we're creating a new undo entry.
+    if (!redo_stack_.empty()) {
+        redo_stack_.clear();
+        dropped_undo_bytes_ += redo_bytes_;
+        redo_bytes_ = 0;
+    }
+
+    // Typing continues at the end of the previous insertion. Backspace erases the text just
+    // before the previous erasure, and forward delete erases at the same offset again.
+    bool continues = false;
+    if (kind == EditKind::Insert && last_edit_.kind == EditKind::Insert) {
+        continues = offset == last_edit_.offset;
+    } else if (kind == EditKind::Erase && last_edit_.kind == EditKind::Erase) {
+        continues = offset + count == last_edit_.offset || offset == last_edit_.offset;
+    }
+
+    bool in_transaction = transaction_depth_ > 0;
+    bool merge = in_transaction ? transaction_has_entry_ : continues;
+    if (!merge || undo_stack_.empty()) {
+        undo_stack_.push_back({root_, 0});
+        transaction_has_entry_ = in_transaction;
+    }
+    undo_stack_.back().bytes += count;
+    undo_bytes_ += count;
+    last_edit_ = {
+        .kind = kind,
+        .offset = kind == EditKind::Insert ? offset + count : offset,
+    };
+
+    // Don't drop the open transaction's entry out from under it; the limits apply once it ends.
+    if (!in_transaction) enforce_undo_limits();
+}
+
+void PieceTree::enforce_undo_limits() {
+    // The newest entry is kept even if it alone exceeds the byte limit.
+    while (!undo_stack_.empty() &&
+           (undo_stack_.size() > max_undo_entries_ ||
+            (undo_bytes_ > max_undo_bytes_ && undo_stack_.size() > 1))) {
+        undo_bytes_ -= undo_stack_.front().bytes;
+        dropped_undo_bytes_ += undo_stack_.front().bytes;
+        undo_stack_.pop_front();
+        if (undo_stack_.empty()) last_edit_ = {};
+    }
+
+    // Scanning the history for live chunks visits every node it holds, so only do so once enough
+    // history has been dropped to possibly free a whole chunk.
+    if (dropped_undo_bytes_ >= ModChunk::kByteCapacity) {
+        release_unreachable_chunks();
+        dropped_undo_bytes_ = 0;
+    }
+}
+
+void PieceTree::release_unreachable_chunks() {
+    std::vector<bool> in_use(buffers_.mod_buffer.chunk_count());
+    std::unordered_set<const Piece*> visited;
+    mark_mod_chunks(root_, visited, in_use);
+    for (const auto& entry : undo_stack_) mark_mod_chunks(entry.root, visited, in_use);
+    for (const auto& entry : redo_stack_) mark_mod_chunks(entry.root, visited, in_use);
+    buffers_.mod_buffer.release_chunks(in_use);
+}
+
+ChunkIterator::ChunkIterator(const PieceTree& tree, size_t first, size_t last)
+    : buffers_{tree.buffers_},
+      offset_{std::min(first, tree.length())},
+      last_{std::min(last, tree.length())} {
+    // Descend to the piece holding `first`, keeping the nodes we go left from.
+    size_t offset = offset_;
+    auto node = tree.root_;
+    while (node) {
+        if (offset < node.left_length()) {
+            stack_.push_back(node);
+            node = node.left();
+        } else if (offset < node.left_length() + node.piece().length) {
+            stack_.push_back(node);
+            skip_ = offset - node.left_length();
+            return;
+        } else {
+            offset -= node.left_length() + node.piece().length;
+            node = node.right();
+        }
+    }
+}
+
+std::string_view ChunkIterator::next() {
+    if (exhausted()) return {};
+    DCHECK(!stack_.empty());
+    auto node = stack_.back();
+    stack_.pop_back();
+    for (auto child = node.right(); child; child = child.left()) {
+        stack_.push_back(child);
+    }
+
+    auto text = get_piece_text(buffers_, node.piece()).substr(skip_, last_ - offset_);
+    skip_ = 0;
+    offset_ += text.size();
+    return text;
+}
+
+ReverseChunkIterator::ReverseChunkIterator(const PieceTree& tree, size_t first, size_t last)
+    : buffers_{tree.buffers_},
+      first_{std::min(first, tree.length())},
+      offset_{std::min(last, tree.length())} {
+    if (offset_ <= first_) return;
+    // Descend to the piece holding the byte before `last`, keeping the nodes we go right from.
+    size_t offset = offset_ - 1;
+    auto node = tree.root_;
+    while (node) {
+        if (offset < node.left_length()) {
+            node = node.left();
+        } else if (offset < node.left_length() + node.piece().length) {
+            stack_.push_back(node);
+            keep_ = offset - node.left_length() + 1;
+            return;
+        } else {
+            stack_.push_back(node);
+            offset -= node.left_length() + node.piece().length;
+            node = node.right();
+        }
+    }
+}
+
+std::string_view ReverseChunkIterator::next() {
+    if (exhausted()) return {};
+    DCHECK(!stack_.empty());
+    auto node = stack_.back();
+    stack_.pop_back();
+    for (auto child = node.left(); child; child = child.right()) {
+        stack_.push_back(child);
+    }
+
+    auto text = get_piece_text(buffers_, node.piece()).substr(0, keep_);
+    keep_ = SIZE_MAX;
+    if (text.size() > offset_ - first_) text = text.substr(text.size() - (offset_ - first_));
+    offset_ -= text.size();
+    return text;
+}
+
 TreeWalker::TreeWalker(const PieceTree& tree, size_t offset)
     : buffers_{tree.buffers_},
       root_{tree.root_},
@@ -750,11 +1360,11 @@ void TreeWalker::populate_ptrs() {
 
     if (dir == Direction::Center) {
         auto& piece = node.piece();
-        const auto& buffer = get_buffer(buffers_, piece.type);
-        auto first_offset = get_offset(buffers_, piece.type, piece.first);
-        auto last_offset = get_offset(buffers_, piece.type, piece.last);
-        first_ptr_ = UNSAFE_TODO(buffer.buffer.data() + first_offset);
-        last_ptr_ = UNSAFE_TODO(buffer.buffer.data() + last_offset);
+        auto text = get_text(buffers_, piece);
+        auto first_offset = get_offset(buffers_, piece, piece.first);
+        auto last_offset = get_offset(buffers_, piece, piece.last);
+        first_ptr_ = UNSAFE_TODO(text.data() + first_offset);
+        last_ptr_ = UNSAFE_TODO(text.data() + last_offset);
         // Change this direction.
         stack_.back().dir = Direction::Right;
         return;
@@ -782,11 +1392,11 @@ void TreeWalker::fast_forward_to(size_t offset) {
             // Make the offset relative to this piece.
             offset -= node.left_length();
             auto& piece = node.piece();
-            const auto& buffer = get_buffer(buffers_, piece.type);
-            auto first_offset = get_offset(buffers_, piece.type, piece.first);
-            auto last_offset = get_offset(buffers_, piece.type, piece.last);
-            first_ptr_ = UNSAFE_TODO(buffer.buffer.data() + first_offset + offset);
-            last_ptr_ = UNSAFE_TODO(buffer.buffer.data() + last_offset);
+            auto text = get_text(buffers_, piece);
+            auto first_offset = get_offset(buffers_, piece, piece.first);
+            auto last_offset = get_offset(buffers_, piece, piece.last);
+            first_ptr_ = UNSAFE_TODO(text.data() + first_offset + offset);
+            last_ptr_ = UNSAFE_TODO(text.data() + last_offset);
             return;
         } else {
             DCHECK(!stack_.empty());
@@ -901,11 +1511,11 @@ void ReverseTreeWalker::populate_ptrs() {
 
     if (dir == Direction::Center) {
         auto& piece = node.piece();
-        const auto& buffer = get_buffer(buffers_, piece.type);
-        auto first_offset = get_offset(buffers_, piece.type, piece.first);
-        auto last_offset = get_offset(buffers_, piece.type, piece.last);
-        last_ptr_ = UNSAFE_TODO(buffer.buffer.data() + first_offset);
-        first_ptr_ = UNSAFE_TODO(buffer.buffer.data() + last_offset);
+        auto text = get_text(buffers_, piece);
+        auto first_offset = get_offset(buffers_, piece, piece.first);
+        auto last_offset = get_offset(buffers_, piece, piece.last);
+        last_ptr_ = UNSAFE_TODO(text.data() + first_offset);
+        first_ptr_ = UNSAFE_TODO(text.data() + last_offset);
         // Change this direction.
         stack_.back().dir = Direction::Left;
         return;
@@ -934,10 +1544,10 @@ void ReverseTreeWalker::fast_forward_to(size_t offset) {
             // Make the offset relative to this piece.
             offset -= node.left_length();
             auto& piece = node.piece();
-            const auto& buffer = get_buffer(buffers_, piece.type);
-            auto first_offset = get_offset(buffers_, piece.type, piece.first);
-            last_ptr_ = UNSAFE_TODO(buffer.buffer.data() + first_offset);
-            first_ptr_ = UNSAFE_TODO(buffer.buffer.data() + first_offset + offset);
+            auto text = get_text(buffers_, piece);
+            auto first_offset = get_offset(buffers_, piece, piece.first);
+            last_ptr_ = UNSAFE_TODO(text.data() + first_offset);
+            first_ptr_ = UNSAFE_TODO(text.data() + first_offset + offset);
             return;
         } else {
             // For when we revisit this node.
@@ -1,85 +1,338 @@
 #pragma once
 
+#include "base/files/memory_mapped_file.h"
+#include "editor/buffer/line_start_index.h"
+#include "editor/buffer/mod_buffer.h"
 #include "editor/buffer/red_black_tree.h"
+#include "editor/buffer/resident_pages.h"
+#include "editor/buffer/text_buffer.h"
+#include "editor/buffer/text_metrics.h"
+#include <cstdint>
+#include <deque>
 #include <format>
-#include <forward_list>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <variant>
 #include <vector>
 
 namespace editor {
 
+class EditJournal;
 struct NodePosition;
 
 struct CharBuffer {
     std::string buffer;
-    std::vector<size_t> line_starts;
+    // When set, the contents live in this read-only mapping and `buffer` is unused.
+    std::shared_ptr<const base::MemoryMappedFile> mapped_file;
+    LineStartIndex line_starts;
+    // See `index_text_metrics()`.
+    std::vector<TextMetrics> block_metrics;
+    // Set in large-file mode, where every read of `mapped_file` is reported to it.
+    std::unique_ptr<ResidentPages> resident_pages;
+
+    std::string_view text() const { return mapped_file ? mapped_file->str() : buffer; }
 };
 
 struct BufferCollection {
-    CharBuffer orig_buffer;
-    CharBuffer mod_buffer;
+    // Never modified after construction, so copies and snapshots share it.
+    std::shared_ptr<const CharBuffer> orig_buffer;
+    ModBuffer mod_buffer;
+};
+
+// Replaces `count` bytes at `offset` with `text`.
+struct Edit {
+    size_t offset{};
+    size_t count{};
+    std::string_view text;
+};
+
+struct CompactOptions {
+    // Also copy runs of two or more pieces shorter than `fragment_length` into one fresh piece.
+    bool rewrite_fragments = false;
+    size_t fragment_length = 256;
+};
+
+// Counts of the tree nodes that offset and line lookups visit.
+struct LookupStats {
+    size_t lookups = 0;
+    size_t nodes_visited = 0;
+
+    double nodes_per_lookup() const {
+        return lookups ? static_cast<double>(nodes_visited) / lookups : 0;
+    }
 };
 
-struct LineRange {
-    size_t first{};
-    size_t last{};
+// The path from the root to where the previous lookup ended, with where each subtree starts. A
+// lookup near the previous one climbs only to the nearest subtree that covers it, and descends
+// from there instead of from the root. Entries point into nodes, so the path is only valid while
+// the root it was taken from is unchanged.
+struct LookupFinger {
+    struct Entry {
+        const RedBlackTree* node;
+        size_t offset;  // Where the subtree starts in the document.
+        size_t line;    // Line feeds before the subtree.
+    };
+
+    std::vector<Entry> path;  // Excludes the root.
+    size_t generation = 0;
+    bool enabled = true;
+    LookupStats stats;
 };
 
-class PieceTree {
+// A compaction in progress. See `PieceTree::begin_compaction()`.
+class Compaction {
+public:
+    // Merges and copies pieces. This only reads bytes that are never written again, so it may run
+    // on any thread while the tree keeps being edited.
+    void run();
+
+private:
+    friend class PieceTree;
+
+    CompactOptions options_;
+    size_t generation_ = 0;
+    std::vector<Piece> pieces_;
+    // The text of each piece. Only filled in when rewriting fragments.
+    std::vector<std::string_view> texts_;
+    // Keeps the chunks behind `texts_` alive even if the tree releases them in the meantime.
+    ModBuffer mod_buffer_;
+    // In large-file mode, whether each piece starts a page of the original buffer. Such pieces
+    // aren't merged into the one before, so no piece reads across a page boundary.
+    std::vector<bool> page_starts_;
+    // Either a piece to keep, or text to append as a new piece.
+    std::vector<std::variant<Piece, std::string>> result_;
+    bool done_ = false;
+};
+
+class PieceTree final : public TextBuffer {
 public:
     PieceTree() : PieceTree(std::string_view{}) {}
     explicit PieceTree(std::string_view txt);
+    // Takes ownership of a mapped file and reads it in place instead of copying it.
+    // NOTE: On POSIX nothing stops another process from modifying the file while it is mapped.
+    // Truncated pages read as zeros and in-place rewrites show through, so the document may
+    // silently change (see `base::MemoryMappedFile`). Line starts stay in bounds either way.
+    explicit PieceTree(std::unique_ptr<base::MemoryMappedFile> file);
+    // Large-file mode, for files that may not fit in memory. The file is read in place as above,
+    // but at most about `resident_budget` bytes of it stay resident: pages are read in as lookups
+    // need them and the least recently read are evicted (see `ResidentPages`). Opening still scans
+    // the whole file once to index it, a page at a time. The original buffer is split into one
+    // piece per page so every read stays within one page.
+    PieceTree(std::unique_ptr<base::MemoryMappedFile> file, size_t resident_budget);
     PieceTree& operator=(std::string_view txt);
     PieceTree& assign(std::string_view txt) { return *this = PieceTree(txt); }
 
     // Manipulation.
-    void insert(size_t offset, std::string_view txt);
-    void erase(size_t offset, size_t count);
+    void insert(size_t offset, std::string_view txt) override;
+    void erase(size_t offset, size_t count) override;
+    // Applies all of `edits` as a single undo entry. Edits must be sorted by offset and must not
+    // overlap; every offset refers to the document before any of them are applied.
+    void apply_edits(std::span<const Edit> edits);
     void clear() { *this = PieceTree{}; }
-    bool undo();
-    bool redo();
+
+    // Compaction.
+    // Merges adjacent pieces that are contiguous in their buffer and, if requested, copies runs of
+    // short pieces into fresh contiguous text. The document and undo history are unchanged.
+    void compact(const CompactOptions& options = {});
+    // The same in three steps, so `Compaction::run()` can happen on another thread. This tree must
+    // not be destroyed or reassigned until the compaction has run. `finish_compaction()` returns
+    // false and leaves the tree alone if it was edited after `begin_compaction()`.
+    Compaction begin_compaction(const CompactOptions& options = {}) const;
+    bool finish_compaction(Compaction&& compaction);
+
+    // Undo history. See `TextBuffer`.
+    static constexpr size_t kDefaultMaxUndoEntries = 10'000;
+    static constexpr size_t kDefaultMaxUndoBytes = 64 * 1024 * 1024;
+    bool undo() override;
+    bool redo() override;
+    void begin_transaction() override;
+    void end_transaction() override;
+    void break_undo_coalescing() override;
+    // Once either limit is exceeded, the oldest entries are dropped (the byte limit never drops
+    // the newest one). Mod buffer chunks that only dropped history referred to are then released.
+    void set_undo_limits(size_t max_entries, size_t max_bytes);
+    size_t undo_entry_count() const { return undo_stack_.size(); }
+    // Bytes inserted or erased by the edits that the undo and redo history can revert.
+    size_t undo_retained_bytes() const { return undo_bytes_ + redo_bytes_; }
 
     // Metadata.
-    size_t length() const { return root_.length(); }
-    bool empty() const { return length() == 0; }
-    size_t line_feed_count() const { return root_.line_feed_count(); }
-    size_t line_count() const { return line_feed_count() + 1; }
+    size_t length() const override { return root_.length(); }
+    size_t line_feed_count() const override { return root_.line_feed_count(); }
 
     // Queries.
-    std::string get_line_content(size_t line) const;
-    std::string get_line_content_with_newline(size_t line) const;
-    // This is similar to `get_line_content_with_newline`, except newlines are replaced by spaces.
-    std::string get_line_content_for_layout_use(size_t line) const;
-    size_t line_at(size_t offset) const;
-    BufferCursor line_column_at(size_t offset) const;
-    size_t offset_at(size_t line, size_t column) const;
-    LineRange get_line_range(size_t line) const;
-    LineRange get_line_range_with_newline(size_t line) const;
-    std::string str() const;
-    std::string substr(size_t offset, size_t count) const;
-    std::optional<size_t> find(std::string_view txt) const;
+    std::string get_line_content_with_newline(size_t line) const override;
+    void get_lines(size_t first, size_t count, LineBlock& lines) const override;
+    size_t line_at(size_t offset) const override;
+    BufferCursor line_column_at(size_t offset) const override;
+    size_t offset_at(size_t line, size_t column) const override;
+    LineRange get_line_range(size_t line) const override;
+    LineRange get_line_range_with_newline(size_t line) const override;
+    std::string substr(size_t offset, size_t count) const override;
+
+    // Unicode positions. These read the codepoint and UTF-16 counts kept in the tree, so each
+    // takes O(log n) plus a scan of at most a few kilobytes. See `TextMetrics` for how invalid
+    // UTF-8 is counted.
+    TextMetrics metrics() const { return root_.metrics(); }
+    // The number of UTF-16 code units before `offset`.
+    size_t offset_to_utf16(size_t offset) const;
+    // The offset just past the first `units` UTF-16 code units, clamped to the document. A
+    // position between the two halves of a surrogate pair resolves to the start of its codepoint.
+    size_t utf16_to_offset(size_t units) const;
+    size_t codepoint_column_at(size_t offset) const override;
+
+    // Chunk access. Chunks are pieces.
+    TextChunk chunk_at(size_t offset) const override;
+    void for_each_chunk(size_t first,
+                        size_t last,
+                        const std::function<bool(std::string_view)>& visit) const override;
+
+    // Returns an immutable copy of the current document, without undo history. No text is copied,
+    // so this is cheap. Snapshots may be read and released on any thread while this tree keeps
+    // being edited.
+    std::shared_ptr<const PieceTree> snapshot() const;
+
+    // Crash recovery. Every edit, undo, redo, transaction boundary and undo limit change is
+    // recorded in `journal` until it is unset. The tree doesn't own the journal. Copies, snapshots
+    // and newly assigned documents start without one.
+    void set_journal(EditJournal* journal) { journal_.journal = journal; }
+    EditJournal* journal() const { return journal_.journal; }
 
     // Debug use.
     // TODO: Should we expose a better debug interface?
     RedBlackTree root() const { return root_; }
+    // Lookups made through `line_at()`, `line_column_at()`, `offset_at()`, `get_line_range()` and
+    // friends. Snapshots don't count theirs.
+    LookupStats lookup_stats() const { return finger_.stats; }
+    void reset_lookup_stats() { finger_.stats = {}; }
+    // Lookups start from where the previous one ended until the next edit. Disabling this makes
+    // every lookup start from the root, for comparison.
+    void set_lookup_finger_enabled(bool enabled) { finger_.enabled = enabled; }
+    size_t mod_buffer_allocated_bytes() const { return buffers_.mod_buffer.allocated_bytes(); }
+    // In large-file mode, the bytes of the file currently held in memory. Otherwise 0.
+    size_t resident_file_bytes() const;
 
 private:
     friend class TreeWalker;
     friend class ReverseTreeWalker;
+    friend class ChunkIterator;
+    friend class ReverseChunkIterator;
+
+    explicit PieceTree(CharBuffer orig_buffer);
+
+    // `Replace` covers batches from `apply_edits()`, which never coalesce.
+    enum class EditKind { None, Insert, Erase, Replace };
+
+    struct UndoEntry {
+        RedBlackTree root;  // The tree before this entry's edits.
+        size_t bytes = 0;   // Bytes inserted or erased by this entry's edits.
+    };
+
+    struct LastEdit {
+        EditKind kind = EditKind::None;
+        size_t offset = 0;  // For `Insert`, the end of the inserted text; for `Erase`, its start.
+    };
+
+    // Moves carry the journal over, but copies don't.
+    struct JournalHolder {
+        EditJournal* journal = nullptr;
+
+        JournalHolder() = default;
+        JournalHolder(const JournalHolder&) {}
+        JournalHolder& operator=(const JournalHolder&) {
+            journal = nullptr;
+            return *this;
+        }
+        JournalHolder(JournalHolder&&) = default;
+        JournalHolder& operator=(JournalHolder&&) = default;
+    };
+
+    // Undo bookkeeping. Must be called before every mutation of `root_`.
+    void record_edit(EditKind kind, size_t offset, size_t count);
+    void enforce_undo_limits();
+    void release_unreachable_chunks();
 
     // Direct mutations.
-    Piece build_piece(std::string_view txt);
+    void insert_internal(size_t offset, std::string_view txt);
+    void erase_internal(size_t offset, size_t count);
+    void rebuild_with_edits(std::span<const Edit> edits);
     void combine_pieces(NodePosition existing_piece, Piece new_piece);
     void remove_node_range(NodePosition first, size_t length);
 
+    // The finger for the next lookup, emptied if the tree has changed since the last one. Returns
+    // null in snapshots, which several threads may read at once.
+    LookupFinger* finger() const;
+
     BufferCollection buffers_;
+    // Node storage for `root_` and the undo/redo history. Nodes keep their arena alive, so trees
+    // handed out by `root()` remain valid after this `PieceTree` is gone.
+    scoped_refptr<NodeArena> arena_ = base::MakeRefCounted<NodeArena>();
     RedBlackTree root_;
-    BufferCursor last_insert_;
 
-    std::forward_list<RedBlackTree> undo_stack_;
-    std::forward_list<RedBlackTree> redo_stack_;
+    // Oldest entries are at the front.
+    std::deque<UndoEntry> undo_stack_;
+    std::deque<UndoEntry> redo_stack_;
+    size_t undo_bytes_ = 0;
+    size_t redo_bytes_ = 0;
+    size_t max_undo_entries_ = kDefaultMaxUndoEntries;
+    size_t max_undo_bytes_ = kDefaultMaxUndoBytes;
+    // Bytes of history dropped since chunks were last released.
+    size_t dropped_undo_bytes_ = 0;
+    LastEdit last_edit_;
+    size_t transaction_depth_ = 0;
+    // Bumped whenever `root_` changes its contents.
+    size_t generation_ = 0;
+    // Whether the open transaction has already pushed its undo entry.
+    bool transaction_has_entry_ = false;
+    // Where the last lookup ended. Const queries update it, so it is not shared across threads.
+    mutable LookupFinger finger_;
+    bool is_snapshot_ = false;
+    JournalHolder journal_;
+};
+
+// Yields the text in [first, last) one piece at a time, clipped to the range. Views point into the
+// tree's buffers and stay valid while the tree is alive.
+class ChunkIterator {
+public:
+    ChunkIterator(const PieceTree& tree, size_t first = 0, size_t last = SIZE_MAX);
+
+    // Returns the next chunk, or an empty view once the range is exhausted. Chunks are never
+    // empty.
+    std::string_view next();
+    bool exhausted() const { return offset_ >= last_; }
+    // The offset of the next chunk.
+    constexpr size_t offset() const { return offset_; }
+
+private:
+    const BufferCollection& buffers_;
+    // Nodes whose piece and right subtree are still to come, nearest last.
+    std::vector<RedBlackTree> stack_;
+    size_t offset_;
+    size_t last_;
+    // How much of the top node's piece lies before `first`.
+    size_t skip_ = 0;
+};
+
+// The same as `ChunkIterator`, but from `last` back to `first`.
+class ReverseChunkIterator {
+public:
+    ReverseChunkIterator(const PieceTree& tree, size_t first = 0, size_t last = SIZE_MAX);
+
+    std::string_view next();
+    bool exhausted() const { return offset_ <= first_; }
+    // The offset just past the next chunk.
+    constexpr size_t offset() const { return offset_; }
+
+private:
+    const BufferCollection& buffers_;
+    // Nodes whose piece and left subtree are still to come, nearest last.
+    std::vector<RedBlackTree> stack_;
+    size_t first_;
+    size_t offset_;
+    // How much of the top node's piece lies before `last`.
+    size_t keep_ = SIZE_MAX;
 };
 
 class TreeWalker {
@@ -156,12 +409,3 @@ struct std::formatter<editor::PieceTree> {
         return std::format_to(ctx.out(), "{}", pt.str());
     }
 };
-
-template <>
-struct std::formatter<editor::LineRange> {
-    constexpr auto parse(std::format_parse_context& ctx) { return ctx.begin(); }
-    template <class FormatContext>
-    auto format(const editor::LineRange& r, FormatContext& ctx) const {
-        return std::format_to(ctx.out(), "[{}..{}]", r.first, r.last);
-    }
-};
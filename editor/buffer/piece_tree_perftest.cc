@@ -0,0 +1,490 @@
+#include "base/debug/memory_usage.h"
+#include "base/debug/profiler.h"
+#include "base/files/file_reader.h"
+#include "base/rand_util.h"
+#include "base/test/perf_test_data.h"
+#include "editor/buffer/piece_tree.h"
+#include "editor/buffer/save_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <gtest/gtest.h>
+#include <print>
+#include <ranges>
+#include <vector>
+
+namespace editor {
+
+namespace {
+
+constexpr size_t N = 100'000;
+
+constexpr std::string_view kFileName = "piece_tree_perftest_1gb.txt";
+const base::FilePath kFilePath{FILE_PATH_LITERAL("piece_tree_perftest_1gb.txt")};
+
+void write_1gb_file() { base::WriteFile(kFileName, base::make_1gb_sample()); }
+
+size_t piece_count(const RedBlackTree& node) {
+    return !node ? 0 : piece_count(node.left()) + 1 + piece_count(node.right());
+}
+
+size_t depth(const RedBlackTree& node) {
+    return !node ? 0 : 1 + std::max(depth(node.left()), depth(node.right()));
+}
+
+// Prints the shape of `tree` and the time taken by `N` random offset and line lookups.
+void report_lookups(std::string_view label, const PieceTree& tree) {
+    std::println("{}: {} pieces, depth {}", label, piece_count(tree.root()), depth(tree.root()));
+    auto p = base::Profiler{std::format("{}: {} lookups", label, N)};
+    size_t sum = 0;
+    for (size_t i = 0; i < N; i++) {
+        sum += tree.line_column_at(base::rand_int(0, tree.length())).column;
+        sum += tree.offset_at(base::rand_int(0, tree.line_feed_count()), 0);
+    }
+    p.stop_mili();
+    EXPECT_GT(sum, 0);
+}
+
+ptrdiff_t resident_mb() {
+    return static_cast<ptrdiff_t>(base::resident_memory_bytes() / 1024 / 1024);
+}
+
+ptrdiff_t peak_resident_mb() {
+    return static_cast<ptrdiff_t>(base::peak_resident_memory_bytes() / 1024 / 1024);
+}
+
+// Runs `open` and reports its latency, resident delta and peak resident delta. The peak is only
+// meaningful per path where the platform can reset it; elsewhere run each test on its own with
+// --gtest_filter.
+template <typename F>
+void measure_open(std::string_view name, F&& open) {
+    bool peak_was_reset = base::reset_peak_resident_memory();
+    ptrdiff_t rss_before = resident_mb();
+    ptrdiff_t peak_before = peak_resident_mb();
+
+    auto p = base::Profiler{name};
+    PieceTree tree = open();
+    p.stop_mili();
+
+    std::println("Resident delta: {} MB", resident_mb() - rss_before);
+    if (peak_was_reset) {
+        std::println("Peak resident delta: {} MB", peak_resident_mb() - peak_before);
+    } else {
+        std::println("Peak resident (process lifetime): {} MB", peak_resident_mb());
+    }
+    EXPECT_EQ(tree.line_count(), base::kPerfTestLongLineCount + 1);
+}
+
+// Runs `save` and reports its latency and peak resident delta.
+template <typename F>
+void measure_save(std::string_view name, F&& save) {
+    bool peak_was_reset = base::reset_peak_resident_memory();
+    ptrdiff_t peak_before = peak_resident_mb();
+
+    auto p = base::Profiler{name};
+    save();
+    p.stop_mili();
+
+    if (peak_was_reset) {
+        std::println("Peak resident delta: {} MB", peak_resident_mb() - peak_before);
+    } else {
+        std::println("Peak resident (process lifetime): {} MB", peak_resident_mb());
+    }
+}
+
+}  // namespace
+
+TEST(PieceTreePerfTest, RandomInsertions) {
+    PieceTree tree{base::rand_string_with_newlines(N, N / 50)};
+    auto p1 = base::Profiler{"PieceTree random insertions"};
+    for (size_t i = 0; i < N; i++) {
+        size_t offset = base::rand_int(0, tree.length());
+        tree.insert(offset, "abc\n");
+    }
+    p1.stop_mili();
+    EXPECT_EQ(tree.length(), N * 5);
+}
+
+TEST(PieceTreePerfTest, RandomErasures) {
+    PieceTree tree{base::rand_string_with_newlines(N, N / 50)};
+    for (size_t i = 0; i < N; i++) {
+        size_t offset = base::rand_int(0, tree.length());
+        tree.insert(offset, "abc\n");
+    }
+
+    auto p1 = base::Profiler{"PieceTree random erasures"};
+    while (!tree.empty()) {
+        size_t offset = base::rand_int(0, tree.length() - 1);
+        tree.erase(offset, 5);
+    }
+    p1.stop_mili();
+}
+
+TEST(PieceTreePerfTest, SequentialTyping) {
+    PieceTree tree{base::rand_string_with_newlines(N, N / 50)};
+    size_t caret = tree.length() / 2;
+    auto p1 = base::Profiler{"PieceTree sequential typing"};
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(caret, "a");
+        ++caret;
+    }
+    p1.stop_mili();
+    EXPECT_EQ(tree.length(), N * 2);
+}
+
+// Typing throughput must not degrade as the mod buffer grows: appends never copy earlier edits.
+TEST(PieceTreePerfTest, LongTypingSession) {
+    constexpr size_t kBlocks = 10;
+    PieceTree tree{base::rand_string_with_newlines(N, N / 50)};
+    size_t caret = tree.length() / 2;
+    for (size_t block = 0; block < kBlocks; ++block) {
+        auto p = base::Profiler{std::format("PieceTree typing, keystrokes {}-{}", block * N,
+                                            (block + 1) * N)};
+        for (size_t i = 0; i < N; i++) {
+            tree.insert(caret, i % 80 == 79 ? "\n" : "a");
+            ++caret;
+        }
+        p.stop_mili();
+    }
+    EXPECT_EQ(tree.length(), N * (kBlocks + 1));
+}
+
+// A replace-all: 10k evenly spaced replacements, applied one at a time and as a single batch.
+TEST(PieceTreePerfTest, ApplyEdits) {
+    constexpr size_t kEdits = 10'000;
+    const std::string str = base::rand_string_with_newlines(N * 10, N / 5);
+    const size_t spacing = str.length() / kEdits;
+    std::vector<Edit> edits;
+    for (size_t i = 0; i < kEdits; ++i) {
+        edits.push_back({.offset = i * spacing, .count = 3, .text = "replacement"});
+    }
+
+    PieceTree looped{str};
+    auto p1 = base::Profiler{"PieceTree 10k edits, erase/insert loop"};
+    // Right to left, so earlier edits don't shift later offsets.
+    for (const auto& edit : std::views::reverse(edits)) {
+        looped.erase(edit.offset, edit.count);
+        looped.insert(edit.offset, edit.text);
+    }
+    p1.stop_mili();
+
+    PieceTree batched{str};
+    auto p2 = base::Profiler{"PieceTree 10k edits, apply_edits"};
+    batched.apply_edits(edits);
+    p2.stop_mili();
+
+    EXPECT_EQ(batched.length(), looped.length());
+    EXPECT_EQ(batched.undo_entry_count(), 1);
+    EXPECT_EQ(batched.str(), looped.str());
+}
+
+TEST(PieceTreePerfTest, CompactAfterRandomEdits) {
+    PieceTree tree{base::rand_string_with_newlines(N * 10, N / 5)};
+    for (size_t i = 0; i < N; i++) {
+        size_t offset = base::rand_int(0, tree.length());
+        if (i % 4 == 3) {
+            tree.erase(offset, 3);
+        } else {
+            tree.insert(offset, "abc\n");
+        }
+    }
+    const std::string str = tree.str();
+    report_lookups("Fragmented", tree);
+
+    auto p1 = base::Profiler{"PieceTree compact, merge only"};
+    tree.compact();
+    p1.stop_mili();
+    report_lookups("Merged", tree);
+
+    auto p2 = base::Profiler{"PieceTree compact, rewrite fragments"};
+    tree.compact({.rewrite_fragments = true});
+    p2.stop_mili();
+    report_lookups("Rewritten", tree);
+
+    EXPECT_EQ(tree.str(), str);
+}
+
+TEST(PieceTreePerfTest, Str1Gb) {
+    PieceTree tree{base::make_1gb_sample()};
+    // Split the document into a few thousand pieces.
+    for (size_t i = 1; i <= 1000; ++i) {
+        tree.insert(tree.length() / 1000 * i - i, "abc\n");
+    }
+
+    size_t walked = 0;
+    {
+        // The previous implementation: one `TreeWalker::next()` call per byte.
+        std::string str;
+        str.reserve(tree.length());
+        auto p1 = base::Profiler{"PieceTree str() with TreeWalker (1GB)"};
+        TreeWalker walker{tree};
+        while (!walker.exhausted()) str.push_back(walker.next());
+        p1.stop_mili();
+        walked = str.size();
+    }
+
+    auto p2 = base::Profiler{"PieceTree str() (1GB)"};
+    std::string str = tree.str();
+    p2.stop_mili();
+
+    EXPECT_EQ(walked, tree.length());
+    EXPECT_EQ(str.size(), tree.length());
+}
+
+// Fetches a screenful of lines per frame while scrolling through a fragmented document.
+TEST(PieceTreePerfTest, ScrollVisibleLines) {
+    constexpr size_t kVisibleLines = 100;
+    PieceTree tree{base::rand_string_with_newlines(N * 10, N / 5)};
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(base::rand_int(0, tree.length()), "abc\n");
+    }
+    const size_t frames = tree.line_count() - kVisibleLines;
+
+    size_t bytes_per_line = 0;
+    auto p1 = base::Profiler{"PieceTree scroll, one lookup per line"};
+    for (size_t first = 0; first < frames; first += 7) {
+        for (size_t line = first; line < first + kVisibleLines; ++line) {
+            bytes_per_line += tree.get_line_content_for_layout_use(line).size();
+        }
+    }
+    p1.stop_mili();
+
+    size_t bytes_per_frame = 0;
+    LineBlock lines;
+    auto p2 = base::Profiler{"PieceTree scroll, get_lines"};
+    for (size_t first = 0; first < frames; first += 7) {
+        tree.get_lines(first, kVisibleLines, lines);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            bytes_per_frame += lines.line_for_layout_use(i).size();
+        }
+    }
+    p2.stop_mili();
+
+    EXPECT_EQ(bytes_per_frame, bytes_per_line);
+}
+
+// Counts the nodes visited per lookup while scrolling and while typing, with lookups starting from
+// the root and from the previous lookup's finger.
+TEST(PieceTreePerfTest, LookupFinger) {
+    constexpr size_t kVisibleLines = 100;
+    PieceTree tree{base::rand_string_with_newlines(N * 10, N / 5)};
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(base::rand_int(0, tree.length()), "abc\n");
+    }
+    std::println("{} pieces, depth {}", piece_count(tree.root()), depth(tree.root()));
+
+    // What a frame asks for: every visible line, and the caret's line and column a few times.
+    auto draw_frame = [&](size_t first, size_t caret) {
+        size_t sum = 0;
+        for (size_t line = first; line < first + kVisibleLines; ++line) {
+            auto [start, end] = tree.get_line_range(line);
+            sum += end - start;
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            auto [line, column] = tree.line_column_at(caret);
+            sum += tree.offset_at(line, column);
+        }
+        return sum;
+    };
+
+    for (bool enabled : {false, true}) {
+        std::string_view label = enabled ? "finger" : "root";
+        tree.set_lookup_finger_enabled(enabled);
+        const size_t frames = tree.line_count() - kVisibleLines;
+
+        tree.reset_lookup_stats();
+        size_t sum = 0;
+        auto p1 = base::Profiler{std::format("PieceTree scroll, lookups from {}", label)};
+        for (size_t first = 0; first < frames; first += 7) {
+            sum += draw_frame(first, tree.offset_at(first + kVisibleLines / 2, 0));
+        }
+        p1.stop_mili();
+        std::println("Scroll: {:.1f} nodes per lookup over {} lookups",
+                     tree.lookup_stats().nodes_per_lookup(), tree.lookup_stats().lookups);
+
+        PieceTree typed = tree;
+        size_t caret = typed.length() / 2;
+        size_t first = typed.line_at(caret) - kVisibleLines / 2;
+        std::swap(tree, typed);
+        tree.reset_lookup_stats();
+        auto p2 = base::Profiler{std::format("PieceTree typing, lookups from {}", label)};
+        for (size_t i = 0; i < N / 10; i++) {
+            tree.insert(caret, i % 40 == 39 ? "\n" : "a");
+            ++caret;
+            sum += draw_frame(first, caret);
+        }
+        p2.stop_mili();
+        std::println("Typing: {:.1f} nodes per lookup over {} lookups",
+                     tree.lookup_stats().nodes_per_lookup(), tree.lookup_stats().lookups);
+        std::swap(tree, typed);
+        EXPECT_GT(sum, 0);
+    }
+}
+
+// Converts random offsets to UTF-16 positions and codepoint columns in a fragmented document with
+// astral-plane text and long lines, first by decoding from the start of the line, then through the
+// metrics kept in the tree.
+TEST(PieceTreePerfTest, Utf16Conversions) {
+    static constexpr std::string_view kTokens[] = {"a", "b", "é", "€", "😀", " "};
+    std::string text;
+    for (size_t line = 0; line < 1000; ++line) {
+        for (size_t i = 0; i < 2000; ++i) text += kTokens[base::rand_int(0, 5)];
+        text += '\n';
+    }
+    PieceTree tree{text};
+    for (size_t i = 0; i < N; i++) {
+        size_t line = base::rand_int(0, tree.line_count() - 1);
+        tree.insert(tree.get_line_range(line).first, "😀x");
+    }
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i < N; i++) {
+        offsets.push_back(tree.get_line_range(base::rand_int(0, tree.line_count() - 1)).last);
+    }
+
+    size_t decoded = 0;
+    auto p1 = base::Profiler{std::format("Decode from line start: {} columns", N)};
+    for (size_t offset : offsets) {
+        size_t first = tree.get_line_range(tree.line_at(offset)).first;
+        TreeWalker walker{tree, first};
+        while (walker.offset() < offset) {
+            char32_t c = walker.next_codepoint();
+            decoded += c >= 0x10000 ? 2 : 1;
+        }
+    }
+    p1.stop_mili();
+
+    size_t converted = 0;
+    auto p2 = base::Profiler{std::format("Tree metrics: {} columns", N)};
+    for (size_t offset : offsets) {
+        size_t first = tree.get_line_range(tree.line_at(offset)).first;
+        converted += tree.offset_to_utf16(offset) - tree.offset_to_utf16(first);
+    }
+    p2.stop_mili();
+    EXPECT_EQ(converted, decoded);
+
+    auto p3 = base::Profiler{std::format("Tree metrics: {} codepoint columns", N)};
+    size_t columns = 0;
+    for (size_t offset : offsets) columns += tree.codepoint_column_at(offset);
+    p3.stop_mili();
+
+    auto p4 = base::Profiler{std::format("Tree metrics: {} UTF-16 round trips", N)};
+    size_t round_trips = 0;
+    for (size_t offset : offsets) {
+        round_trips += tree.utf16_to_offset(tree.offset_to_utf16(offset)) == offset;
+    }
+    p4.stop_mili();
+    EXPECT_EQ(round_trips, N);
+    EXPECT_GT(columns, 0);
+}
+
+// Saves a heavily edited 1GB document, first by flattening it into one string, then by streaming
+// its pieces with `save_file()`.
+TEST(PieceTreePerfTest, Save1Gb) {
+    PieceTree tree{base::make_1gb_sample()};
+    for (size_t i = 0; i < N; i++) {
+        tree.insert(base::rand_int(0, tree.length()), "abc\n");
+    }
+
+    measure_save("Save 1GB file (str() + WriteFile)",
+                 [&] { base::WriteFile(kFileName, tree.str()); });
+    EXPECT_EQ(std::filesystem::file_size(kFileName), tree.length());
+    std::remove(kFileName.data());
+
+    SaveStats stats;
+    measure_save("Save 1GB file (save_file)",
+                 [&] { EXPECT_TRUE(save_file(tree, kFilePath, &stats)); });
+    std::println("save_file: {} write calls, {:.0f} MB/s", stats.write_calls,
+                 stats.megabytes_per_second());
+    EXPECT_EQ(std::filesystem::file_size(kFileName), tree.length());
+    std::remove(kFileName.data());
+}
+
+// Opens a file the way `EditorWidget::open_file` used to: read it into a string, then copy it
+// into the tree.
+TEST(PieceTreePerfTest, OpenFile1GbReadFile) {
+    write_1gb_file();
+    measure_open("Open 1GB file (ReadFile + copy)", [] {
+        std::string contents = base::ReadFile(kFileName);
+        return PieceTree{contents};
+    });
+    std::remove(kFileName.data());
+}
+
+// Hands the tree a memory mapping of the file. These pages are file-backed, so the OS can drop
+// them under memory pressure.
+TEST(PieceTreePerfTest, OpenFile1GbMapped) {
+    write_1gb_file();
+    measure_open("Open 1GB file (memory mapped)", [] {
+        auto file = std::make_unique<base::MemoryMappedFile>();
+        EXPECT_TRUE(file->Initialize(kFilePath));
+        return PieceTree{std::move(file)};
+    });
+    std::remove(kFileName.data());
+}
+
+// Opens a file several times larger than the resident budget in large-file mode, shows its last
+// screen the way dragging the scrollbar to the bottom would, then jumps between random screens.
+// Apart from the line index, only the budgeted pages should stay resident.
+TEST(PieceTreePerfTest, OpenFile4GbLargeFileMode) {
+    constexpr std::string_view kLargeFileName = "piece_tree_perftest_4gb.txt";
+    const base::FilePath kLargeFilePath{FILE_PATH_LITERAL("piece_tree_perftest_4gb.txt")};
+    constexpr size_t kSize = size_t{4} * 1024 * 1024 * 1024;
+    constexpr size_t kBudget = 256 * 1024 * 1024;
+    constexpr size_t kScreenLines = 60;
+    {
+        std::string block;
+        while (block.size() < 1024 * 1024) block += base::kPerfTestLongLine;
+        FILE* out = fopen(kLargeFileName.data(), "wb");
+        ASSERT_TRUE(out);
+        for (size_t written = 0; written < kSize; written += block.size()) {
+            fwrite(block.data(), 1, block.size(), out);
+        }
+        fclose(out);
+    }
+
+    bool peak_was_reset = base::reset_peak_resident_memory();
+    ptrdiff_t rss_before = resident_mb();
+    ptrdiff_t peak_before = peak_resident_mb();
+
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    ASSERT_TRUE(file->Initialize(kLargeFilePath));
+    auto p1 = base::Profiler{"Open 4GB file (large-file mode)"};
+    PieceTree tree{std::move(file), kBudget};
+    p1.stop_mili();
+
+    // What stays resident after opening is the line and metrics index.
+    ptrdiff_t rss_after_open = resident_mb();
+    std::println("Resident delta after opening: {} MB", rss_after_open - rss_before);
+    if (peak_was_reset) {
+        std::println("Peak resident delta while opening: {} MB", peak_resident_mb() - peak_before);
+    }
+
+    LineBlock lines;
+    auto p2 = base::Profiler{"Show the last screen"};
+    tree.get_lines(tree.line_count() - kScreenLines, kScreenLines, lines);
+    p2.stop_micro();
+    EXPECT_EQ(lines.size(), kScreenLines);
+    std::println("File pages resident after showing the last screen: {} MB",
+                 tree.resident_file_bytes() / 1024 / 1024);
+    EXPECT_LE(tree.resident_file_bytes(), 2 * ResidentPages::kPageSize);
+
+    constexpr size_t kJumps = 1000;
+    auto p3 = base::Profiler{std::format("Show {} random screens", kJumps)};
+    for (size_t i = 0; i < kJumps; ++i) {
+        size_t first = base::rand_generator(tree.line_count() - kScreenLines);
+        tree.get_lines(first, kScreenLines, lines);
+        EXPECT_EQ(lines.line(0), base::kPerfTestLongLine.substr(0, 99));
+    }
+    p3.stop_mili();
+    std::println("File pages resident after jumping: {} MB",
+                 tree.resident_file_bytes() / 1024 / 1024);
+    EXPECT_LE(tree.resident_file_bytes(), kBudget);
+    ptrdiff_t resident_delta = resident_mb() - rss_after_open;
+    std::println("Resident delta from jumping: {} MB", resident_delta);
+    EXPECT_LE(resident_delta, static_cast<ptrdiff_t>(kBudget / 1024 / 1024) + 64);
+
+    std::remove(kLargeFileName.data());
+}
+
+}  // namespace editor
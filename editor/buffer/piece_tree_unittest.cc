@@ -1,9 +1,15 @@
+#include "base/files/file_reader.h"
 #include "base/rand_util.h"
 #include "editor/buffer/piece_tree.h"
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <fuzztest/fuzztest_core.h>
 #include <gtest/gtest.h>
+#include <mutex>
+#include <ranges>
 #include <spdlog/spdlog.h>
+#include <thread>
 #include <tuple>
 
 namespace editor {
@@ -11,6 +17,12 @@ namespace editor {
 static_assert(std::movable<PieceTree>);
 static_assert(std::copyable<PieceTree>);
 
+namespace {
+size_t piece_count(const RedBlackTree& node) {
+    return !node ? 0 : piece_count(node.left()) + 1 + piece_count(node.right());
+}
+}  // namespace
+
 TEST(PieceTreeTest, Construction) {
     using namespace std::string_literals;
     using namespace std::string_view_literals;
@@ -43,6 +55,82 @@ TEST(PieceTree, Clear) {
     EXPECT_EQ(tree.length(), 0);
 }
 
+TEST(PieceTreeTest, ConstructionFromMappedFile) {
+    constexpr std::string_view kFileName = "piece_tree_unittest.txt";
+    base::WriteFile(kFileName, "Hello world!\nThis is a line.\n");
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    ASSERT_TRUE(file->Initialize(base::FilePath{FILE_PATH_LITERAL("piece_tree_unittest.txt")}));
+    std::remove(kFileName.data());
+
+    PieceTree tree{std::move(file)};
+    EXPECT_EQ(tree.str(), "Hello world!\nThis is a line.\n");
+    EXPECT_EQ(tree.line_count(), 3);
+    EXPECT_EQ(tree.get_line_content(1), "This is a line.");
+
+    // Copies share the mapping, and edits never write to it.
+    PieceTree copy = tree;
+    tree.insert(5, ",");
+    tree.erase(0, 1);
+    EXPECT_EQ(tree.str(), "ello, world!\nThis is a line.\n");
+    EXPECT_EQ(copy.str(), "Hello world!\nThis is a line.\n");
+}
+
+// Large-file mode keeps only part of the file resident, but reads the same as a tree holding the
+// whole text.
+TEST(PieceTreeTest, LargeFileMode) {
+    constexpr std::string_view kFileName = "piece_tree_unittest_large.txt";
+    const base::FilePath kFilePath{FILE_PATH_LITERAL("piece_tree_unittest_large.txt")};
+    constexpr size_t kPageSize = ResidentPages::kPageSize;
+    constexpr size_t kBudget = 2 * kPageSize;
+    std::string block;
+    for (size_t i = 0; block.size() < 1024 * 1024; ++i) {
+        block += std::format("{} é😀 {}\n", i, std::string(i % 97, 'x'));
+    }
+    std::string text;
+    while (text.size() < 3 * kPageSize + kPageSize / 2) text += block;
+    base::WriteFile(kFileName, text);
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    ASSERT_TRUE(file->Initialize(kFilePath));
+    std::remove(kFileName.data());
+
+    PieceTree tree{std::move(file), kBudget};
+    PieceTree expected{text};
+    // One piece per page.
+    EXPECT_EQ(piece_count(tree.root()), 4);
+    EXPECT_EQ(tree.length(), expected.length());
+    EXPECT_EQ(tree.line_feed_count(), expected.line_feed_count());
+    EXPECT_EQ(tree.metrics(), expected.metrics());
+    EXPECT_EQ(tree.resident_file_bytes(), 0);
+
+    for (int i = 0; i < 200; ++i) {
+        size_t line = base::rand_int(0, static_cast<int>(expected.line_feed_count()));
+        EXPECT_EQ(tree.get_line_content_with_newline(line),
+                  expected.get_line_content_with_newline(line));
+        size_t offset = base::rand_int(0, static_cast<int>(expected.length()));
+        EXPECT_EQ(tree.line_column_at(offset), expected.line_column_at(offset));
+        EXPECT_EQ(tree.offset_to_utf16(offset), expected.offset_to_utf16(offset));
+        EXPECT_EQ(tree.substr(offset, 100), expected.substr(offset, 100));
+        EXPECT_LE(tree.resident_file_bytes(), kBudget);
+    }
+
+    // Reading to the end only brings in the last page.
+    tree.get_line_content(tree.line_feed_count() - 1);
+    EXPECT_GT(tree.resident_file_bytes(), 0);
+
+    // Compaction merges the split halves of a page back together, but never merges pages.
+    for (auto* t : {&tree, &expected}) {
+        t->insert(kPageSize - 1, "ab\ncd");
+        t->erase(kPageSize - 1, 5);
+        t->erase(2 * kPageSize + 3, 10);
+        t->insert(3 * kPageSize, "é\n");
+    }
+    tree.compact();
+    EXPECT_EQ(piece_count(tree.root()), 7);
+    // Not EXPECT_EQ, which would print the whole document.
+    EXPECT_TRUE(tree.str() == expected.str());
+    EXPECT_LE(tree.resident_file_bytes(), kBudget);
+}
+
 TEST(PieceTreeTest, CustomTest1) {
     std::string str = "The quick brown fox\njumped over the lazy dog";
     PieceTree tree{str};
@@ -972,6 +1060,610 @@ TEST(PieceTreeTest, FindTest2) {
     ASSERT_FALSE(tree.find("\x8F\x9F"));
 }
 
+// Typing fills several mod buffer chunks. Pieces must never span chunks, and text typed into an
+// earlier chunk must survive later chunks being allocated.
+TEST(PieceTreeTest, InsertAcrossModChunks) {
+    PieceTree tree{"start\nend"};
+    std::string str = tree.str();
+
+    std::string line(ModChunk::kByteCapacity / 10, 'x');
+    line.back() = '\n';
+    size_t caret = 6;
+    for (size_t i = 0; i < 50; ++i) {
+        tree.insert(caret, line);
+        str.insert(caret, line);
+        caret += line.size();
+        // Interleave some single-character typing elsewhere.
+        tree.insert(i, "ab");
+        str.insert(i, "ab");
+        caret += 2;
+    }
+    EXPECT_EQ(tree.str(), str);
+    EXPECT_EQ(tree.line_feed_count(), std::ranges::count(str, '\n'));
+    EXPECT_EQ(tree.get_line_content(tree.line_count() - 1), "end");
+}
+
+// A walker reads straight out of the mod buffer. Later appends must not invalidate it.
+TEST(PieceTreeTest, WalkerSurvivesAppends) {
+    PieceTree tree;
+    tree.insert(0, "hello world");
+    PieceTree reader = tree;
+    TreeWalker walker{reader};
+    EXPECT_EQ(walker.next(), 'h');
+
+    for (size_t i = 0; i < 10'000; ++i) {
+        tree.insert(tree.length(), "typing more text\n");
+    }
+
+    std::string rest;
+    while (!walker.exhausted()) rest.push_back(walker.next());
+    EXPECT_EQ(rest, "ello world");
+}
+
+// Typing at the caret coalesces into one undo entry. Moving elsewhere starts a new one.
+TEST(PieceTreeTest, UndoCoalescesTyping) {
+    PieceTree tree{"abc"};
+    for (size_t i = 0; i < 5; ++i) {
+        tree.insert(3 + i, "x");
+    }
+    EXPECT_EQ(tree.undo_entry_count(), 1);
+    tree.insert(0, "y");
+    EXPECT_EQ(tree.undo_entry_count(), 2);
+    EXPECT_EQ(tree.str(), "yabcxxxxx");
+
+    EXPECT_TRUE(tree.undo());
+    EXPECT_EQ(tree.str(), "abcxxxxx");
+    EXPECT_TRUE(tree.undo());
+    EXPECT_EQ(tree.str(), "abc");
+    EXPECT_FALSE(tree.undo());
+    EXPECT_TRUE(tree.redo());
+    EXPECT_EQ(tree.str(), "abcxxxxx");
+}
+
+TEST(PieceTreeTest, UndoCoalescesDeletes) {
+    PieceTree tree{"0123456789"};
+    // Backspace from the end, then forward delete at the front.
+    for (size_t i = 0; i < 3; ++i) tree.erase(9 - i, 1);
+    EXPECT_EQ(tree.undo_entry_count(), 1);
+    for (size_t i = 0; i < 3; ++i) tree.erase(0, 1);
+    EXPECT_EQ(tree.undo_entry_count(), 2);
+    EXPECT_EQ(tree.str(), "3456");
+
+    // Switching between inserting and erasing starts a new entry.
+    tree.insert(4, "a");
+    tree.erase(4, 1);
+    EXPECT_EQ(tree.undo_entry_count(), 4);
+
+    tree.undo();
+    tree.undo();
+    tree.undo();
+    EXPECT_EQ(tree.str(), "0123456");
+}
+
+TEST(PieceTreeTest, BreakUndoCoalescing) {
+    PieceTree tree;
+    tree.insert(0, "a");
+    tree.break_undo_coalescing();
+    tree.insert(1, "b");
+    EXPECT_EQ(tree.undo_entry_count(), 2);
+    tree.undo();
+    EXPECT_EQ(tree.str(), "a");
+
+    // After an undo, the next edit never joins an older entry.
+    tree.insert(1, "c");
+    EXPECT_EQ(tree.undo_entry_count(), 2);
+}
+
+TEST(PieceTreeTest, UndoTransaction) {
+    PieceTree tree{"hello world"};
+    tree.begin_transaction();
+    tree.erase(0, 5);
+    tree.begin_transaction();
+    tree.insert(0, "goodbye");
+    tree.end_transaction();
+    tree.insert(tree.length(), "!");
+    tree.end_transaction();
+    EXPECT_EQ(tree.str(), "goodbye world!");
+    EXPECT_EQ(tree.undo_entry_count(), 1);
+
+    // Typing after the transaction doesn't join it.
+    tree.insert(tree.length(), "!");
+    EXPECT_EQ(tree.undo_entry_count(), 2);
+
+    tree.undo();
+    tree.undo();
+    EXPECT_EQ(tree.str(), "hello world");
+    tree.redo();
+    EXPECT_EQ(tree.str(), "goodbye world!");
+}
+
+TEST(PieceTreeTest, UndoEntryLimit) {
+    PieceTree tree;
+    tree.set_undo_limits(3, PieceTree::kDefaultMaxUndoBytes);
+    for (size_t i = 0; i < 10; ++i) {
+        tree.insert(0, "a");
+        tree.break_undo_coalescing();
+    }
+    EXPECT_EQ(tree.undo_entry_count(), 3);
+    EXPECT_EQ(tree.undo_retained_bytes(), 3);
+
+    while (tree.undo()) {}
+    EXPECT_EQ(tree.str(), std::string(7, 'a'));
+}
+
+TEST(PieceTreeTest, UndoByteLimit) {
+    constexpr size_t kMaxBytes = 1000;
+    PieceTree tree;
+    tree.set_undo_limits(PieceTree::kDefaultMaxUndoEntries, kMaxBytes);
+    std::string word(30, 'w');
+    for (size_t i = 0; i < 1000; ++i) {
+        tree.insert(0, word);
+        tree.break_undo_coalescing();
+        ASSERT_LE(tree.undo_retained_bytes(), kMaxBytes);
+    }
+    EXPECT_EQ(tree.undo_entry_count(), kMaxBytes / word.size());
+
+    // A single entry larger than the limit is still kept.
+    tree.insert(0, std::string(kMaxBytes * 2, 'x'));
+    EXPECT_EQ(tree.undo_entry_count(), 1);
+    EXPECT_EQ(tree.undo_retained_bytes(), kMaxBytes * 2);
+}
+
+// Once history referring to a mod buffer chunk is dropped, the chunk is released.
+TEST(PieceTreeTest, UndoLimitReleasesModChunks) {
+    PieceTree tree;
+    tree.set_undo_limits(1, PieceTree::kDefaultMaxUndoBytes);
+
+    // Each line fills most of a chunk. Deleting it leaves nothing but history referring to it.
+    std::string line(ModChunk::kByteCapacity - 1, 'x');
+    for (size_t i = 0; i < 20; ++i) {
+        tree.insert(0, line);
+        tree.erase(0, line.size());
+    }
+    EXPECT_TRUE(tree.empty());
+    EXPECT_EQ(tree.undo_retained_bytes(), line.size());
+    // Only the newest chunk is reachable, plus any dropped since the last release.
+    EXPECT_LE(tree.mod_buffer_allocated_bytes(), 2 * ModChunk::kByteCapacity);
+
+    EXPECT_TRUE(tree.undo());
+    EXPECT_EQ(tree.str(), line);
+}
+
+namespace {
+std::string apply_edits_to_string(std::string str, std::span<const Edit> edits) {
+    for (const auto& edit : std::views::reverse(edits)) {
+        str.replace(edit.offset, edit.count, edit.text);
+    }
+    return str;
+}
+}  // namespace
+
+TEST(PieceTreeTest, ApplyEdits) {
+    PieceTree tree{"one two three\nfour"};
+    auto edits = std::to_array<Edit>({
+        {.offset = 0, .count = 3, .text = "1"},
+        {.offset = 4, .count = 0, .text = "and "},
+        {.offset = 8, .count = 6},
+        {.offset = 18, .count = 0, .text = "!"},
+    });
+    tree.apply_edits(edits);
+    EXPECT_EQ(tree.str(), "1 and two four!");
+    EXPECT_EQ(tree.line_feed_count(), 0);
+    EXPECT_EQ(tree.undo_entry_count(), 1);
+
+    EXPECT_TRUE(tree.undo());
+    EXPECT_EQ(tree.str(), "one two three\nfour");
+    EXPECT_TRUE(tree.redo());
+    EXPECT_EQ(tree.str(), "1 and two four!");
+
+    // Edits that change nothing don't create an undo entry.
+    tree.apply_edits(std::to_array<Edit>({{.offset = 3}, {.offset = 99}}));
+    EXPECT_EQ(tree.undo_entry_count(), 1);
+}
+
+// Covers both small batches, which are applied one by one, and large ones, which rebuild the
+// tree.
+TEST(PieceTreeTest, ApplyEditsRandomTest) {
+    for (size_t edit_count : {1, 2, 10, 100, 1000}) {
+        std::string str = base::rand_bytes_as_string(5000);
+        PieceTree tree{str};
+        // Fragment the tree first.
+        for (size_t n = 0; n < 200; ++n) {
+            size_t index = base::rand_int(0, str.length());
+            std::string text = base::rand_bytes_as_string(base::rand_int(1, 5));
+            str.insert(index, text);
+            tree.insert(index, text);
+        }
+
+        std::vector<std::string> texts;
+        std::vector<Edit> edits;
+        size_t offset = 0;
+        for (size_t n = 0; n < edit_count && offset <= str.length(); ++n) {
+            offset = base::rand_int(offset, std::min(str.length(), offset + 20));
+            size_t count = base::rand_int(0, std::min(str.length() - offset, size_t{3}));
+            // Every edit changes something: a batch of no-ops records no undo entry, and the
+            // undo below would revert the fragmenting inserts instead.
+            texts.push_back(base::rand_bytes_as_string(base::rand_int(count == 0 ? 1 : 0, 4)));
+            edits.push_back({.offset = offset, .count = count});
+            offset += count + 1;
+        }
+        for (size_t n = 0; n < edits.size(); ++n) edits[n].text = texts[n];
+
+        std::string expected = apply_edits_to_string(str, edits);
+        tree.apply_edits(edits);
+        EXPECT_EQ(tree.str(), expected);
+        EXPECT_EQ(tree.length(), expected.length());
+        EXPECT_EQ(tree.line_feed_count(), std::ranges::count(expected, '\n'));
+        EXPECT_TRUE(tree.root().satisfies_red_black_invariants());
+
+        tree.undo();
+        EXPECT_EQ(tree.str(), str);
+    }
+}
+
+TEST(PieceTreeTest, CompactMergesContiguousPieces) {
+    PieceTree tree{"hello\nworld"};
+    // Splitting a piece and deleting the inserted text leaves two contiguous halves behind.
+    tree.insert(3, "XYZ");
+    tree.erase(3, 3);
+    tree.insert(tree.length(), "!");
+    tree.insert(0, "!");
+    tree.erase(0, 1);
+    EXPECT_EQ(piece_count(tree.root()), 3);
+
+    tree.compact();
+    EXPECT_EQ(piece_count(tree.root()), 2);
+    EXPECT_EQ(tree.str(), "hello\nworld!");
+    EXPECT_EQ(tree.line_feed_count(), 1);
+    EXPECT_EQ(tree.get_line_content(1), "world!");
+    EXPECT_TRUE(tree.root().satisfies_red_black_invariants());
+
+    // Compaction doesn't touch the undo history.
+    tree.undo();
+    EXPECT_EQ(tree.str(), "!hello\nworld!");
+}
+
+TEST(PieceTreeTest, CompactRewritesFragments) {
+    std::string str = base::rand_string_with_newlines(1000, 50);
+    PieceTree tree{str};
+    for (size_t n = 0; n < 500; ++n) {
+        size_t index = base::rand_int(0, str.length());
+        std::string text = base::rand_bytes_as_string(base::rand_int(1, 5));
+        str.insert(index, text);
+        tree.insert(index, text);
+    }
+    size_t before = piece_count(tree.root());
+
+    tree.compact({.rewrite_fragments = true, .fragment_length = 64});
+    EXPECT_LT(piece_count(tree.root()), before / 4);
+    EXPECT_EQ(tree.str(), str);
+    EXPECT_EQ(tree.line_feed_count(), std::ranges::count(str, '\n'));
+    for (size_t line = 0; line < tree.line_count(); ++line) {
+        EXPECT_EQ(tree.get_line_range(line).first, tree.offset_at(line, 0));
+    }
+
+    // Editing continues as normal.
+    tree.insert(10, "abc");
+    str.insert(10, "abc");
+    EXPECT_EQ(tree.str(), str);
+}
+
+TEST(PieceTreeTest, CompactOnAnotherThread) {
+    PieceTree tree{"0123456789"};
+    for (size_t i = 0; i < 10; ++i) tree.insert(i * 2, "x");
+    std::string str = tree.str();
+
+    auto compaction = tree.begin_compaction({.rewrite_fragments = true});
+    std::thread{[&] { compaction.run(); }}.join();
+    EXPECT_TRUE(tree.finish_compaction(std::move(compaction)));
+    EXPECT_EQ(piece_count(tree.root()), 1);
+    EXPECT_EQ(tree.str(), str);
+
+    // A compaction that raced with an edit is thrown away.
+    auto stale = tree.begin_compaction({.rewrite_fragments = true});
+    tree.insert(0, "y");
+    stale.run();
+    EXPECT_FALSE(tree.finish_compaction(std::move(stale)));
+    EXPECT_EQ(tree.str(), "y" + str);
+}
+
+TEST(PieceTreeTest, GetLines) {
+    PieceTree tree{"ab\ncd\n\nef"};
+    tree.insert(5, "X\nY");
+    ASSERT_EQ(tree.str(), "ab\ncdX\nY\n\nef");
+
+    LineBlock lines;
+    tree.get_lines(1, 3, lines);
+    ASSERT_EQ(lines.size(), 3);
+    EXPECT_EQ(lines.first_line(), 1);
+    EXPECT_EQ(lines.line(0), "cdX");
+    EXPECT_EQ(lines.line_for_layout_use(0), "cdX ");
+    EXPECT_EQ(lines.offset(0), 3);
+    EXPECT_EQ(lines.line(1), "Y");
+    EXPECT_EQ(lines.offset(1), 7);
+    EXPECT_EQ(lines.line(2), "");
+    EXPECT_TRUE(lines.contains(3));
+    EXPECT_FALSE(lines.contains(4));
+
+    // Asking for more lines than there are stops at the end.
+    tree.get_lines(3, 10, lines);
+    ASSERT_EQ(lines.size(), 2);
+    EXPECT_EQ(lines.line(1), "ef");
+    EXPECT_EQ(lines.line_for_layout_use(1), "ef");
+
+    tree.get_lines(5, 1, lines);
+    EXPECT_TRUE(lines.empty());
+}
+
+TEST(PieceTreeTest, GetLinesRandomTest) {
+    std::string str = base::rand_string_with_newlines(2000, 100);
+    PieceTree tree{str};
+    for (size_t n = 0; n < 200; ++n) {
+        size_t index = base::rand_int(0, str.length());
+        std::string text = base::rand_string_with_newlines(base::rand_int(2, 10), 2);
+        str.insert(index, text);
+        tree.insert(index, text);
+    }
+
+    LineBlock lines;
+    for (size_t n = 0; n < 100; ++n) {
+        size_t first = base::rand_int(0, tree.line_count());
+        size_t count = base::rand_int(0, 30);
+        tree.get_lines(first, count, lines);
+        ASSERT_EQ(lines.size(), std::min(count, tree.line_count() - first));
+        for (size_t i = 0; i < lines.size(); ++i) {
+            EXPECT_EQ(lines.line(i), tree.get_line_content(first + i));
+            EXPECT_EQ(lines.line_for_layout_use(i),
+                      tree.get_line_content_for_layout_use(first + i));
+            EXPECT_EQ(lines.offset(i), tree.get_line_range(first + i).first);
+        }
+    }
+}
+
+TEST(PieceTreeTest, SnapshotIsUnaffectedByEdits) {
+    PieceTree tree{"hello\nworld"};
+    tree.insert(5, ", there");
+    auto snapshot = tree.snapshot();
+
+    tree.erase(0, 5);
+    tree.insert(0, "goodbye");
+    tree.undo();
+    EXPECT_EQ(snapshot->str(), "hello, there\nworld");
+    EXPECT_EQ(snapshot->get_line_content(1), "world");
+
+    // Snapshots outlive their tree.
+    tree = PieceTree{};
+    EXPECT_EQ(snapshot->str(), "hello, there\nworld");
+}
+
+// Readers walk snapshots on other threads while this thread keeps editing, taking snapshots and
+// dropping history. Meant to be run under TSan.
+TEST(PieceTreeTest, SnapshotsAreThreadSafe) {
+    constexpr size_t kReaders = 4;
+    PieceTree tree{base::rand_string_with_newlines(1000, 50)};
+    tree.set_undo_limits(20, PieceTree::kDefaultMaxUndoBytes);
+
+    std::mutex mutex;
+    std::shared_ptr<const PieceTree> latest = tree.snapshot();
+    std::atomic<bool> done = false;
+    std::atomic<size_t> reads = 0;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < kReaders; ++i) {
+        readers.emplace_back([&] {
+            LineBlock lines;
+            while (!done.load()) {
+                std::shared_ptr<const PieceTree> snapshot;
+                {
+                    std::lock_guard lock{mutex};
+                    snapshot = latest;
+                }
+                std::string str = snapshot->str();
+                EXPECT_EQ(str.size(), snapshot->length());
+                EXPECT_EQ(std::ranges::count(str, '\n'), snapshot->line_feed_count());
+
+                std::string reversed;
+                for (ReverseTreeWalker walker{*snapshot, snapshot->length()};
+                     !walker.exhausted();) {
+                    reversed.push_back(walker.next());
+                }
+                std::ranges::reverse(reversed);
+                EXPECT_EQ(reversed, str);
+
+                snapshot->get_lines(0, snapshot->line_count(), lines);
+                EXPECT_EQ(lines.size(), snapshot->line_count());
+                ++reads;
+            }
+        });
+    }
+
+    for (size_t n = 0; n < 3000 || reads.load() < kReaders; ++n) {
+        size_t offset = base::rand_int(0, tree.length());
+        switch (base::rand_int(0, 9)) {
+        case 0:
+            tree.undo();
+            break;
+        case 1:
+            tree.erase(offset, base::rand_int(1, 20));
+            break;
+        case 2:
+            if (n % 100 == 2) tree.compact({.rewrite_fragments = true});
+            break;
+        default:
+            tree.insert(offset, base::rand_string_with_newlines(base::rand_int(2, 40), 2));
+            break;
+        }
+        auto snapshot = tree.snapshot();
+        std::lock_guard lock{mutex};
+        latest = std::move(snapshot);
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+}
+
+TEST(PieceTreeTest, Utf16AndCodepointConversions) {
+    // "😀" and "𝄞" are 4 bytes and 2 UTF-16 units; "é" is 2 bytes and "€" is 3.
+    PieceTree tree{"a😀b\né€𝄞"};
+    tree.insert(5, "é");     // a😀éb
+    tree.insert(0, "𝄞\n");  // 𝄞\na😀éb
+    ASSERT_EQ(tree.str(), "𝄞\na😀éb\né€𝄞");
+    EXPECT_EQ(tree.metrics(), (TextMetrics{10, 13}));
+
+    // Offsets of each codepoint start, with their UTF-16 positions and columns.
+    struct Position {
+        size_t offset;
+        size_t utf16;
+        size_t column;
+    };
+    std::vector<Position> positions = {
+        {0, 0, 0},   {4, 2, 1},   {5, 3, 0},   {6, 4, 1},   {10, 6, 2},  {12, 7, 3},
+        {13, 8, 4},  {14, 9, 0},  {16, 10, 1}, {19, 11, 2}, {23, 13, 3},
+    };
+    for (const auto& [offset, utf16, column] : positions) {
+        EXPECT_EQ(tree.offset_to_utf16(offset), utf16) << offset;
+        EXPECT_EQ(tree.utf16_to_offset(utf16), offset) << utf16;
+        EXPECT_EQ(tree.codepoint_column_at(offset), column) << offset;
+    }
+    // Halfway through a surrogate pair.
+    EXPECT_EQ(tree.utf16_to_offset(1), 0);
+    EXPECT_EQ(tree.utf16_to_offset(5), 6);
+    EXPECT_EQ(tree.utf16_to_offset(12), 19);
+    // Past the end.
+    EXPECT_EQ(tree.offset_to_utf16(100), 13);
+    EXPECT_EQ(tree.utf16_to_offset(100), tree.length());
+}
+
+namespace {
+// A UTF-8 string together with its codepoint boundaries.
+struct Utf8Model {
+    std::string text;
+
+    std::vector<size_t> boundaries() const {
+        std::vector<size_t> result;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i == text.size() || (static_cast<uint8_t>(text[i]) & 0xC0) != 0x80) {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }
+};
+
+std::string rand_utf8(size_t codepoints) {
+    static constexpr std::string_view kTokens[] = {"a", "b", "\n", "é", "€", "😀", "𝄞"};
+    std::string result;
+    for (size_t i = 0; i < codepoints; ++i) result += kTokens[base::rand_int(0, 6)];
+    return result;
+}
+}  // namespace
+
+// Edits at random codepoint boundaries, including inside large original pieces whose metrics are
+// split through the block index, and checks every conversion against a scan of the text.
+TEST(PieceTreeTest, Utf16AndCodepointRandomTest) {
+    Utf8Model model{rand_utf8(5000)};
+    PieceTree tree{model.text};
+    for (size_t i = 0; i < 200; ++i) {
+        auto boundaries = model.boundaries();
+        size_t at = base::rand_int(0, static_cast<int>(boundaries.size()) - 1);
+        if (base::rand_int(0, 2) == 0 && at + 1 < boundaries.size()) {
+            size_t end = std::min(at + base::rand_int(1, 20), boundaries.size() - 1);
+            tree.erase(boundaries[at], boundaries[end] - boundaries[at]);
+            model.text.erase(boundaries[at], boundaries[end] - boundaries[at]);
+        } else {
+            std::string text = rand_utf8(base::rand_int(1, 10));
+            tree.insert(boundaries[at], text);
+            model.text.insert(boundaries[at], text);
+        }
+    }
+    ASSERT_EQ(tree.str(), model.text);
+
+    size_t units = 0;
+    size_t column = 0;
+    for (size_t offset : model.boundaries()) {
+        EXPECT_EQ(tree.offset_to_utf16(offset), units);
+        EXPECT_EQ(tree.utf16_to_offset(units), offset);
+        EXPECT_EQ(tree.codepoint_column_at(offset), column);
+        if (offset == model.text.size()) break;
+        auto lead = static_cast<uint8_t>(model.text[offset]);
+        units += lead >= 0xF0 ? 2 : 1;
+        column = lead == '\n' ? 0 : column + 1;
+    }
+    EXPECT_EQ(tree.metrics().utf16_units, units);
+    EXPECT_EQ(tree.metrics().codepoints, model.boundaries().size() - 1);
+
+    tree.compact({.rewrite_fragments = true});
+    EXPECT_EQ(tree.metrics().utf16_units, units);
+    EXPECT_EQ(tree.offset_to_utf16(model.text.size()), units);
+}
+
+// Lookups that start from the previous lookup's finger agree with lookups from the root, across
+// edits, undo and compaction.
+TEST(PieceTreeTest, LookupFingerRandomTest) {
+    PieceTree tree{base::rand_string_with_newlines(2000, 100)};
+    PieceTree reference = tree;
+    reference.set_lookup_finger_enabled(false);
+
+    for (size_t i = 0; i < 300; ++i) {
+        int action = base::rand_int(0, 9);
+        if (action == 0) {
+            tree.undo();
+            reference.undo();
+        } else if (action == 1) {
+            tree.compact({.rewrite_fragments = true});
+            reference.compact({.rewrite_fragments = true});
+        } else if (action < 5) {
+            size_t offset = base::rand_int(0, tree.length());
+            std::string text = base::rand_string_with_newlines(base::rand_int(3, 20), 3);
+            tree.insert(offset, text);
+            reference.insert(offset, text);
+        } else if (action < 7) {
+            size_t offset = base::rand_int(0, tree.length());
+            size_t count = base::rand_int(1, 20);
+            tree.erase(offset, count);
+            reference.erase(offset, count);
+        }
+        ASSERT_EQ(tree.str(), reference.str());
+
+        // A burst of nearby lookups, as a frame around the caret would make.
+        size_t offset = base::rand_int(0, tree.length());
+        for (size_t j = 0; j < 10; ++j) {
+            offset = std::min(offset + base::rand_int(0, 30), tree.length());
+            size_t line = tree.line_at(offset);
+            ASSERT_EQ(line, reference.line_at(offset));
+            auto cursor = tree.line_column_at(offset);
+            ASSERT_EQ(cursor, reference.line_column_at(offset));
+            ASSERT_EQ(tree.offset_at(line, cursor.column), offset);
+            auto range = tree.get_line_range_with_newline(line);
+            auto expected = reference.get_line_range_with_newline(line);
+            ASSERT_EQ(range.first, expected.first);
+            ASSERT_EQ(range.last, expected.last);
+            ASSERT_EQ(tree.get_line_content(line), reference.get_line_content(line));
+        }
+    }
+    EXPECT_LT(tree.lookup_stats().nodes_per_lookup(), reference.lookup_stats().nodes_per_lookup());
+}
+
+TEST(PieceTreeTest, LookupFingerStats) {
+    PieceTree tree{"a\nb\nc\n"};
+    for (size_t i = 0; i < 100; ++i) {
+        tree.insert(base::rand_int(0, tree.length()), "x\ny");
+    }
+    // The first piece is at the bottom of the left spine.
+    tree.reset_lookup_stats();
+    EXPECT_EQ(tree.line_at(1), 0);
+    EXPECT_EQ(tree.lookup_stats().lookups, 1);
+    EXPECT_GT(tree.lookup_stats().nodes_visited, 1);
+
+    // The same lookup again only needs the node it ended on.
+    tree.reset_lookup_stats();
+    EXPECT_EQ(tree.line_at(1), 0);
+    EXPECT_EQ(tree.lookup_stats().nodes_visited, 1);
+
+    // Snapshots don't keep a finger, so they can be read from several threads.
+    auto snapshot = tree.snapshot();
+    EXPECT_EQ(snapshot->line_at(1), 0);
+    EXPECT_EQ(snapshot->lookup_stats().lookups, 0);
+}
+
 // Property-based (FuzzTest) versions of the differential `*RandomTest` cases
 // above: they hold a plain `std::string` as the reference model, apply the same
 // operations to it and to the `PieceTree`, and assert the two stay in sync. The
@@ -1,11 +1,16 @@
 #include "base/check.h"
+#include "base/compiler_specific.h"
 #include "editor/buffer/red_black_tree.h"
+#include <bit>
+#include <cstddef>
+#include <new>
 
 namespace editor {
 
 using Color = RedBlackTree::Color;
 
-RedBlackTree::RedBlackTree(Color c,
+RedBlackTree::RedBlackTree(NodeArena& arena,
+                           Color c,
                            const RedBlackTree& left,
                            const Piece& p,
                            const RedBlackTree& right) {
@@ -15,8 +20,18 @@ RedBlackTree::RedBlackTree(Color c,
         .left_lf_count = left.line_feed_count(),
         .subtree_length = left.length() + p.length + right.length(),
         .subtree_lf_count = left.line_feed_count() + p.lf_count + right.line_feed_count(),
+        .left_metrics = left.metrics(),
+        .subtree_metrics = left.metrics() + p.metrics + right.metrics(),
     };
-    node_ = std::make_shared<Node>(c, left.node_, d, right.node_);
+    node_ = new (arena.allocate()) Node(&arena, c, left, d, right);
+}
+
+void RedBlackTree::NodeTraits::Destruct(const Node* node) {
+    // Hold onto the arena: destroying the node releases its children, which may in turn return
+    // themselves to the same arena.
+    NodeArena* arena = node->arena;
+    node->~Node();
+    arena->deallocate(node);
 }
 
 // =================================================================================================
@@ -24,24 +39,51 @@ RedBlackTree::RedBlackTree(Color c,
 // =================================================================================================
 
 namespace {
-RedBlackTree ins(const RedBlackTree& node, const Piece& p, size_t at, size_t total_offset) {
-    if (!node) return {Color::Red, {}, p, {}};
+RedBlackTree ins(NodeArena& arena,
+                 const RedBlackTree& node,
+                 const Piece& p,
+                 size_t at,
+                 size_t total_offset) {
+    if (!node) return {arena, Color::Red, {}, p, {}};
 
     size_t split = total_offset + node.left_length() + node.piece().length;
     if (at < split) {
-        auto new_left = ins(node.left(), p, at, total_offset);
-        RedBlackTree rebuilt = {node.color(), new_left, node.piece(), node.right()};
+        auto new_left = ins(arena, node.left(), p, at, total_offset);
+        RedBlackTree rebuilt = {arena, node.color(), new_left, node.piece(), node.right()};
         return rebuilt.balance();
     } else {
-        auto new_right = ins(node.right(), p, at, split);
-        RedBlackTree rebuilt = {node.color(), node.left(), node.piece(), new_right};
+        auto new_right = ins(arena, node.right(), p, at, split);
+        RedBlackTree rebuilt = {arena, node.color(), node.left(), node.piece(), new_right};
         return rebuilt.balance();
     }
 }
 }  // namespace
 
-RedBlackTree RedBlackTree::insert(size_t at, const Piece& p) const {
-    return ins(*this, p, at, 0).blacken();
+RedBlackTree RedBlackTree::insert(NodeArena& arena, size_t at, const Piece& p) const {
+    return ins(arena, *this, p, at, 0).blacken();
+}
+
+namespace {
+// Splitting at the middle keeps sibling subtrees within one node of each other, so every empty
+// leaf sits at depth `red_depth` or `red_depth + 1`. Coloring the nodes at `red_depth` red (and
+// everything above black) gives all paths the same black height.
+RedBlackTree build_range(NodeArena& arena,
+                         std::span<const Piece> pieces,
+                         size_t depth,
+                         size_t red_depth) {
+    if (pieces.empty()) return {};
+    size_t mid = pieces.size() / 2;
+    auto left = build_range(arena, pieces.first(mid), depth + 1, red_depth);
+    auto right = build_range(arena, pieces.subspan(mid + 1), depth + 1, red_depth);
+    auto color = depth == red_depth && depth > 0 ? Color::Red : Color::Black;
+    return {arena, color, left, pieces[mid], right};
+}
+}  // namespace
+
+RedBlackTree RedBlackTree::build(NodeArena& arena, std::span<const Piece> pieces) {
+    // The deepest level of a tree with n nodes split this way is floor(log2(n)).
+    size_t red_depth = pieces.empty() ? 0 : std::bit_width(pieces.size()) - 1;
+    return build_range(arena, pieces, 0, red_depth);
 }
 
 // See okasaki_balance.png (Okasaki, 1999, Fig. 1) for the balance cases.
@@ -53,22 +95,32 @@ RedBlackTree RedBlackTree::balance() const {
     const auto& p = piece();
 
     if (l.double_red_left()) {
-        return {Color::Red, l.left().blacken(), l.piece(), {Color::Black, l.right(), p, r}};
+        return {arena(),
+                Color::Red,
+                l.left().blacken(),
+                l.piece(),
+                {arena(), Color::Black, l.right(), p, r}};
     }
     if (l.double_red_right()) {
-        return {Color::Red,
-                {Color::Black, l.left(), l.piece(), l.right().left()},
+        return {arena(),
+                Color::Red,
+                {arena(), Color::Black, l.left(), l.piece(), l.right().left()},
                 l.right().piece(),
-                {Color::Black, l.right().right(), p, r}};
+                {arena(), Color::Black, l.right().right(), p, r}};
     }
     if (r.double_red_left()) {
-        return {Color::Red,
-                {Color::Black, l, p, r.left().left()},
+        return {arena(),
+                Color::Red,
+                {arena(), Color::Black, l, p, r.left().left()},
                 r.left().piece(),
-                {Color::Black, r.left().right(), r.piece(), r.right()}};
+                {arena(), Color::Black, r.left().right(), r.piece(), r.right()}};
     }
     if (r.double_red_right()) {
-        return {Color::Red, {Color::Black, l, p, r.left()}, r.piece(), r.right().blacken()};
+        return {arena(),
+                Color::Red,
+                {arena(), Color::Black, l, p, r.left()},
+                r.piece(),
+                r.right().blacken()};
     }
     return *this;
 }
@@ -83,36 +135,39 @@ RedBlackTree fuse(const RedBlackTree& left, const RedBlackTree& right) {
     // case: (None, r)
     if (!left) return right;
     if (!right) return left;
+    auto& arena = left.arena();
     // match: (left.color, right.color)
     // case: (B, R)
     if (left.is_black() && right.is_red()) {
-        return {Color::Red, fuse(left, right.left()), right.piece(), right.right()};
+        return {arena, Color::Red, fuse(left, right.left()), right.piece(), right.right()};
     }
     // case: (R, B)
     if (left.is_red() && right.is_black()) {
-        return {Color::Red, left.left(), left.piece(), fuse(left.right(), right)};
+        return {arena, Color::Red, left.left(), left.piece(), fuse(left.right(), right)};
     }
     // case: (R, R)
     if (left.is_red() && right.is_red()) {
         auto fused = fuse(left.right(), right.left());
         if (fused.is_red()) {
-            RedBlackTree new_left = {Color::Red, left.left(), left.piece(), fused.left()};
-            RedBlackTree new_right = {Color::Red, fused.right(), right.piece(), right.right()};
-            return {Color::Red, new_left, fused.piece(), new_right};
+            RedBlackTree new_left = {arena, Color::Red, left.left(), left.piece(), fused.left()};
+            RedBlackTree new_right = {arena, Color::Red, fused.right(), right.piece(),
+                                      right.right()};
+            return {arena, Color::Red, new_left, fused.piece(), new_right};
         }
-        RedBlackTree new_right = {Color::Red, fused, right.piece(), right.right()};
-        return {Color::Red, left.left(), left.piece(), new_right};
+        RedBlackTree new_right = {arena, Color::Red, fused, right.piece(), right.right()};
+        return {arena, Color::Red, left.left(), left.piece(), new_right};
     }
     // case: (B, B)
     DCHECK(left.is_black() && right.is_black());
     auto fused = fuse(left.right(), right.left());
     if (fused.is_red()) {
-        RedBlackTree new_left = {Color::Black, left.left(), left.piece(), fused.left()};
-        RedBlackTree new_right = {Color::Black, fused.right(), right.piece(), right.right()};
-        return {Color::Red, new_left, fused.piece(), new_right};
+        RedBlackTree new_left = {arena, Color::Black, left.left(), left.piece(), fused.left()};
+        RedBlackTree new_right = {arena, Color::Black, fused.right(), right.piece(),
+                                  right.right()};
+        return {arena, Color::Red, new_left, fused.piece(), new_right};
     }
-    RedBlackTree new_right = {Color::Black, fused, right.piece(), right.right()};
-    RedBlackTree new_node = {Color::Red, left.left(), left.piece(), new_right};
+    RedBlackTree new_right = {arena, Color::Black, fused, right.piece(), right.right()};
+    RedBlackTree new_node = {arena, Color::Red, left.left(), left.piece(), new_right};
     return new_node.balance_left();
 }
 
@@ -135,7 +190,7 @@ RedBlackTree RedBlackTree::flip_children_if_both_red() const {
     DCHECK(is_black());
     // Both children are red.
     if (left().is_red() && right().is_red()) {
-        return {Color::Red, left().blacken(), piece(), right().blacken()};
+        return {arena(), Color::Red, left().blacken(), piece(), right().blacken()};
     }
     return balance();
 }
@@ -144,24 +199,25 @@ RedBlackTree RedBlackTree::balance_left() const {
     // match: (color_l, color_r, color_r_l)
     // case: (Some(R), ..)
     if (left() && left().is_red()) {
-        return {Color::Red, left().blacken(), piece(), right()};
+        return {arena(), Color::Red, left().blacken(), piece(), right()};
     }
     // case: (_, Some(B), _)
     if (right() && right().is_black()) {
-        RedBlackTree new_left = {Color::Black, left(), piece(), right().redden()};
+        RedBlackTree new_left = {arena(), Color::Black, left(), piece(), right().redden()};
         return new_left.flip_children_if_both_red();
     }
     // case: (_, Some(R), Some(B))
     if (right() && right().is_red() && right().left() && right().left().is_black()) {
         RedBlackTree unbalanced_new_right = {
+            arena(),
             Color::Black,
             right().left().right(),
             right().piece(),
             right().right().redden(),
         };
         auto new_right = unbalanced_new_right.flip_children_if_both_red();
-        RedBlackTree new_left = {Color::Black, left(), piece(), right().left().left()};
-        return {Color::Red, new_left, right().left().piece(), new_right};
+        RedBlackTree new_left = {arena(), Color::Black, left(), piece(), right().left().left()};
+        return {arena(), Color::Red, new_left, right().left().piece(), new_right};
     }
     NOTREACHED();
 }
@@ -170,16 +226,17 @@ RedBlackTree RedBlackTree::balance_right() const {
     // match: (color_l, color_l_r, color_r)
     // case: (.., Some(R))
     if (right() && right().is_red()) {
-        return {Color::Red, left(), piece(), right().blacken()};
+        return {arena(), Color::Red, left(), piece(), right().blacken()};
     }
     // case: (Some(B), ..)
     if (left() && left().is_black()) {
-        RedBlackTree new_right = {Color::Black, left().redden(), piece(), right()};
+        RedBlackTree new_right = {arena(), Color::Black, left().redden(), piece(), right()};
         return new_right.flip_children_if_both_red();
     }
     // case: (Some(R), Some(B), _)
     if (left() && left().is_red() && left().right() && left().right().is_black()) {
         RedBlackTree unbalanced_new_left = {
+            arena(),
             Color::Black,
             // Note: Because 'left' is red, it must have a left child.
             left().left().redden(),
@@ -187,15 +244,15 @@ RedBlackTree RedBlackTree::balance_right() const {
             left().right().left(),
         };
         auto new_left = unbalanced_new_left.flip_children_if_both_red();
-        RedBlackTree new_right = {Color::Black, left().right().right(), piece(), right()};
-        return {Color::Red, new_left, left().right().piece(), new_right};
+        RedBlackTree new_right = {arena(), Color::Black, left().right().right(), piece(), right()};
+        return {arena(), Color::Red, new_left, left().right().piece(), new_right};
     }
     NOTREACHED();
 }
 
 RedBlackTree RedBlackTree::remove_left(size_t at, size_t total) const {
     auto new_left = rem(left(), at, total);
-    RedBlackTree new_node = {Color::Red, new_left, piece(), right()};
+    RedBlackTree new_node = {arena(), Color::Red, new_left, piece(), right()};
     // In this case, the root was a red node and must've had at least two children.
     if (left() && left().is_black()) {
         return new_node.balance_left();
@@ -205,7 +262,7 @@ RedBlackTree RedBlackTree::remove_left(size_t at, size_t total) const {
 
 RedBlackTree RedBlackTree::remove_right(size_t at, size_t total) const {
     auto new_right = rem(right(), at, total + left_length() + piece().length);
-    RedBlackTree new_node = {Color::Red, left(), piece(), new_right};
+    RedBlackTree new_node = {arena(), Color::Red, left(), piece(), new_right};
     // In this case, the root was a red node and must've had at least two children.
     if (right() && right().is_black()) {
         return new_node.balance_right();
@@ -213,6 +270,54 @@ RedBlackTree RedBlackTree::remove_right(size_t at, size_t total) const {
     return new_node;
 }
 
+// =================================================================================================
+// Node allocation
+// =================================================================================================
+
+union NodeArena::Slot {
+    Slot* next;
+    alignas(RedBlackTree::Node) std::byte storage[sizeof(RedBlackTree::Node)];
+};
+
+NodeArena::~NodeArena() {
+    DCHECK_EQ(live_nodes(), size_t{0});
+    for (Slot* slab : slabs_) delete[] slab;
+}
+
+void* NodeArena::allocate() {
+    if (!free_list_) {
+        // Taking the whole list at once means the list is never popped concurrently, so there is
+        // no ABA problem.
+        free_list_ = freed_list_.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (!free_list_) {
+        Slot* slab = new Slot[kSlabSize];
+        slabs_.push_back(slab);
+        for (size_t i = 0; i < kSlabSize; ++i) {
+            UNSAFE_TODO(slab[i]).next = free_list_;
+            free_list_ = UNSAFE_TODO(&slab[i]);
+        }
+    }
+    Slot* slot = free_list_;
+    free_list_ = slot->next;
+    // Live nodes keep the arena alive through a single reference, taken by the first of them.
+    // This saves a second atomic operation on every allocation. The allocating thread holds its
+    // own reference to the arena (or to one of its nodes), so a concurrent drop to zero cannot
+    // destroy it in between.
+    if (live_nodes_.fetch_add(1, std::memory_order_relaxed) == 0) AddRef();
+    return slot->storage;
+}
+
+void NodeArena::deallocate(const void* p) {
+    Slot* slot = reinterpret_cast<Slot*>(const_cast<void*>(p));
+    slot->next = freed_list_.load(std::memory_order_relaxed);
+    while (!freed_list_.compare_exchange_weak(slot->next, slot, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+    }
+    // This may destroy the arena, so it must come last.
+    if (live_nodes_.fetch_sub(1, std::memory_order_acq_rel) == 1) Release();
+}
+
 // =================================================================================================
 // Debugging
 // =================================================================================================
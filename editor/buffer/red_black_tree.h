@@ -1,27 +1,30 @@
 #pragma once
 
 #include "base/check.h"
-#include <memory>
+#include "base/memory/ref_counted.h"
+#include "editor/buffer/text_buffer.h"
+#include "editor/buffer/text_metrics.h"
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <vector>
 
 namespace editor {
 
-struct BufferCursor {
-    size_t line{};    // Relative line in the current buffer.
-    size_t column{};  // Column into the current line.
-
-    bool operator==(const BufferCursor&) const = default;
-};
-
 enum class BufferType { Original, Mod };
 
 struct Piece {
     BufferType type{};
+    size_t chunk{};  // Index of the mod buffer chunk holding this piece. Unused for `Original`.
     BufferCursor first{};
     BufferCursor last{};
     size_t length{};
     size_t lf_count{};
+    TextMetrics metrics{};  // Codepoints and UTF-16 code units in the piece.
 };
 
+class NodeArena;
+
 class RedBlackTree {
 public:
     // TODO: Should we make `Color`/`color()` private? We already expose `is_red()`/`is_black()`
@@ -30,25 +33,35 @@ public:
     enum class Color { Red, Black };
 
     RedBlackTree() = default;
-    RedBlackTree(Color c, const RedBlackTree& left, const Piece& p, const RedBlackTree& right);
+    RedBlackTree(NodeArena& arena,
+                 Color c,
+                 const RedBlackTree& left,
+                 const Piece& p,
+                 const RedBlackTree& right);
 
     // Queries.
     explicit operator bool() const { return static_cast<bool>(node_); }
-    size_t length() const { return !node_ ? 0 : node_->data.subtree_length; }
-    size_t line_feed_count() const { return !node_ ? 0 : node_->data.subtree_lf_count; }
-    size_t left_length() const { return !node_ ? 0 : node_->data.left_length; }
-    size_t left_line_feed_count() const { return !node_ ? 0 : node_->data.left_lf_count; }
-    // clang-format off
-    const Piece& piece() const { DCHECK(node_); return node_->data.piece; }
+    size_t length() const;
+    size_t line_feed_count() const;
+    size_t left_length() const;
+    size_t left_line_feed_count() const;
+    TextMetrics metrics() const;
+    TextMetrics left_metrics() const;
+    const Piece& piece() const;
     // TODO: See above comment under `Color`.
-    Color color() const { DCHECK(node_); return node_->color; }
-    RedBlackTree left() const { DCHECK(node_); return {node_->left}; }
-    RedBlackTree right() const { DCHECK(node_); return {node_->right}; }
-    // clang-format on
+    Color color() const;
+    // Children are returned by reference so walking the tree does not touch reference counts.
+    const RedBlackTree& left() const;
+    const RedBlackTree& right() const;
+    NodeArena& arena() const;
 
     // Mutators.
-    RedBlackTree insert(size_t at, const Piece& p) const;
+    // New nodes are allocated from `arena`. Removal and rebalancing reuse the arena of the nodes
+    // they replace.
+    RedBlackTree insert(NodeArena& arena, size_t at, const Piece& p) const;
     RedBlackTree remove(size_t at) const;
+    // Builds a balanced tree holding `pieces` in order, in linear time.
+    static RedBlackTree build(NodeArena& arena, std::span<const Piece> pieces);
 
     // Helpers.
     bool operator==(const RedBlackTree&) const = default;
@@ -56,12 +69,12 @@ public:
     // TODO: Organize and test these.
     // Null nodes are black.
     bool empty() const { return !node_; }
-    bool is_black() const { return !node_ || node_->color == Color::Black; }
-    bool is_red() const { return node_ && node_->color == Color::Red; }
+    bool is_black() const;
+    bool is_red() const;
     bool double_red_left() const { return is_red() && left().is_red(); }
     bool double_red_right() const { return is_red() && right().is_red(); }
-    RedBlackTree blacken() const { return {Color::Black, left(), piece(), right()}; }
-    RedBlackTree redden() const { return {Color::Red, left(), piece(), right()}; }
+    RedBlackTree blacken() const { return {arena(), Color::Black, left(), piece(), right()}; }
+    RedBlackTree redden() const { return {arena(), Color::Red, left(), piece(), right()}; }
 
     // Insertion.
     RedBlackTree balance() const;
@@ -77,8 +90,10 @@ public:
     bool satisfies_red_black_invariants() const;
 
 private:
+    friend class NodeArena;
+
     struct Node;
-    using NodePtr = std::shared_ptr<const Node>;
+    using NodePtr = scoped_refptr<const Node>;
 
     struct NodeData {
         Piece piece{};
@@ -86,13 +101,13 @@ private:
         size_t left_lf_count{};
         size_t subtree_length{};
         size_t subtree_lf_count{};
+        TextMetrics left_metrics{};
+        TextMetrics subtree_metrics{};
     };
 
-    struct Node {
-        Color color;
-        NodePtr left;
-        NodeData data;
-        NodePtr right;
+    // Nodes are returned to their arena instead of being deleted.
+    struct NodeTraits {
+        static void Destruct(const Node* node);
     };
 
     RedBlackTree(const NodePtr& node) : node_(node) {}
@@ -100,4 +115,89 @@ private:
     NodePtr node_;
 };
 
+// Trees are shared with other threads through snapshots, which copy and drop node handles
+// while the owning thread keeps editing. The count must be atomic.
+struct RedBlackTree::Node : public base::RefCountedThreadSafe<Node, NodeTraits> {
+    Node(NodeArena* arena,
+         Color color,
+         RedBlackTree left,
+         const NodeData& data,
+         RedBlackTree right)
+        : arena(arena),
+          color(color),
+          left(std::move(left)),
+          data(data),
+          right(std::move(right)) {}
+
+    NodeArena* arena;
+    Color color;
+    RedBlackTree left;
+    NodeData data;
+    RedBlackTree right;
+};
+
+// clang-format off
+inline size_t RedBlackTree::length() const { return !node_ ? 0 : node_->data.subtree_length; }
+inline size_t RedBlackTree::line_feed_count() const {
+    return !node_ ? 0 : node_->data.subtree_lf_count;
+}
+inline size_t RedBlackTree::left_length() const { return !node_ ? 0 : node_->data.left_length; }
+inline size_t RedBlackTree::left_line_feed_count() const {
+    return !node_ ? 0 : node_->data.left_lf_count;
+}
+inline TextMetrics RedBlackTree::metrics() const {
+    return !node_ ? TextMetrics{} : node_->data.subtree_metrics;
+}
+inline TextMetrics RedBlackTree::left_metrics() const {
+    return !node_ ? TextMetrics{} : node_->data.left_metrics;
+}
+inline const Piece& RedBlackTree::piece() const { DCHECK(node_); return node_->data.piece; }
+inline RedBlackTree::Color RedBlackTree::color() const { DCHECK(node_); return node_->color; }
+inline const RedBlackTree& RedBlackTree::left() const { DCHECK(node_); return node_->left; }
+inline const RedBlackTree& RedBlackTree::right() const { DCHECK(node_); return node_->right; }
+inline NodeArena& RedBlackTree::arena() const { DCHECK(node_); return *node_->arena; }
+inline bool RedBlackTree::is_black() const { return !node_ || node_->color == Color::Black; }
+inline bool RedBlackTree::is_red() const { return node_ && node_->color == Color::Red; }
+// clang-format on
+
+// A slab allocator for `RedBlackTree` nodes. Nodes are carved out of fixed-size slabs and
+// recycled through a free list, so building a new path costs no heap allocations once the arena
+// has warmed up.
+//
+// Live nodes collectively hold one reference to their arena, so the arena outlives any tree (or
+// copy of a tree) that was allocated from it.
+//
+// Only one thread may allocate at a time (the one editing the tree), but nodes may be freed from
+// any thread. Frees go onto a lock-free list that the allocating thread takes over in one step
+// whenever its own list runs dry.
+class NodeArena : public base::RefCountedThreadSafe<NodeArena> {
+public:
+    NodeArena() = default;
+
+    // Number of nodes carved out of each slab.
+    static constexpr size_t kSlabSize = 512;
+
+    // Debug use.
+    size_t slab_count() const { return slabs_.size(); }
+    size_t live_nodes() const { return live_nodes_.load(std::memory_order_relaxed); }
+
+private:
+    friend class base::RefCountedThreadSafe<NodeArena>;
+    friend class RedBlackTree;
+
+    ~NodeArena();
+
+    union Slot;
+
+    void* allocate();
+    void deallocate(const void* p);
+
+    // Only touched by the allocating thread.
+    std::vector<Slot*> slabs_;
+    Slot* free_list_ = nullptr;
+    // Freed slots waiting to be taken over by the allocating thread.
+    std::atomic<Slot*> freed_list_ = nullptr;
+    std::atomic<size_t> live_nodes_ = 0;
+};
+
 }  // namespace editor
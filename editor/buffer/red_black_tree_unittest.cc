@@ -1,5 +1,6 @@
 #include "editor/buffer/red_black_tree.h"
 #include <gtest/gtest.h>
+#include <vector>
 
 namespace editor {
 
@@ -8,6 +9,12 @@ using Color = RedBlackTree::Color;
 
 namespace {
 
+// Trees built here are small and short-lived, so every test shares one arena.
+NodeArena& arena() {
+    static scoped_refptr<NodeArena> arena = base::MakeRefCounted<NodeArena>();
+    return *arena;
+}
+
 bool tree_shape_equal(const RedBlackTree& a, const RedBlackTree& b) {
     if (!a && !b) return true;
     if (!a || !b) return false;
@@ -23,12 +30,19 @@ testing::AssertionResult assert_tree_shape_equal(const char* a_expr,
 }
 #define EXPECT_TREE_EQ(a, b) EXPECT_PRED_FORMAT2(assert_tree_shape_equal, a, b)
 
-Tree B(const Tree& L, const Tree& R) { return {Color::Black, L, {}, R}; }
-Tree R(const Tree& L, const Tree& R) { return {Color::Red, L, {}, R}; }
-Tree BL() { return {Color::Black, {}, {}, {}}; }
-Tree RL() { return {Color::Red, {}, {}, {}}; }
+Tree B(const Tree& L, const Tree& R) { return {arena(), Color::Black, L, {}, R}; }
+Tree R(const Tree& L, const Tree& R) { return {arena(), Color::Red, L, {}, R}; }
+Tree BL() { return {arena(), Color::Black, {}, {}, {}}; }
+Tree RL() { return {arena(), Color::Red, {}, {}, {}}; }
 Tree NIL() { return {}; }
 
+void collect_lengths(const Tree& node, std::vector<size_t>& lengths) {
+    if (!node) return;
+    collect_lengths(node.left(), lengths);
+    lengths.push_back(node.piece().length);
+    collect_lengths(node.right(), lengths);
+}
+
 }  // namespace
 
 TEST(RedBlackTreeTest, Constructor) {
@@ -38,7 +52,7 @@ TEST(RedBlackTreeTest, Constructor) {
     EXPECT_EQ(t1.length(), 0);
     EXPECT_EQ(t1.line_feed_count(), 0);
 
-    Tree t2 = {Color::Red, {}, {.length = 10, .lf_count = 5}, {}};
+    Tree t2 = {arena(), Color::Red, {}, {.length = 10, .lf_count = 5}, {}};
     EXPECT_TRUE(t2);
     EXPECT_TRUE(t2.is_red());
     EXPECT_FALSE(t2.left());
@@ -104,17 +118,47 @@ TEST(RedBlackTreeTest, Balance) {
     }
 }
 
+TEST(RedBlackTreeTest, NodeArenaRecyclesNodes) {
+    auto arena = base::MakeRefCounted<NodeArena>();
+    {
+        Tree t;
+        for (size_t i = 0; i < 1000; ++i) t = t.insert(*arena, i, {.length = 1});
+        EXPECT_EQ(t.length(), 1000);
+        EXPECT_TRUE(t.satisfies_red_black_invariants());
+        EXPECT_GT(arena->live_nodes(), 0);
+    }
+    EXPECT_EQ(arena->live_nodes(), 0);
+
+    // Freed nodes are reused before any new slab is allocated.
+    size_t slabs = arena->slab_count();
+    Tree t;
+    for (size_t i = 0; i < 1000; ++i) t = t.insert(*arena, i, {.length = 1});
+    EXPECT_EQ(arena->slab_count(), slabs);
+}
+
+TEST(RedBlackTreeTest, NodesKeepArenaAlive) {
+    Tree t;
+    {
+        auto arena = base::MakeRefCounted<NodeArena>();
+        t = t.insert(*arena, 0, {.length = 5});
+    }
+    t = t.insert(t.arena(), 5, {.length = 5});
+    t = t.remove(0);
+    EXPECT_EQ(t.length(), 5);
+    EXPECT_EQ(t.arena().live_nodes(), 1);
+}
+
 // TEST(RedBlackTreeTest, Insert) {
 //     Tree t;
-//     t = t.insert(0, P(5, 2));
+//     t = t.insert(arena(), 0, P(5, 2));
 //     EXPECT_EQ(t.length(), 5);
 //     EXPECT_EQ(t.line_feed_count(), 2);
 
-//     t = t.insert(0, P(10, 0));
+//     t = t.insert(arena(), 0, P(10, 0));
 //     EXPECT_EQ(t.length(), 15);
 //     EXPECT_EQ(t.line_feed_count(), 2);
 
-//     t = t.insert(10, P(1, 1));
+//     t = t.insert(arena(), 10, P(1, 1));
 //     EXPECT_EQ(t.length(), 16);
 //     EXPECT_EQ(t.line_feed_count(), 3);
 // }
@@ -128,7 +172,7 @@ TEST(RedBlackTreeTest, Balance) {
 //         size_t at = base::rand_generator(total_len + 1);
 //         size_t len = base::rand_int(1, 100);
 //         size_t lf = base::rand_generator(len);
-//         t = t.insert(at, P(len, lf));
+//         t = t.insert(arena(), at, P(len, lf));
 
 //         total_len += len;
 //         total_lf += lf;
@@ -138,4 +182,28 @@ TEST(RedBlackTreeTest, Balance) {
 //     EXPECT_EQ(t.line_feed_count(), total_lf);
 // }
 
+TEST(RedBlackTreeTest, BuildIsBalancedAndInOrder) {
+    for (size_t n = 0; n <= 130; ++n) {
+        std::vector<Piece> pieces;
+        for (size_t i = 0; i < n; ++i) {
+            pieces.push_back({.length = i + 1, .lf_count = i % 2});
+        }
+        auto tree = Tree::build(arena(), pieces);
+        EXPECT_TRUE(tree.satisfies_red_black_invariants()) << n;
+        EXPECT_TRUE(tree.is_black()) << n;
+        EXPECT_EQ(tree.length(), n * (n + 1) / 2);
+        EXPECT_EQ(tree.line_feed_count(), n / 2);
+
+        // Pieces come back out in order.
+        std::vector<size_t> lengths;
+        collect_lengths(tree, lengths);
+        ASSERT_EQ(lengths.size(), n);
+        for (size_t i = 0; i < n; ++i) EXPECT_EQ(lengths[i], i + 1);
+
+        // The result is an ordinary tree that can be edited further.
+        auto inserted = tree.insert(arena(), 0, {.length = 1});
+        EXPECT_TRUE(inserted.satisfies_red_black_invariants()) << n;
+    }
+}
+
 }  // namespace editor
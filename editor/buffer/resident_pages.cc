@@ -0,0 +1,63 @@
+#include "editor/buffer/resident_pages.h"
+#include <algorithm>
+
+namespace editor {
+
+ResidentPages::ResidentPages(const base::MemoryMappedFile& file, size_t budget)
+    : file_(file),
+      budget_pages_(std::max<size_t>((budget + kPageSize - 1) / kPageSize, 2)),
+      last_touched_((file.length() + kPageSize - 1) / kPageSize) {}
+
+void ResidentPages::touch(size_t offset, size_t length) const {
+    if (offset >= file_.length()) return;
+    size_t first = offset / kPageSize;
+    size_t last = (std::min(offset + length, file_.length()) - 1) / kPageSize;
+    if (length == 0) last = first;
+
+    std::lock_guard lock{mutex_};
+    for (size_t page = first; page <= last; ++page) {
+        if (last_touched_[page] == 0) ++resident_pages_;
+        last_touched_[page] = ++clock_;
+    }
+    // Pages are large and few, so a scan for the oldest is cheaper than keeping an ordered list up
+    // to date on every touch.
+    while (resident_pages_ > budget_pages_) {
+        size_t oldest = 0;
+        uint64_t oldest_time = UINT64_MAX;
+        for (size_t page = 0; page < last_touched_.size(); ++page) {
+            if (last_touched_[page] != 0 && last_touched_[page] < oldest_time) {
+                oldest = page;
+                oldest_time = last_touched_[page];
+            }
+        }
+        evict_page(oldest);
+    }
+}
+
+void ResidentPages::evict(size_t offset, size_t length) const {
+    if (offset >= file_.length() || length == 0) return;
+    size_t first = offset / kPageSize;
+    size_t last = (std::min(offset + length, file_.length()) - 1) / kPageSize;
+
+    std::lock_guard lock{mutex_};
+    for (size_t page = first; page <= last; ++page) evict_page(page);
+}
+
+size_t ResidentPages::resident_bytes() const {
+    std::lock_guard lock{mutex_};
+    return resident_pages_ * kPageSize;
+}
+
+bool ResidentPages::is_resident(size_t offset) const {
+    if (offset >= file_.length()) return false;
+    std::lock_guard lock{mutex_};
+    return last_touched_[offset / kPageSize] != 0;
+}
+
+void ResidentPages::evict_page(size_t page) const {
+    if (last_touched_[page] != 0) --resident_pages_;
+    last_touched_[page] = 0;
+    file_.Evict(page * kPageSize, kPageSize);
+}
+
+}  // namespace editor
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "base/files/memory_mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace editor {
+
+// Keeps the resident part of a mapped file within a budget. Readers report the ranges they are
+// about to read with `touch()`; once the touched pages exceed the budget, the least recently
+// touched ones are evicted from memory (see `base::MemoryMappedFile::Evict()`). Evicted pages stay
+// readable and are read back from the file on their next access.
+//
+// Only touched pages are accounted for, so every read of the mapping must be reported. `touch()`
+// may be called from any thread.
+class ResidentPages {
+public:
+    // The unit of accounting and eviction.
+    static constexpr size_t kPageSize = 16 * 1024 * 1024;
+
+    // `file` must outlive this. The budget is rounded up to a whole number of pages, and at least
+    // two, so a read that crosses a page boundary never evicts its own first page.
+    ResidentPages(const base::MemoryMappedFile& file, size_t budget);
+    ResidentPages(const ResidentPages&) = delete;
+    ResidentPages& operator=(const ResidentPages&) = delete;
+
+    // Marks the pages covering `[offset, offset + length)` as the most recently used, evicting
+    // others as needed to stay within budget.
+    void touch(size_t offset, size_t length) const;
+    // Evicts the pages covering `[offset, offset + length)` right away.
+    void evict(size_t offset, size_t length) const;
+
+    size_t budget() const { return budget_pages_ * kPageSize; }
+    // Bytes in the pages touched and not evicted since.
+    size_t resident_bytes() const;
+    // Whether the page holding `offset` was touched and not evicted since.
+    bool is_resident(size_t offset) const;
+
+private:
+    void evict_page(size_t page) const;
+
+    const base::MemoryMappedFile& file_;
+    size_t budget_pages_;
+
+    mutable std::mutex mutex_;
+    // When each page was last touched, or 0 if it isn't resident.
+    mutable std::vector<uint64_t> last_touched_;
+    mutable uint64_t clock_ = 0;
+    mutable size_t resident_pages_ = 0;
+};
+
+}  // namespace editor
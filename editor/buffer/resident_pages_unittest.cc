@@ -0,0 +1,75 @@
+#include "editor/buffer/resident_pages.h"
+#include <cstdio>
+#include <filesystem>
+#include <gtest/gtest.h>
+
+namespace editor {
+
+namespace {
+
+constexpr std::string_view kFileName = "resident_pages_unittest.txt";
+const base::FilePath kFilePath{FILE_PATH_LITERAL("resident_pages_unittest.txt")};
+constexpr size_t kPageSize = ResidentPages::kPageSize;
+
+// Maps a sparse file of `size` bytes, which takes no disk space.
+std::unique_ptr<base::MemoryMappedFile> map_sparse_file(size_t size) {
+    fclose(fopen(kFileName.data(), "wb"));
+    std::filesystem::resize_file(kFileName, size);
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    EXPECT_TRUE(file->Initialize(kFilePath));
+    std::remove(kFileName.data());
+    return file;
+}
+
+}  // namespace
+
+TEST(ResidentPagesTest, EvictsLeastRecentlyTouched) {
+    auto file = map_sparse_file(5 * kPageSize + 100);
+    ResidentPages pages{*file, 3 * kPageSize};
+    EXPECT_EQ(pages.budget(), 3 * kPageSize);
+
+    pages.touch(0, 1);
+    pages.touch(kPageSize, 1);
+    pages.touch(2 * kPageSize + 5, 10);
+    EXPECT_EQ(pages.resident_bytes(), 3 * kPageSize);
+
+    // Touching page 0 again makes page 1 the least recently used.
+    pages.touch(100, 1);
+    pages.touch(5 * kPageSize, 1);
+    EXPECT_EQ(pages.resident_bytes(), 3 * kPageSize);
+    EXPECT_TRUE(pages.is_resident(0));
+    EXPECT_FALSE(pages.is_resident(kPageSize));
+    EXPECT_TRUE(pages.is_resident(2 * kPageSize));
+    EXPECT_TRUE(pages.is_resident(5 * kPageSize));
+
+    // A range across a boundary touches both pages.
+    pages.touch(4 * kPageSize - 1, 2);
+    EXPECT_TRUE(pages.is_resident(3 * kPageSize));
+    EXPECT_TRUE(pages.is_resident(4 * kPageSize));
+    EXPECT_FALSE(pages.is_resident(0));
+    EXPECT_FALSE(pages.is_resident(2 * kPageSize));
+    EXPECT_EQ(pages.resident_bytes(), 3 * kPageSize);
+
+    pages.evict(3 * kPageSize, kPageSize);
+    EXPECT_FALSE(pages.is_resident(3 * kPageSize));
+    EXPECT_EQ(pages.resident_bytes(), 2 * kPageSize);
+}
+
+TEST(ResidentPagesTest, BudgetIsAtLeastTwoPages) {
+    auto file = map_sparse_file(4 * kPageSize);
+    ResidentPages pages{*file, 1};
+    EXPECT_EQ(pages.budget(), 2 * kPageSize);
+
+    // A read across a boundary keeps both of its pages.
+    pages.touch(0, 1);
+    pages.touch(2 * kPageSize - 1, 2);
+    EXPECT_TRUE(pages.is_resident(kPageSize));
+    EXPECT_TRUE(pages.is_resident(2 * kPageSize));
+    EXPECT_FALSE(pages.is_resident(0));
+
+    // Ranges past the end are ignored.
+    pages.touch(4 * kPageSize, 10);
+    EXPECT_EQ(pages.resident_bytes(), 2 * kPageSize);
+}
+
+}  // namespace editor
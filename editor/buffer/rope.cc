@@ -0,0 +1,609 @@
+#include "base/check.h"
+#include "base/numeric/saturation_arithmetic.h"
+#include "editor/buffer/rope.h"
+#include "editor/buffer/text_metrics.h"
+#include <algorithm>
+#include <utility>
+
+namespace editor {
+
+struct RopeNode {
+    // Leaves hold `text` and internal nodes hold `children`; the other one stays empty.
+    bool is_leaf = true;
+    size_t length = 0;
+    size_t lf_count = 0;
+    size_t codepoints = 0;
+    std::string text;
+    std::vector<std::unique_ptr<RopeNode>> children;
+};
+
+namespace {
+
+using NodePtr = std::unique_ptr<RopeNode>;
+
+size_t count_codepoints(std::string_view text) { return count_text_metrics(text).codepoints; }
+
+size_t count_line_feeds(std::string_view text) {
+    return static_cast<size_t>(std::ranges::count(text, '\n'));
+}
+
+void update(RopeNode& node) {
+    if (node.is_leaf) {
+        node.length = node.text.size();
+        node.lf_count = count_line_feeds(node.text);
+        node.codepoints = count_codepoints(node.text);
+        return;
+    }
+    node.length = 0;
+    node.lf_count = 0;
+    node.codepoints = 0;
+    for (const auto& child : node.children) {
+        node.length += child->length;
+        node.lf_count += child->lf_count;
+        node.codepoints += child->codepoints;
+    }
+}
+
+NodePtr make_leaf(std::string text) {
+    auto leaf = std::make_unique<RopeNode>();
+    leaf->text = std::move(text);
+    update(*leaf);
+    return leaf;
+}
+
+NodePtr make_internal(std::vector<NodePtr> children) {
+    auto node = std::make_unique<RopeNode>();
+    node->is_leaf = false;
+    node->children = std::move(children);
+    update(*node);
+    return node;
+}
+
+// Cuts `text` into as few leaves as fit it, all of about the same length. More than one leaf
+// means each is at least half full.
+std::vector<NodePtr> make_leaves(std::string_view text) {
+    size_t count = std::max<size_t>(1, (text.size() + Rope::kMaxLeafLength - 1) /
+                                           Rope::kMaxLeafLength);
+    std::vector<NodePtr> leaves;
+    leaves.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t first = text.size() * i / count;
+        size_t last = text.size() * (i + 1) / count;
+        leaves.push_back(make_leaf(std::string{text.substr(first, last - first)}));
+    }
+    return leaves;
+}
+
+// Groups `nodes` under as few parents as fit them, all with about the same number of children.
+// More than one parent means each has at least `kMinChildren`.
+std::vector<NodePtr> make_parents(std::vector<NodePtr> nodes) {
+    size_t count = (nodes.size() + Rope::kMaxChildren - 1) / Rope::kMaxChildren;
+    std::vector<NodePtr> parents;
+    parents.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t first = nodes.size() * i / count;
+        size_t last = nodes.size() * (i + 1) / count;
+        parents.push_back(make_internal(std::vector<NodePtr>(
+            std::make_move_iterator(nodes.begin() + first),
+            std::make_move_iterator(nodes.begin() + last))));
+    }
+    return parents;
+}
+
+// Stacks levels of parents over `nodes`, which must all be the same height, until one remains.
+NodePtr build_tree(std::vector<NodePtr> nodes) {
+    while (nodes.size() > 1) {
+        nodes = make_parents(std::move(nodes));
+    }
+    return std::move(nodes.front());
+}
+
+// Inserts `text` at `offset` within `node`. If `node` overflows, it keeps the first part and the
+// rest is returned as new siblings to go right after it.
+std::vector<NodePtr> insert_into(RopeNode& node, size_t offset, std::string_view text) {
+    std::vector<NodePtr> siblings;
+    if (node.is_leaf) {
+        if (node.text.size() + text.size() <= Rope::kMaxLeafLength) {
+            node.text.insert(offset, text);
+            node.length += text.size();
+            node.lf_count += count_line_feeds(text);
+            node.codepoints += count_codepoints(text);
+            return siblings;
+        }
+        std::string combined;
+        combined.reserve(node.text.size() + text.size());
+        combined.append(node.text, 0, offset).append(text).append(node.text, offset);
+        siblings = make_leaves(combined);
+        node.text = std::move(siblings.front()->text);
+        update(node);
+        siblings.erase(siblings.begin());
+        return siblings;
+    }
+
+    // At a boundary between children, prefer the left one, so typing at the end of a leaf extends
+    // it instead of the start of the next one.
+    auto& children = node.children;
+    size_t i = 0;
+    while (i + 1 < children.size() && offset > children[i]->length) {
+        offset -= children[i]->length;
+        ++i;
+    }
+    auto new_children = insert_into(*children[i], offset, text);
+    children.insert(children.begin() + i + 1, std::make_move_iterator(new_children.begin()),
+                    std::make_move_iterator(new_children.end()));
+    if (children.size() <= Rope::kMaxChildren) {
+        update(node);
+        return siblings;
+    }
+    siblings = make_parents(std::move(children));
+    children = std::move(siblings.front()->children);
+    update(node);
+    siblings.erase(siblings.begin());
+    return siblings;
+}
+
+bool is_underfull(const RopeNode& node) {
+    return node.is_leaf ? node.text.size() < Rope::kMinLeafLength
+                        : node.children.size() < Rope::kMinChildren;
+}
+
+void rebalance_children(RopeNode& node);
+
+// Merges `right` into `left` if they fit in one node, and otherwise splits their contents evenly
+// between them. Returns whether `right` is now empty.
+bool merge_or_share(RopeNode& left, RopeNode& right) {
+    if (left.is_leaf) {
+        if (left.text.size() + right.text.size() <= Rope::kMaxLeafLength) {
+            left.text += right.text;
+            update(left);
+            return true;
+        }
+        std::string combined = left.text + right.text;
+        size_t half = combined.size() / 2;
+        left.text.assign(combined, 0, half);
+        right.text.assign(combined, half);
+        update(left);
+        update(right);
+        return false;
+    }
+
+    auto& children = left.children;
+    children.insert(children.end(), std::make_move_iterator(right.children.begin()),
+                    std::make_move_iterator(right.children.end()));
+    right.children.clear();
+    if (children.size() > Rope::kMaxChildren) {
+        size_t half = children.size() / 2;
+        right.children.assign(std::make_move_iterator(children.begin() + half),
+                              std::make_move_iterator(children.end()));
+        children.resize(half);
+    }
+    // A grandchild that had no siblings to merge with may have some now.
+    rebalance_children(left);
+    update(left);
+    if (right.children.empty()) return true;
+    rebalance_children(right);
+    update(right);
+    return false;
+}
+
+// Fixes up underfull children by merging them with or borrowing from a neighbour.
+void rebalance_children(RopeNode& node) {
+    auto& children = node.children;
+    size_t i = 0;
+    while (children.size() > 1 && i < children.size()) {
+        if (!is_underfull(*children[i])) {
+            ++i;
+            continue;
+        }
+        size_t left = i > 0 ? i - 1 : 0;
+        if (merge_or_share(*children[left], *children[left + 1])) {
+            children.erase(children.begin() + left + 1);
+        }
+        // Either may be underfull still (or again, if its own children merged), so look again.
+        i = left;
+    }
+}
+
+// Erases [offset, offset + count) from `node`. Children it covers entirely are dropped whole.
+void erase_from(RopeNode& node, size_t offset, size_t count) {
+    if (node.is_leaf) {
+        node.text.erase(offset, count);
+        update(node);
+        return;
+    }
+
+    auto& children = node.children;
+    size_t i = 0;
+    while (i < children.size() && count > 0) {
+        size_t child_length = children[i]->length;
+        if (offset >= child_length) {
+            offset -= child_length;
+            ++i;
+            continue;
+        }
+        size_t n = std::min(count, child_length - offset);
+        if (n == child_length) {
+            children.erase(children.begin() + i);
+        } else {
+            erase_from(*children[i], offset, n);
+            ++i;
+        }
+        count -= n;
+        offset = 0;
+    }
+    rebalance_children(node);
+    update(node);
+}
+
+// Descends to the leaf holding `offset`, which must be less than the length of `node`, and
+// returns it along with where it starts.
+std::pair<const RopeNode*, size_t> leaf_at(const RopeNode* node, size_t offset) {
+    size_t start = 0;
+    while (!node->is_leaf) {
+        for (const auto& child : node->children) {
+            if (offset < child->length) {
+                node = child.get();
+                break;
+            }
+            offset -= child->length;
+            start += child->length;
+        }
+    }
+    return {node, start};
+}
+
+// Sums `field` over the text before `offset`, using `count` for the part of the final leaf.
+template <size_t RopeNode::* field, class Count>
+size_t sum_before(const RopeNode* node, size_t offset, Count count) {
+    size_t sum = 0;
+    while (!node->is_leaf) {
+        const RopeNode* next = nullptr;
+        for (const auto& child : node->children) {
+            if (offset < child->length) {
+                next = child.get();
+                break;
+            }
+            offset -= child->length;
+            sum += (*child).*field;
+        }
+        // `offset` was at or past the end.
+        if (!next) return sum;
+        node = next;
+    }
+    return sum + count(std::string_view(node->text).substr(0, offset));
+}
+
+bool visit_chunks(const RopeNode& node,
+                  size_t start,
+                  size_t first,
+                  size_t last,
+                  const std::function<bool(std::string_view)>& visit) {
+    if (node.is_leaf) {
+        size_t from = std::max(first, start) - start;
+        size_t to = std::min(last, start + node.length) - start;
+        return from >= to || visit(std::string_view(node.text).substr(from, to - from));
+    }
+    for (const auto& child : node.children) {
+        if (start >= last) break;
+        if (start + child->length > first && !visit_chunks(*child, start, first, last, visit)) {
+            return false;
+        }
+        start += child->length;
+    }
+    return true;
+}
+
+// Returns the height of `node`, or 0 if anything below it is wrong.
+size_t check_node(const RopeNode& node, bool is_root) {
+    if (node.is_leaf) {
+        bool counts_ok = node.length == node.text.size() &&
+                         node.lf_count == count_line_feeds(node.text) &&
+                         node.codepoints == count_codepoints(node.text);
+        bool size_ok = node.text.size() <= Rope::kMaxLeafLength &&
+                       (is_root || node.text.size() >= Rope::kMinLeafLength);
+        return counts_ok && size_ok ? 1 : 0;
+    }
+
+    size_t min_children = is_root ? 2 : Rope::kMinChildren;
+    if (node.children.size() < min_children || node.children.size() > Rope::kMaxChildren) {
+        return 0;
+    }
+    size_t height = 0;
+    size_t length = 0;
+    size_t lf_count = 0;
+    size_t codepoints = 0;
+    for (const auto& child : node.children) {
+        size_t child_height = check_node(*child, false);
+        if (child_height == 0 || (height != 0 && child_height != height)) return 0;
+        height = child_height;
+        length += child->length;
+        lf_count += child->lf_count;
+        codepoints += child->codepoints;
+    }
+    bool counts_ok =
+        node.length == length && node.lf_count == lf_count && node.codepoints == codepoints;
+    return counts_ok ? height + 1 : 0;
+}
+
+}  // namespace
+
+Rope::Rope(std::string_view txt) : root_{build_tree(make_leaves(txt))} {}
+
+Rope::~Rope() = default;
+
+Rope::Rope(Rope&&) noexcept = default;
+
+Rope& Rope::operator=(Rope&&) noexcept = default;
+
+size_t Rope::length() const { return root_->length; }
+
+size_t Rope::line_feed_count() const { return root_->lf_count; }
+
+void Rope::insert(size_t offset, std::string_view txt) {
+    if (txt.empty()) return;
+    offset = std::min(offset, length());
+
+    record_edit(EditKind::Insert, offset, txt);
+    insert_internal(offset, txt);
+}
+
+void Rope::insert_internal(size_t offset, std::string_view txt) {
+    auto siblings = insert_into(*root_, offset, txt);
+    if (!siblings.empty()) {
+        siblings.insert(siblings.begin(), std::move(root_));
+        root_ = build_tree(std::move(siblings));
+    }
+    DCHECK(satisfies_invariants());
+}
+
+void Rope::erase(size_t offset, size_t count) {
+    if (offset >= length()) return;
+    count = std::min(count, length() - offset);
+    if (count == 0) return;
+
+    record_edit(EditKind::Erase, offset, substr(offset, count));
+    erase_internal(offset, count);
+}
+
+void Rope::erase_internal(size_t offset, size_t count) {
+    erase_from(*root_, offset, count);
+    while (!root_->is_leaf && root_->children.size() == 1) {
+        root_ = std::move(root_->children.front());
+    }
+    if (!root_->is_leaf && root_->children.empty()) root_ = make_leaf({});
+    DCHECK(satisfies_invariants());
+}
+
+std::string Rope::get_line_content_with_newline(size_t line) const {
+    auto [first, last] = get_line_range_with_newline(line);
+    return substr(first, last - first);
+}
+
+size_t Rope::line_at(size_t offset) const {
+    return line_feeds_before(std::min(offset, length()));
+}
+
+BufferCursor Rope::line_column_at(size_t offset) const {
+    size_t line = line_at(offset);
+    auto [first, last] = get_line_range(line);
+    return {line, std::min(offset, last) - first};
+}
+
+size_t Rope::offset_at(size_t line, size_t column) const {
+    auto [first, last] = get_line_range(line);
+    return std::min(first + column, last);
+}
+
+LineRange Rope::get_line_range(size_t line) const {
+    size_t first = line_start(line);
+    size_t last = line < line_feed_count() ? line_start(line + 1) - 1 : length();
+    return {first, last};
+}
+
+LineRange Rope::get_line_range_with_newline(size_t line) const {
+    return {line_start(line), line_start(line + 1)};
+}
+
+std::string Rope::substr(size_t offset, size_t count) const {
+    std::string str;
+    offset = std::min(offset, length());
+    size_t last = std::min(base::add_sat(offset, count), length());
+    str.reserve(last - offset);
+    for_each_chunk(offset, last, [&](std::string_view chunk) {
+        str += chunk;
+        return true;
+    });
+    return str;
+}
+
+size_t Rope::codepoint_column_at(size_t offset) const {
+    auto [first, last] = get_line_range(line_at(offset));
+    offset = std::min(offset, last);
+    return codepoints_before(offset) - codepoints_before(first);
+}
+
+TextChunk Rope::chunk_at(size_t offset) const {
+    DCHECK_LT(offset, length());
+    auto [leaf, start] = leaf_at(root_.get(), offset);
+    return {start, leaf->text};
+}
+
+void Rope::for_each_chunk(size_t first,
+                          size_t last,
+                          const std::function<bool(std::string_view)>& visit) const {
+    last = std::min(last, length());
+    if (first < last) visit_chunks(*root_, 0, first, last, visit);
+}
+
+size_t Rope::line_start(size_t line) const {
+    if (line == 0) return 0;
+    if (line > line_feed_count()) return length();
+
+    // Find the leaf holding the `line`th line feed.
+    size_t offset = 0;
+    const RopeNode* node = root_.get();
+    while (!node->is_leaf) {
+        for (const auto& child : node->children) {
+            if (line <= child->lf_count) {
+                node = child.get();
+                break;
+            }
+            line -= child->lf_count;
+            offset += child->length;
+        }
+    }
+    size_t pos = 0;
+    while (true) {
+        pos = node->text.find('\n', pos);
+        DCHECK_NE(pos, std::string::npos);
+        ++pos;
+        if (--line == 0) return offset + pos;
+    }
+}
+
+size_t Rope::line_feeds_before(size_t offset) const {
+    return sum_before<&RopeNode::lf_count>(root_.get(), offset, count_line_feeds);
+}
+
+size_t Rope::codepoints_before(size_t offset) const {
+    return sum_before<&RopeNode::codepoints>(root_.get(), offset, count_codepoints);
+}
+
+bool Rope::undo() {
+    if (undo_stack_.empty()) return false;
+    auto entry = std::move(undo_stack_.back());
+    undo_stack_.pop_back();
+    undo_bytes_ -= entry.bytes;
+    for (auto it = entry.changes.rbegin(); it != entry.changes.rend(); ++it) {
+        if (!it->inserted.empty()) erase_internal(it->offset, it->inserted.size());
+        if (!it->erased.empty()) insert_internal(it->offset, it->erased);
+    }
+    redo_bytes_ += entry.bytes;
+    redo_stack_.push_back(std::move(entry));
+    last_edit_ = {};
+    transaction_has_entry_ = false;
+    return true;
+}
+
+bool Rope::redo() {
+    if (redo_stack_.empty()) return false;
+    auto entry = std::move(redo_stack_.back());
+    redo_stack_.pop_back();
+    redo_bytes_ -= entry.bytes;
+    for (const auto& change : entry.changes) {
+        if (!change.erased.empty()) erase_internal(change.offset, change.erased.size());
+        if (!change.inserted.empty()) insert_internal(change.offset, change.inserted);
+    }
+    undo_bytes_ += entry.bytes;
+    undo_stack_.push_back(std::move(entry));
+    last_edit_ = {};
+    transaction_has_entry_ = false;
+    return true;
+}
+
+void Rope::begin_transaction() {
+    if (transaction_depth_++ == 0) {
+        last_edit_ = {};
+        transaction_has_entry_ = false;
+    }
+}
+
+void Rope::end_transaction() {
+    DCHECK_GT(transaction_depth_, 0);
+    if (--transaction_depth_ == 0) {
+        last_edit_ = {};
+        transaction_has_entry_ = false;
+        enforce_undo_limits();
+    }
+}
+
+void Rope::set_undo_limits(size_t max_entries, size_t max_bytes) {
+    max_undo_entries_ = max_entries;
+    max_undo_bytes_ = max_bytes;
+    enforce_undo_limits();
+}
+
+void Rope::record_edit(EditKind kind, size_t offset, std::string_view txt) {
+    // Can't redo if we're creating a new undo entry.
+    redo_stack_.clear();
+    redo_bytes_ = 0;
+
+    // The same coalescing rules as `PieceTree::record_edit()`.
+    size_t count = txt.size();
+    bool continues = false;
+    if (kind == EditKind::Insert && last_edit_.kind == EditKind::Insert) {
+        continues = offset == last_edit_.offset;
+    } else if (kind == EditKind::Erase && last_edit_.kind == EditKind::Erase) {
+        continues = offset + count == last_edit_.offset || offset == last_edit_.offset;
+    }
+
+    bool in_transaction = transaction_depth_ > 0;
+    bool merge = in_transaction ? transaction_has_entry_ : continues;
+    if (!merge || undo_stack_.empty()) {
+        undo_stack_.push_back({});
+        transaction_has_entry_ = in_transaction;
+    }
+
+    // Extend the previous change when this one picks up where it left off.
+    auto& changes = undo_stack_.back().changes;
+    Change* prev = changes.empty() ? nullptr : &changes.back();
+    if (kind == EditKind::Insert && prev && prev->erased.empty() &&
+        offset == prev->offset + prev->inserted.size()) {
+        prev->inserted += txt;
+    } else if (kind == EditKind::Erase && prev && prev->inserted.empty() &&
+               offset + count == prev->offset) {
+        prev->erased.insert(0, txt);
+        prev->offset = offset;
+    } else if (kind == EditKind::Erase && prev && prev->inserted.empty() &&
+               offset == prev->offset) {
+        prev->erased += txt;
+    } else if (kind == EditKind::Insert) {
+        changes.push_back({.offset = offset, .inserted = std::string{txt}});
+    } else {
+        changes.push_back({.offset = offset, .erased = std::string{txt}});
+    }
+    undo_stack_.back().bytes += count;
+    undo_bytes_ += count;
+    last_edit_ = {
+        .kind = kind,
+        .offset = kind == EditKind::Insert ? offset + count : offset,
+    };
+
+    // Don't drop the open transaction's entry out from under it; the limits apply once it ends.
+    if (!in_transaction) enforce_undo_limits();
+}
+
+void Rope::enforce_undo_limits() {
+    // The newest entry is kept even if it alone exceeds the byte limit.
+    while (!undo_stack_.empty() &&
+           (undo_stack_.size() > max_undo_entries_ ||
+            (undo_bytes_ > max_undo_bytes_ && undo_stack_.size() > 1))) {
+        undo_bytes_ -= undo_stack_.front().bytes;
+        undo_stack_.pop_front();
+        if (undo_stack_.empty()) last_edit_ = {};
+    }
+}
+
+size_t Rope::leaf_count() const {
+    size_t count = 0;
+    std::vector<const RopeNode*> stack{root_.get()};
+    while (!stack.empty()) {
+        const RopeNode* node = stack.back();
+        stack.pop_back();
+        if (node->is_leaf) ++count;
+        for (const auto& child : node->children) stack.push_back(child.get());
+    }
+    return count;
+}
+
+size_t Rope::height() const {
+    size_t height = 1;
+    for (const RopeNode* node = root_.get(); !node->is_leaf; node = node->children.front().get()) {
+        ++height;
+    }
+    return height;
+}
+
+bool Rope::satisfies_invariants() const { return check_node(*root_, true) != 0; }
+
+}  // namespace editor
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "editor/buffer/text_buffer.h"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+// Defined in rope.cc, so the tree's helpers can live in an anonymous namespace there.
+struct RopeNode;
+
+// A B+ tree of text: leaves hold up to `kMaxLeafLength` bytes each, and every node caches the
+// length, line feeds and codepoints of its subtree, so offset and line lookups take O(log n) plus
+// a scan of one leaf. Unlike `PieceTree`, edits rewrite the text in place, so there is no original
+// buffer to keep alive and no fragmentation to compact away, but snapshots would need a copy.
+//
+// This started as //experiments/rope. On top of that, erasing merges or rebalances underfull
+// nodes, so the tree stays within the size bounds below after any edit sequence.
+class Rope final : public TextBuffer {
+public:
+    // A leaf holds at most one page of text, and at least a quarter of one unless it is the only
+    // leaf. Internal nodes have between `kMinChildren` and `kMaxChildren` children, except the
+    // root, which has at least two.
+    static constexpr size_t kMaxLeafLength = 4096;
+    static constexpr size_t kMinLeafLength = kMaxLeafLength / 4;
+    static constexpr size_t kMaxChildren = 8;
+    static constexpr size_t kMinChildren = kMaxChildren / 2;
+
+    static constexpr size_t kDefaultMaxUndoEntries = 10'000;
+    static constexpr size_t kDefaultMaxUndoBytes = 64 * 1024 * 1024;
+
+    Rope() : Rope(std::string_view{}) {}
+    // Builds a balanced tree in O(n).
+    explicit Rope(std::string_view txt);
+    ~Rope() override;
+    Rope(Rope&&) noexcept;
+    Rope& operator=(Rope&&) noexcept;
+
+    // Manipulation.
+    void insert(size_t offset, std::string_view txt) override;
+    void erase(size_t offset, size_t count) override;
+
+    // Undo history. Entries record the text each edit inserted and erased, and undoing replays
+    // them in reverse.
+    bool undo() override;
+    bool redo() override;
+    void begin_transaction() override;
+    void end_transaction() override;
+    void break_undo_coalescing() override { last_edit_ = {}; }
+    // Once either limit is exceeded, the oldest entries are dropped (the byte limit never drops
+    // the newest one).
+    void set_undo_limits(size_t max_entries, size_t max_bytes);
+    size_t undo_entry_count() const { return undo_stack_.size(); }
+    // Bytes of text held by the undo and redo history.
+    size_t undo_retained_bytes() const { return undo_bytes_ + redo_bytes_; }
+
+    // Metadata.
+    size_t length() const override;
+    size_t line_feed_count() const override;
+
+    // Queries.
+    std::string get_line_content_with_newline(size_t line) const override;
+    size_t line_at(size_t offset) const override;
+    BufferCursor line_column_at(size_t offset) const override;
+    size_t offset_at(size_t line, size_t column) const override;
+    LineRange get_line_range(size_t line) const override;
+    LineRange get_line_range_with_newline(size_t line) const override;
+    std::string substr(size_t offset, size_t count) const override;
+    size_t codepoint_column_at(size_t offset) const override;
+
+    // Chunk access. Chunks are whole leaves.
+    TextChunk chunk_at(size_t offset) const override;
+    void for_each_chunk(size_t first,
+                        size_t last,
+                        const std::function<bool(std::string_view)>& visit) const override;
+
+    // Debug use.
+    size_t leaf_count() const;
+    size_t height() const;
+    // Whether every node's cached counts are right and every node is within the size bounds.
+    bool satisfies_invariants() const;
+
+private:
+    // Replaces `erased` at `offset` with `inserted`.
+    struct Change {
+        size_t offset = 0;
+        std::string erased;
+        std::string inserted;
+    };
+
+    struct UndoEntry {
+        std::vector<Change> changes;
+        size_t bytes = 0;
+    };
+
+    enum class EditKind { None, Insert, Erase };
+
+    struct LastEdit {
+        EditKind kind = EditKind::None;
+        size_t offset = 0;  // For `Insert`, the end of the inserted text; for `Erase`, its start.
+    };
+
+    // Undo bookkeeping. Must be called before every edit.
+    void record_edit(EditKind kind, size_t offset, std::string_view txt);
+    void enforce_undo_limits();
+
+    // Direct mutations.
+    void insert_internal(size_t offset, std::string_view txt);
+    void erase_internal(size_t offset, size_t count);
+
+    // The offset where `line` starts, or `length()` past the last line.
+    size_t line_start(size_t line) const;
+    // Line feeds and codepoints before `offset`.
+    size_t line_feeds_before(size_t offset) const;
+    size_t codepoints_before(size_t offset) const;
+
+    std::unique_ptr<RopeNode> root_;
+
+    // Oldest entries are at the front.
+    std::deque<UndoEntry> undo_stack_;
+    std::deque<UndoEntry> redo_stack_;
+    size_t undo_bytes_ = 0;
+    size_t redo_bytes_ = 0;
+    size_t max_undo_entries_ = kDefaultMaxUndoEntries;
+    size_t max_undo_bytes_ = kDefaultMaxUndoBytes;
+    LastEdit last_edit_;
+    size_t transaction_depth_ = 0;
+    // Whether the open transaction has already pushed its undo entry.
+    bool transaction_has_entry_ = false;
+};
+
+}  // namespace editor
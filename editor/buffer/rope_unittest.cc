@@ -0,0 +1,96 @@
+#include "base/rand_util.h"
+#include "editor/buffer/rope.h"
+#include <gtest/gtest.h>
+
+namespace editor {
+
+static_assert(std::movable<Rope>);
+
+TEST(RopeTest, BulkConstruction) {
+    for (size_t length : {size_t{0}, size_t{1}, Rope::kMaxLeafLength, Rope::kMaxLeafLength + 1,
+                          size_t{1'000'000}}) {
+        std::string text(length, 'a');
+        Rope rope{text};
+        EXPECT_EQ(rope.length(), length);
+        EXPECT_EQ(rope.str(), text);
+        EXPECT_TRUE(rope.satisfies_invariants());
+    }
+
+    Rope rope{std::string(1'000'000, 'a')};
+    // Leaves are full apart from rounding, and the height is logarithmic in the leaf count.
+    EXPECT_EQ(rope.leaf_count(), (1'000'000 + Rope::kMaxLeafLength - 1) / Rope::kMaxLeafLength);
+    EXPECT_LE(rope.height(), size_t{5});
+}
+
+TEST(RopeTest, LargeInsertSplitsLeaves) {
+    Rope rope{"ab"};
+    std::string big(100'000, 'x');
+    rope.insert(1, big);
+    EXPECT_EQ(rope.str(), "a" + big + "b");
+    EXPECT_TRUE(rope.satisfies_invariants());
+    EXPECT_GT(rope.leaf_count(), size_t{1});
+
+    EXPECT_TRUE(rope.undo());
+    EXPECT_EQ(rope.str(), "ab");
+    EXPECT_TRUE(rope.satisfies_invariants());
+}
+
+TEST(RopeTest, EraseMergesUnderfullNodes) {
+    std::string text = base::rand_string_with_newlines(200'000, 2000);
+    Rope rope{text};
+    size_t height = rope.height();
+
+    // Erasing almost everything leaves one small leaf.
+    rope.erase(10, text.size() - 20);
+    text.erase(10, text.size() - 20);
+    EXPECT_EQ(rope.str(), text);
+    EXPECT_TRUE(rope.satisfies_invariants());
+    EXPECT_EQ(rope.leaf_count(), size_t{1});
+    EXPECT_EQ(rope.height(), size_t{1});
+
+    EXPECT_TRUE(rope.undo());
+    EXPECT_TRUE(rope.satisfies_invariants());
+    EXPECT_LE(rope.height(), height + 1);
+}
+
+TEST(RopeTest, RandomEditsKeepInvariants) {
+    std::string expected = base::rand_string_with_newlines(50'000, 500);
+    Rope rope{expected};
+    for (int i = 0; i < 2000; ++i) {
+        size_t offset = base::rand_int(0, static_cast<int>(expected.size()));
+        if (base::rand_int(0, 1) == 0) {
+            size_t length = base::rand_int(0, 19) == 0 ? 5000 : base::rand_int(1, 50);
+            std::string txt = base::rand_string_with_newlines(length, length / 10);
+            rope.insert(offset, txt);
+            expected.insert(offset, txt);
+        } else {
+            size_t count = base::rand_int(0, 19) == 0 ? 5000 : base::rand_int(1, 50);
+            rope.erase(offset, count);
+            expected.erase(offset, count);
+        }
+        ASSERT_TRUE(rope.satisfies_invariants());
+        ASSERT_EQ(rope.length(), expected.size());
+    }
+    EXPECT_EQ(rope.str(), expected);
+}
+
+TEST(RopeTest, UndoLimits) {
+    Rope rope;
+    for (int i = 0; i < 10; ++i) {
+        rope.break_undo_coalescing();
+        rope.insert(rope.length(), "abcd");
+    }
+    EXPECT_EQ(rope.undo_entry_count(), size_t{10});
+    EXPECT_EQ(rope.undo_retained_bytes(), size_t{40});
+
+    rope.set_undo_limits(5, 1000);
+    EXPECT_EQ(rope.undo_entry_count(), size_t{5});
+    rope.set_undo_limits(100, 10);
+    EXPECT_EQ(rope.undo_entry_count(), size_t{2});
+    EXPECT_EQ(rope.undo_retained_bytes(), size_t{8});
+
+    while (rope.undo()) {}
+    EXPECT_EQ(rope.length(), size_t{32});
+}
+
+}  // namespace editor
@@ -0,0 +1,153 @@
+#include "base/compiler_specific.h"
+#include "base/files/file_util.h"
+#include "build/build_config.h"
+#include "editor/buffer/save_file.h"
+#include <cerrno>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <string>
+
+#if BUILDFLAG(IS_POSIX)
+#include "base/posix/eintr_wrapper.h"
+#include <climits>
+#include <fcntl.h>
+#include <span>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+#else
+#include <filesystem>
+#endif
+
+namespace editor {
+
+double SaveStats::megabytes_per_second() const {
+    double seconds = std::chrono::duration<double>(duration).count();
+    return seconds > 0 ? static_cast<double>(bytes) / 1024 / 1024 / seconds : 0;
+}
+
+#if BUILDFLAG(IS_POSIX)
+
+namespace {
+
+// Writes all of `iov`, resuming after short writes.
+bool write_all(int fd, std::span<iovec> iov, SaveStats& stats) {
+    while (!iov.empty()) {
+        ssize_t written = HANDLE_EINTR(writev(fd, iov.data(), static_cast<int>(iov.size())));
+        if (written <= 0) return false;
+        ++stats.write_calls;
+
+        size_t remaining = static_cast<size_t>(written);
+        while (!iov.empty() && remaining >= iov[0].iov_len) {
+            remaining -= iov[0].iov_len;
+            iov = iov.subspan(1);
+        }
+        if (remaining > 0) {
+            iov[0].iov_base = UNSAFE_TODO(static_cast<char*>(iov[0].iov_base) + remaining);
+            iov[0].iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+bool write_tree(int fd, const PieceTree& tree, SaveStats& stats) {
+    std::vector<iovec> iov;
+    iov.reserve(IOV_MAX);
+    ChunkIterator it{tree};
+    while (!it.exhausted()) {
+        std::string_view chunk = it.next();
+        iov.push_back({const_cast<char*>(chunk.data()), chunk.size()});
+        stats.bytes += chunk.size();
+        if (iov.size() == IOV_MAX) {
+            if (!write_all(fd, iov, stats)) return false;
+            iov.clear();
+        }
+    }
+    return write_all(fd, iov, stats);
+}
+
+// Makes the rename itself durable.
+void sync_directory(const base::FilePath& dir) {
+    int fd = HANDLE_EINTR(open(dir.value().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd < 0) return;
+    fsync(fd);
+    IGNORE_EINTR(close(fd));
+}
+
+}  // namespace
+
+bool save_file(const PieceTree& tree, const base::FilePath& path, SaveStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    SaveStats result;
+
+    std::string temp_path = path.value() + ".XXXXXX";
+    int fd = mkostemp(temp_path.data(), O_CLOEXEC);
+    if (fd < 0) {
+        spdlog::error("save_file() error: cannot create a temporary file: {}", strerror(errno));
+        return false;
+    }
+
+    auto fail = [&](std::string_view what) {
+        spdlog::error("save_file() error: {} failed: {}", what, strerror(errno));
+        if (fd >= 0) IGNORE_EINTR(close(fd));
+        unlink(temp_path.c_str());
+        return false;
+    };
+
+    // `mkostemp()` creates the file as 0600.
+    struct stat info;
+    mode_t mode = stat(path.value().c_str(), &info) == 0 ? info.st_mode & 07777 : 0644;
+    if (fchmod(fd, mode) != 0) return fail("fchmod");
+    if (!write_tree(fd, tree, result)) return fail("writev");
+    if (HANDLE_EINTR(fsync(fd)) != 0) return fail("fsync");
+    int closed = IGNORE_EINTR(close(fd));
+    fd = -1;
+    if (closed != 0) return fail("close");
+    if (rename(temp_path.c_str(), path.value().c_str()) != 0) return fail("rename");
+    sync_directory(path.DirName());
+
+    result.duration = std::chrono::steady_clock::now() - start;
+    if (stats) *stats = result;
+    return true;
+}
+
+#else
+
+// Without `writev()`, write one piece at a time through stdio's buffer.
+bool save_file(const PieceTree& tree, const base::FilePath& path, SaveStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    SaveStats result;
+
+    base::FilePath temp_path{path.value() + FILE_PATH_LITERAL(".tmp")};
+    FILE* file = base::OpenFile(temp_path, "wb");
+    if (!file) {
+        spdlog::error("save_file() error: cannot create a temporary file");
+        return false;
+    }
+    bool ok = true;
+    ChunkIterator it{tree};
+    while (ok && !it.exhausted()) {
+        std::string_view chunk = it.next();
+        ok = fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+        result.bytes += chunk.size();
+        ++result.write_calls;
+    }
+    ok = base::CloseFile(file) && ok;
+
+    std::error_code error;
+    if (ok) std::filesystem::rename(temp_path.value(), path.value(), error);
+    if (!ok || error) {
+        spdlog::error("save_file() error: cannot write the file");
+        std::filesystem::remove(temp_path.value(), error);
+        return false;
+    }
+
+    result.duration = std::chrono::steady_clock::now() - start;
+    if (stats) *stats = result;
+    return true;
+}
+
+#endif
+
+}  // namespace editor
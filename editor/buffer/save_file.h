@@ -0,0 +1,30 @@
+#pragma once
+
+#include "base/files/file_path.h"
+#include "editor/buffer/piece_tree.h"
+#include <chrono>
+#include <cstddef>
+
+namespace editor {
+
+struct SaveStats {
+    size_t bytes = 0;
+    // Number of write system calls. Each one carries up to `IOV_MAX` pieces.
+    size_t write_calls = 0;
+    std::chrono::nanoseconds duration{};
+
+    double megabytes_per_second() const;
+};
+
+// Writes `tree` to `path` without first copying it into one string: the pieces are handed to the
+// OS straight from the tree's buffers, in batches. The text goes to a temporary file next to
+// `path`, which is flushed to disk and then renamed over `path`, so readers see either the old or
+// the new contents and never a partial file. An existing file keeps its permissions.
+//
+// Replacing the file instead of rewriting it in place also keeps documents opened through a
+// memory mapping (including `tree` itself) intact, as they still map the old file.
+//
+// Returns false and leaves `path` untouched on failure.
+bool save_file(const PieceTree& tree, const base::FilePath& path, SaveStats* stats = nullptr);
+
+}  // namespace editor
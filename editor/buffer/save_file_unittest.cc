@@ -0,0 +1,95 @@
+#include "base/files/file_reader.h"
+#include "base/rand_util.h"
+#include "build/build_config.h"
+#include "editor/buffer/save_file.h"
+#include <cstdio>
+#include <gtest/gtest.h>
+
+#if BUILDFLAG(IS_POSIX)
+#include <sys/stat.h>
+#endif
+
+namespace editor {
+
+namespace {
+
+constexpr std::string_view kFileName = "save_file_unittest.txt";
+const base::FilePath kFilePath{FILE_PATH_LITERAL("save_file_unittest.txt")};
+
+}  // namespace
+
+TEST(SaveFileTest, WritesEditedTree) {
+    PieceTree tree{"Hello world!\nSecond line\n"};
+    tree.insert(5, ",");
+    tree.erase(0, 1);
+    tree.insert(0, "J");
+    tree.insert(tree.length(), "Third line\n");
+
+    SaveStats stats;
+    ASSERT_TRUE(save_file(tree, kFilePath, &stats));
+    EXPECT_EQ(base::ReadFile(kFileName), tree.str());
+    EXPECT_EQ(stats.bytes, tree.length());
+    EXPECT_GE(stats.write_calls, 1);
+    std::remove(kFileName.data());
+}
+
+TEST(SaveFileTest, WritesEmptyTree) {
+    base::WriteFile(kFileName, "old contents");
+    ASSERT_TRUE(save_file(PieceTree{}, kFilePath));
+    EXPECT_EQ(base::ReadFile(kFileName), "");
+    std::remove(kFileName.data());
+}
+
+// More pieces than fit in a single write call.
+TEST(SaveFileTest, WritesManyPieces) {
+    PieceTree tree{base::rand_string_with_newlines(1000, 10)};
+    std::string expected = tree.str();
+    for (size_t i = 0; i < 5000; ++i) {
+        size_t offset = base::rand_int(0, tree.length());
+        std::string text = base::rand_bytes_as_string(base::rand_int(1, 5));
+        tree.insert(offset, text);
+        expected.insert(offset, text);
+    }
+
+    SaveStats stats;
+    ASSERT_TRUE(save_file(tree, kFilePath, &stats));
+    EXPECT_EQ(base::ReadFile(kFileName), expected);
+    EXPECT_GT(stats.write_calls, 1);
+    std::remove(kFileName.data());
+}
+
+// The file is replaced rather than rewritten, so a tree reading the old file through a mapping
+// still sees the old contents.
+TEST(SaveFileTest, SavesOverOwnMappedFile) {
+    base::WriteFile(kFileName, "Hello world!\n");
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    ASSERT_TRUE(file->Initialize(kFilePath));
+    PieceTree tree{std::move(file)};
+    tree.insert(0, ">> ");
+
+    ASSERT_TRUE(save_file(tree, kFilePath));
+    EXPECT_EQ(tree.str(), ">> Hello world!\n");
+    EXPECT_EQ(base::ReadFile(kFileName), ">> Hello world!\n");
+    std::remove(kFileName.data());
+}
+
+TEST(SaveFileTest, FailsWithoutTouchingTarget) {
+    base::FilePath path{FILE_PATH_LITERAL("save_file_unittest_missing_dir/file.txt")};
+    EXPECT_FALSE(save_file(PieceTree{"text"}, path));
+}
+
+#if BUILDFLAG(IS_POSIX)
+TEST(SaveFileTest, KeepsPermissions) {
+    base::WriteFile(kFileName, "old contents");
+    ASSERT_EQ(chmod(kFileName.data(), 0640), 0);
+
+    ASSERT_TRUE(save_file(PieceTree{"new contents"}, kFilePath));
+    struct stat info;
+    ASSERT_EQ(stat(kFileName.data(), &info), 0);
+    EXPECT_EQ(info.st_mode & 07777, 0640u);
+    EXPECT_EQ(base::ReadFile(kFileName), "new contents");
+    std::remove(kFileName.data());
+}
+#endif
+
+}  // namespace editor
@@ -0,0 +1,170 @@
+#include "base/check.h"
+#include "base/unicode/utf8_decoder.h"
+#include "editor/buffer/piece_tree.h"
+#include "editor/buffer/rope.h"
+#include "editor/buffer/text_buffer.h"
+#include "editor/search/aho_corasick.h"
+
+namespace editor {
+
+void LineBlock::clear() {
+    first_line_ = 0;
+    offset_ = 0;
+    text_.clear();
+    starts_.clear();
+    ends_.clear();
+}
+
+std::string_view LineBlock::line(size_t i) const {
+    return std::string_view(text_).substr(starts_[i], ends_[i] - starts_[i]);
+}
+
+std::string_view LineBlock::line_for_layout_use(size_t i) const {
+    return std::string_view(text_).substr(starts_[i], starts_[i + 1] - starts_[i]);
+}
+
+std::string TextBuffer::get_line_content(size_t line) const {
+    std::string buf = get_line_content_with_newline(line);
+    if (!buf.empty() && buf.back() == '\n') buf.pop_back();
+    return buf;
+}
+
+std::string TextBuffer::get_line_content_for_layout_use(size_t line) const {
+    std::string buf = get_line_content_with_newline(line);
+    if (!buf.empty() && buf.back() == '\n') buf.back() = ' ';
+    return buf;
+}
+
+void TextBuffer::get_lines(size_t first, size_t count, LineBlock& lines) const {
+    if (first >= line_count() || count == 0) {
+        lines.clear();
+        lines.first_line_ = first;
+        return;
+    }
+    get_lines_from(first, get_line_range(first).first, count, lines);
+}
+
+void TextBuffer::get_lines_from(size_t first,
+                                size_t offset,
+                                size_t count,
+                                LineBlock& lines) const {
+    lines.clear();
+    lines.first_line_ = first;
+    if (first >= line_count() || count == 0) return;
+
+    lines.offset_ = offset;
+    lines.starts_.push_back(0);
+    auto end_line = [&](bool newline) {
+        lines.ends_.push_back(lines.text_.size());
+        if (newline) lines.text_.push_back(' ');
+        lines.starts_.push_back(lines.text_.size());
+    };
+
+    for_each_chunk(offset, length(), [&](std::string_view chunk) {
+        size_t newline;
+        while (lines.size() < count && (newline = chunk.find('\n')) != std::string_view::npos) {
+            lines.text_ += chunk.substr(0, newline);
+            end_line(true);
+            chunk.remove_prefix(newline + 1);
+        }
+        if (lines.size() < count) lines.text_ += chunk;
+        return lines.size() < count;
+    });
+    // The last line of the document has no newline.
+    if (lines.size() < count) end_line(false);
+}
+
+std::optional<size_t> TextBuffer::find(std::string_view txt) const {
+    AhoCorasick ac({std::string(txt)});
+    auto result = ac.match(*this);
+
+    if (result.match_begin == -1) {
+        return std::nullopt;
+    } else {
+        return result.match_begin;
+    }
+}
+
+TextWalker::TextWalker(const TextBuffer& buffer, size_t offset)
+    : buffer_{buffer}, length_{buffer.length()}, offset_{std::min(offset, length_)} {}
+
+char TextWalker::next() {
+    if (exhausted()) return '\0';
+    if (offset_ - chunk_.offset >= chunk_.text.size()) chunk_ = buffer_.chunk_at(offset_);
+    char c = chunk_.text[offset_ - chunk_.offset];
+    ++offset_;
+    return c;
+}
+
+char32_t TextWalker::next_codepoint() {
+    base::UTF8Decoder decoder;
+    while (!exhausted()) {
+        decoder.put(next());
+
+        if (decoder.done()) {
+            return decoder.value();
+        } else if (decoder.error()) {
+            return 0;
+        }
+    }
+    return decoder.done() ? decoder.value() : 0;
+}
+
+ReverseTextWalker::ReverseTextWalker(const TextBuffer& buffer, size_t offset)
+    : buffer_{buffer}, offset_{std::min(offset, buffer.length())} {}
+
+char ReverseTextWalker::next() {
+    if (exhausted()) return '\0';
+    --offset_;
+    if (offset_ < chunk_.offset || offset_ - chunk_.offset >= chunk_.text.size()) {
+        chunk_ = buffer_.chunk_at(offset_);
+    }
+    return chunk_.text[offset_ - chunk_.offset];
+}
+
+char32_t ReverseTextWalker::next_codepoint() {
+    base::ReverseUTF8Decoder decoder;
+    while (!exhausted()) {
+        decoder.put(next());
+
+        if (decoder.done()) {
+            return decoder.value();
+        } else if (decoder.error()) {
+            return 0;
+        }
+    }
+    return decoder.done() ? decoder.value() : 0;
+}
+
+std::string_view to_string(TextBufferBackend backend) {
+    switch (backend) {
+    case TextBufferBackend::kPieceTree:
+        return "piece_tree";
+    case TextBufferBackend::kRope:
+        return "rope";
+    }
+    NOTREACHED();
+}
+
+std::unique_ptr<TextBuffer> make_text_buffer(TextBufferBackend backend, std::string_view txt) {
+    switch (backend) {
+    case TextBufferBackend::kPieceTree:
+        return std::make_unique<PieceTree>(txt);
+    case TextBufferBackend::kRope:
+        return std::make_unique<Rope>(txt);
+    }
+    NOTREACHED();
+}
+
+std::unique_ptr<TextBuffer> make_text_buffer(TextBufferBackend backend,
+                                             std::unique_ptr<base::MemoryMappedFile> file) {
+    switch (backend) {
+    case TextBufferBackend::kPieceTree:
+        return std::make_unique<PieceTree>(std::move(file));
+    case TextBufferBackend::kRope:
+        return std::make_unique<Rope>(file->str());
+    }
+    NOTREACHED();
+}
+
+}  // namespace editor
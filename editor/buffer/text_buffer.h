@@ -0,0 +1,187 @@
+#pragma once
+
+#include "base/files/memory_mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+struct BufferCursor {
+    size_t line{};    // Relative line in the current buffer.
+    size_t column{};  // Column into the current line.
+
+    bool operator==(const BufferCursor&) const = default;
+};
+
+struct LineRange {
+    size_t first{};
+    size_t last{};
+};
+
+// Consecutive lines copied into one buffer, so a screenful of lines costs a single traversal and
+// no per-line allocations. Reusing one instance across `TextBuffer::get_lines()` calls reuses its
+// storage.
+class LineBlock {
+public:
+    size_t first_line() const { return first_line_; }
+    size_t size() const { return ends_.size(); }
+    bool empty() const { return ends_.empty(); }
+    bool contains(size_t line) const { return line - first_line_ < size(); }
+    void clear();
+
+    // Line `i` is line `first_line() + i` of the document.
+    // The document offset where the line starts.
+    size_t offset(size_t i) const { return offset_ + starts_[i]; }
+    // The same as `TextBuffer::get_line_content()`.
+    std::string_view line(size_t i) const;
+    // The same as `TextBuffer::get_line_content_for_layout_use()`.
+    std::string_view line_for_layout_use(size_t i) const;
+
+private:
+    friend class TextBuffer;
+
+    size_t first_line_ = 0;
+    size_t offset_ = 0;
+    // The lines back to back, with each newline replaced by a space.
+    std::string text_;
+    // Where each line starts in `text_`, plus the end of the last line.
+    std::vector<size_t> starts_;
+    // Where the content of each line (excluding the space) ends in `text_`.
+    std::vector<size_t> ends_;
+};
+
+// A contiguous run of the document, starting at `offset`.
+struct TextChunk {
+    size_t offset{};
+    std::string_view text;
+};
+
+// The text storage behind an editor view: what `TextEditWidget`, the movement helpers and search
+// need from a document. Lines are delimited by '\n'. Implemented by `PieceTree`, which reads files
+// in place and keeps cheap snapshots and undo history, and by `Rope`, which keeps the text in
+// fixed-size leaves.
+class TextBuffer {
+public:
+    virtual ~TextBuffer() = default;
+
+    // Manipulation.
+    virtual void insert(size_t offset, std::string_view txt) = 0;
+    virtual void erase(size_t offset, size_t count) = 0;
+
+    // Undo history.
+    // Consecutive typing at the caret (and consecutive backspaces/deletes) coalesce into a single
+    // undo entry. Everything between `begin_transaction()` and the matching `end_transaction()`
+    // forms one entry as well; transactions nest, and only the outermost pair counts.
+    virtual bool undo() = 0;
+    virtual bool redo() = 0;
+    virtual void begin_transaction() = 0;
+    virtual void end_transaction() = 0;
+    // Ends the current coalescing run, so the next edit starts a new undo entry.
+    virtual void break_undo_coalescing() = 0;
+
+    // Metadata.
+    virtual size_t length() const = 0;
+    virtual size_t line_feed_count() const = 0;
+    bool empty() const { return length() == 0; }
+    size_t line_count() const { return line_feed_count() + 1; }
+
+    // Queries.
+    std::string get_line_content(size_t line) const;
+    virtual std::string get_line_content_with_newline(size_t line) const = 0;
+    // This is similar to `get_line_content_with_newline`, except newlines are replaced by spaces.
+    std::string get_line_content_for_layout_use(size_t line) const;
+    // Copies up to `count` lines starting at `first` into `lines` in a single pass.
+    virtual void get_lines(size_t first, size_t count, LineBlock& lines) const;
+    virtual size_t line_at(size_t offset) const = 0;
+    virtual BufferCursor line_column_at(size_t offset) const = 0;
+    virtual size_t offset_at(size_t line, size_t column) const = 0;
+    virtual LineRange get_line_range(size_t line) const = 0;
+    virtual LineRange get_line_range_with_newline(size_t line) const = 0;
+    std::string str() const { return substr(0, length()); }
+    virtual std::string substr(size_t offset, size_t count) const = 0;
+    std::optional<size_t> find(std::string_view txt) const;
+    // The number of codepoints between the start of the line containing `offset` and `offset`.
+    virtual size_t codepoint_column_at(size_t offset) const = 0;
+
+    // Chunk access.
+    // The longest contiguous run of the document that contains `offset`, which must be less than
+    // `length()`.
+    virtual TextChunk chunk_at(size_t offset) const = 0;
+    // Calls `visit` with the text in [first, last) one contiguous run at a time, in order, until
+    // it returns false. Views stay valid until the next edit.
+    virtual void for_each_chunk(size_t first,
+                                size_t last,
+                                const std::function<bool(std::string_view)>& visit) const = 0;
+
+protected:
+    // Fills `lines` with up to `count` lines starting at document offset `offset`, which must be
+    // the start of line `first`.
+    void get_lines_from(size_t first, size_t offset, size_t count, LineBlock& lines) const;
+};
+
+// Reads the buffer one byte or codepoint at a time, from `offset` to the end.
+class TextWalker {
+public:
+    TextWalker(const TextBuffer& buffer, size_t offset = 0);
+
+    char next();
+    char32_t next_codepoint();
+    bool exhausted() const { return offset_ >= length_; }
+    size_t offset() const { return offset_; }
+
+private:
+    const TextBuffer& buffer_;
+    size_t length_;
+    size_t offset_;
+    TextChunk chunk_{};
+};
+
+// The same as `TextWalker`, but from `offset` back to the start.
+class ReverseTextWalker {
+public:
+    ReverseTextWalker(const TextBuffer& buffer, size_t offset);
+
+    char next();
+    char32_t next_codepoint();
+    bool exhausted() const { return offset_ == 0; }
+    size_t offset() const { return offset_; }
+
+private:
+    const TextBuffer& buffer_;
+    size_t offset_;
+    TextChunk chunk_{};
+};
+
+enum class TextBufferBackend { kPieceTree, kRope };
+
+// Selected with the `editor_text_buffer` GN arg.
+#if defined(EDITOR_TEXT_BUFFER_ROPE)
+inline constexpr TextBufferBackend kDefaultTextBufferBackend = TextBufferBackend::kRope;
+#else
+inline constexpr TextBufferBackend kDefaultTextBufferBackend = TextBufferBackend::kPieceTree;
+#endif
+
+std::string_view to_string(TextBufferBackend backend);
+
+std::unique_ptr<TextBuffer> make_text_buffer(TextBufferBackend backend, std::string_view txt);
+// `PieceTree` reads the mapping in place; `Rope` copies it.
+std::unique_ptr<TextBuffer> make_text_buffer(TextBufferBackend backend,
+                                             std::unique_ptr<base::MemoryMappedFile> file);
+
+}  // namespace editor
+
+template <>
+struct std::formatter<editor::LineRange> {
+    constexpr auto parse(std::format_parse_context& ctx) { return ctx.begin(); }
+    template <class FormatContext>
+    auto format(const editor::LineRange& r, FormatContext& ctx) const {
+        return std::format_to(ctx.out(), "[{}..{}]", r.first, r.last);
+    }
+};
@@ -0,0 +1,138 @@
+#include "base/debug/profiler.h"
+#include "base/rand_util.h"
+#include "editor/buffer/text_buffer.h"
+#include "editor/movement.h"
+#include <format>
+#include <gtest/gtest.h>
+
+namespace editor {
+
+namespace {
+
+constexpr size_t N = 100'000;
+
+// About 10 MB in lines of about 50 bytes. Generating random text is slow, so this repeats 1 MB.
+std::string make_10mb_text() {
+    const std::string block = base::rand_string_with_newlines(N * 10, N / 5);
+    std::string text;
+    text.reserve(block.size() * 10);
+    for (int i = 0; i < 10; ++i) text += block;
+    return text;
+}
+
+// Runs the same workloads against every backend, so their numbers can be compared side by side.
+class TextBufferPerfTest : public testing::TestWithParam<TextBufferBackend> {
+protected:
+    std::unique_ptr<TextBuffer> make(std::string_view txt) {
+        return make_text_buffer(GetParam(), txt);
+    }
+
+    base::Profiler profile(std::string_view label) {
+        return base::Profiler{std::format("{} {}", to_string(GetParam()), label)};
+    }
+};
+
+}  // namespace
+
+TEST_P(TextBufferPerfTest, Construction) {
+    const std::string text = make_10mb_text();
+    auto p = profile("construction, 10 MB");
+    auto buffer = make(text);
+    p.stop_mili();
+    EXPECT_EQ(buffer->length(), text.size());
+}
+
+TEST_P(TextBufferPerfTest, SequentialTyping) {
+    auto buffer = make(base::rand_string_with_newlines(N * 10, N / 5));
+    size_t caret = buffer->length() / 2;
+    auto p = profile("sequential typing");
+    for (size_t i = 0; i < N; i++) {
+        buffer->insert(caret, i % 80 == 79 ? "\n" : "a");
+        ++caret;
+    }
+    p.stop_mili();
+    EXPECT_EQ(buffer->length(), N * 11);
+}
+
+TEST_P(TextBufferPerfTest, RandomEdits) {
+    auto buffer = make(base::rand_string_with_newlines(N * 10, N / 5));
+    auto p = profile("random edits");
+    for (size_t i = 0; i < N; i++) {
+        size_t offset = base::rand_int(0, buffer->length() - 1);
+        if (i % 2 == 0) {
+            buffer->insert(offset, "abc\n");
+        } else {
+            buffer->erase(offset, 3);
+        }
+    }
+    p.stop_mili();
+}
+
+TEST_P(TextBufferPerfTest, ScrollVisibleLines) {
+    constexpr size_t kVisibleLines = 100;
+    auto buffer = make(base::rand_string_with_newlines(N * 10, N / 5));
+    for (size_t i = 0; i < N; i++) {
+        buffer->insert(base::rand_int(0, buffer->length()), "abc\n");
+    }
+    const size_t frames = buffer->line_count() - kVisibleLines;
+
+    size_t bytes = 0;
+    LineBlock lines;
+    auto p = profile("scroll, get_lines");
+    for (size_t first = 0; first < frames; first += 7) {
+        buffer->get_lines(first, kVisibleLines, lines);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            bytes += lines.line_for_layout_use(i).size();
+        }
+    }
+    p.stop_mili();
+    EXPECT_GT(bytes, size_t{0});
+}
+
+TEST_P(TextBufferPerfTest, Lookups) {
+    auto buffer = make(base::rand_string_with_newlines(N * 10, N / 5));
+    for (size_t i = 0; i < N; i++) {
+        buffer->insert(base::rand_int(0, buffer->length()), "abc\n");
+    }
+    size_t sum = 0;
+    auto p = profile("random line/offset lookups");
+    for (size_t i = 0; i < N; i++) {
+        sum += buffer->line_column_at(base::rand_int(0, buffer->length())).column;
+        sum += buffer->offset_at(base::rand_int(0, buffer->line_feed_count()), 0);
+    }
+    p.stop_mili();
+    EXPECT_GT(sum, size_t{0});
+}
+
+TEST_P(TextBufferPerfTest, WordMovement) {
+    auto buffer = make(base::rand_string_with_newlines(N * 10, N / 5));
+    size_t offset = 0;
+    size_t moves = 0;
+    auto p = profile("next_word_end() across the document");
+    while (offset < buffer->length()) {
+        size_t next = next_word_end(*buffer, offset);
+        offset = next == offset ? offset + 1 : next;
+        ++moves;
+    }
+    p.stop_mili();
+    EXPECT_GT(moves, size_t{0});
+}
+
+TEST_P(TextBufferPerfTest, Find) {
+    auto buffer = make(make_10mb_text());
+    for (size_t i = 0; i < 1000; i++) {
+        buffer->insert(base::rand_int(0, buffer->length()), "abc\n");
+    }
+    buffer->insert(buffer->length(), "needle");
+    auto p = profile("find at the end, 10 MB");
+    auto result = buffer->find("needle");
+    p.stop_mili();
+    EXPECT_EQ(result, buffer->length() - 6);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         TextBufferPerfTest,
+                         testing::Values(TextBufferBackend::kPieceTree, TextBufferBackend::kRope),
+                         [](const auto& info) { return std::string{to_string(info.param)}; });
+
+}  // namespace editor
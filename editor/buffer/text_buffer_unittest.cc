@@ -0,0 +1,209 @@
+#include "base/rand_util.h"
+#include "editor/buffer/text_buffer.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace editor {
+
+namespace {
+
+class TextBufferTest : public testing::TestWithParam<TextBufferBackend> {
+protected:
+    std::unique_ptr<TextBuffer> make(std::string_view txt) {
+        return make_text_buffer(GetParam(), txt);
+    }
+};
+
+// Checks every query against the same query on `expected`.
+void expect_matches(const TextBuffer& buffer, std::string_view expected) {
+    ASSERT_EQ(buffer.length(), expected.size());
+    ASSERT_EQ(buffer.str(), expected);
+    ASSERT_EQ(buffer.line_feed_count(), static_cast<size_t>(std::ranges::count(expected, '\n')));
+
+    std::vector<size_t> starts{0};
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i] == '\n') starts.push_back(i + 1);
+    }
+    for (size_t line = 0; line < starts.size(); ++line) {
+        size_t first = starts[line];
+        size_t last = line + 1 < starts.size() ? starts[line + 1] - 1 : expected.size();
+        size_t last_with_newline = line + 1 < starts.size() ? starts[line + 1] : expected.size();
+        ASSERT_EQ(buffer.get_line_range(line).first, first);
+        ASSERT_EQ(buffer.get_line_range(line).last, last);
+        ASSERT_EQ(buffer.get_line_range_with_newline(line).last, last_with_newline);
+        ASSERT_EQ(buffer.get_line_content(line), expected.substr(first, last - first));
+        ASSERT_EQ(buffer.get_line_content_with_newline(line),
+                  expected.substr(first, last_with_newline - first));
+        ASSERT_EQ(buffer.offset_at(line, 1), std::min(first + 1, last));
+    }
+
+    for (size_t offset = 0; offset <= expected.size(); ++offset) {
+        size_t line = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), offset) -
+                                          starts.begin()) -
+                      1;
+        ASSERT_EQ(buffer.line_at(offset), line);
+        ASSERT_EQ(buffer.line_column_at(offset), (BufferCursor{line, offset - starts[line]}));
+    }
+
+    std::string chunks;
+    buffer.for_each_chunk(0, buffer.length(), [&](std::string_view chunk) {
+        EXPECT_FALSE(chunk.empty());
+        chunks += chunk;
+        return true;
+    });
+    ASSERT_EQ(chunks, expected);
+    for (size_t offset = 0; offset < expected.size(); offset += 97) {
+        auto chunk = buffer.chunk_at(offset);
+        ASSERT_LE(chunk.offset, offset);
+        ASSERT_LT(offset, chunk.offset + chunk.text.size());
+        ASSERT_EQ(chunk.text, expected.substr(chunk.offset, chunk.text.size()));
+    }
+}
+
+}  // namespace
+
+TEST_P(TextBufferTest, Queries) {
+    auto buffer = make("ab\ncd\n\nef");
+    expect_matches(*buffer, "ab\ncd\n\nef");
+    EXPECT_EQ(buffer->line_count(), size_t{4});
+    EXPECT_EQ(buffer->get_line_content_for_layout_use(1), "cd ");
+    EXPECT_EQ(buffer->get_line_content_for_layout_use(3), "ef");
+    EXPECT_EQ(buffer->substr(4, 100), "d\n\nef");
+    EXPECT_EQ(buffer->find("\nef"), 6);
+    EXPECT_EQ(buffer->find("x"), std::nullopt);
+
+    auto empty = make("");
+    expect_matches(*empty, "");
+    EXPECT_TRUE(empty->empty());
+    EXPECT_EQ(empty->line_count(), size_t{1});
+    EXPECT_EQ(empty->get_line_content(0), "");
+}
+
+TEST_P(TextBufferTest, GetLines) {
+    auto buffer = make("ab\ncd\n\nef");
+    LineBlock lines;
+    buffer->get_lines(1, 10, lines);
+    ASSERT_EQ(lines.size(), size_t{3});
+    EXPECT_EQ(lines.first_line(), size_t{1});
+    EXPECT_EQ(lines.offset(0), size_t{3});
+    EXPECT_EQ(lines.line(0), "cd");
+    EXPECT_EQ(lines.line_for_layout_use(0), "cd ");
+    EXPECT_EQ(lines.line(1), "");
+    EXPECT_EQ(lines.line(2), "ef");
+
+    buffer->get_lines(4, 1, lines);
+    EXPECT_TRUE(lines.empty());
+}
+
+TEST_P(TextBufferTest, CodepointColumn) {
+    auto buffer = make("a\n😄b🙂\nc");
+    EXPECT_EQ(buffer->codepoint_column_at(2), size_t{0});
+    EXPECT_EQ(buffer->codepoint_column_at(6), size_t{1});
+    EXPECT_EQ(buffer->codepoint_column_at(7), size_t{2});
+    EXPECT_EQ(buffer->codepoint_column_at(11), size_t{3});
+    EXPECT_EQ(buffer->codepoint_column_at(13), size_t{1});
+}
+
+TEST_P(TextBufferTest, UndoCoalescing) {
+    auto buffer = make("hello");
+    buffer->insert(5, " ");
+    buffer->insert(6, "w");
+    buffer->insert(7, "orld");
+    buffer->break_undo_coalescing();
+    buffer->erase(10, 1);
+    buffer->erase(9, 1);
+    EXPECT_EQ(buffer->str(), "hello wor");
+
+    EXPECT_TRUE(buffer->undo());
+    EXPECT_EQ(buffer->str(), "hello world");
+    EXPECT_TRUE(buffer->undo());
+    EXPECT_EQ(buffer->str(), "hello");
+    EXPECT_FALSE(buffer->undo());
+    EXPECT_TRUE(buffer->redo());
+    EXPECT_TRUE(buffer->redo());
+    EXPECT_FALSE(buffer->redo());
+    EXPECT_EQ(buffer->str(), "hello wor");
+
+    buffer->begin_transaction();
+    buffer->erase(0, 6);
+    buffer->insert(0, "goodbye ");
+    buffer->end_transaction();
+    EXPECT_EQ(buffer->str(), "goodbye wor");
+    EXPECT_TRUE(buffer->undo());
+    EXPECT_EQ(buffer->str(), "hello wor");
+}
+
+TEST_P(TextBufferTest, Walkers) {
+    // Long enough to span several rope leaves, and edited so the piece tree has several pieces.
+    std::string expected;
+    for (int i = 0; i < 2000; ++i) expected += "a😄 ";
+    auto buffer = make(expected);
+    // Back to front, so earlier codepoint boundaries stay put.
+    for (size_t offset = expected.size(); offset >= 6 * 166; offset -= 6 * 166) {
+        buffer->insert(offset, "é");
+        expected.insert(offset, "é");
+    }
+
+    TextWalker walker{*buffer};
+    ReverseTextWalker reverse_walker{*buffer, buffer->length()};
+    std::u32string forward;
+    std::u32string backward;
+    while (!walker.exhausted()) forward += walker.next_codepoint();
+    while (!reverse_walker.exhausted()) backward += reverse_walker.next_codepoint();
+    EXPECT_EQ(walker.offset(), expected.size());
+    EXPECT_EQ(reverse_walker.offset(), size_t{0});
+    std::ranges::reverse(backward);
+    EXPECT_EQ(forward, backward);
+    EXPECT_EQ(forward.size(), buffer->codepoint_column_at(buffer->length()));
+
+    TextWalker byte_walker{*buffer, 5};
+    std::string bytes;
+    while (!byte_walker.exhausted()) bytes += byte_walker.next();
+    EXPECT_EQ(bytes, expected.substr(5));
+}
+
+TEST_P(TextBufferTest, RandomEdits) {
+    std::string expected = base::rand_string_with_newlines(20000, 400);
+    auto buffer = make(expected);
+    std::vector<std::string> history{expected};
+    size_t position = 0;
+
+    for (int i = 0; i < 300; ++i) {
+        int action = base::rand_int(0, 9);
+        if (action == 0 && position > 0) {
+            ASSERT_TRUE(buffer->undo());
+            expected = history[--position];
+        } else if (action == 1 && position + 1 < history.size()) {
+            ASSERT_TRUE(buffer->redo());
+            expected = history[++position];
+        } else {
+            buffer->break_undo_coalescing();
+            size_t offset = base::rand_int(0, static_cast<int>(expected.size()));
+            if (action % 2 == 0) {
+                // Sometimes insert more than a whole rope leaf.
+                size_t length = base::rand_int(0, 9) == 0 ? 6000 : base::rand_int(1, 30);
+                std::string txt = base::rand_string_with_newlines(length, length / 10);
+                buffer->insert(offset, txt);
+                expected.insert(offset, txt);
+            } else {
+                size_t count = base::rand_int(0, 9) == 0 ? 8000 : base::rand_int(1, 30);
+                buffer->erase(offset, count);
+                expected.erase(offset, count);
+            }
+            // Erasing at the end is a no-op, which leaves no undo entry.
+            if (expected != history[position]) {
+                history.resize(++position);
+                history.push_back(expected);
+            }
+        }
+        ASSERT_EQ(buffer->str(), expected);
+    }
+    expect_matches(*buffer, expected);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         TextBufferTest,
+                         testing::Values(TextBufferBackend::kPieceTree, TextBufferBackend::kRope),
+                         [](const auto& info) { return std::string{to_string(info.param)}; });
+
+}  // namespace editor
@@ -0,0 +1,118 @@
+#include "base/check.h"
+#include "base/compiler_specific.h"
+#include "editor/buffer/text_metrics.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace editor {
+
+namespace {
+
+bool is_continuation(uint8_t byte) { return (byte & 0xC0) == 0x80; }
+
+// UTF-16 code units taken by the codepoint starting with `byte`.
+size_t utf16_cost(uint8_t byte) { return byte >= 0xF0 ? 2 : 1; }
+
+// Adds up the eight byte lanes of `lanes`.
+size_t sum_lanes(uint64_t lanes) {
+    constexpr uint64_t kLowBytes = 0x00FF00FF00FF00FF;
+    uint64_t pairs = (lanes & kLowBytes) + ((lanes >> 8) & kLowBytes);
+    return static_cast<size_t>((pairs * 0x0001000100010001) >> 48);
+}
+
+}  // namespace
+
+TextMetrics count_text_metrics(std::string_view text) {
+    // Eight bytes at a time: a byte is a continuation iff its top bits are 10, and a 4-byte lead
+    // iff its top four bits are set. Shifting left moves each byte's lower bits into its own top
+    // bit, and the matches are counted per byte lane. A lane overflows after 255 words.
+    constexpr uint64_t kHighBits = 0x8080808080808080;
+    size_t continuations = 0;
+    size_t four_byte_leads = 0;
+    size_t i = 0;
+    while (i + 8 <= text.size()) {
+        uint64_t continuation_lanes = 0;
+        uint64_t four_byte_lanes = 0;
+        size_t end = std::min(text.size() - 7, i + 255 * 8);
+        for (; i < end; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, UNSAFE_TODO(text.data() + i), sizeof(word));
+            continuation_lanes += (word & ~(word << 1) & kHighBits) >> 7;
+            four_byte_lanes += (word & (word << 1) & (word << 2) & (word << 3) & kHighBits) >> 7;
+        }
+        continuations += sum_lanes(continuation_lanes);
+        four_byte_leads += sum_lanes(four_byte_lanes);
+    }
+    for (; i < text.size(); ++i) {
+        uint8_t byte = static_cast<uint8_t>(text[i]);
+        continuations += is_continuation(byte);
+        four_byte_leads += byte >= 0xF0;
+    }
+    size_t codepoints = text.size() - continuations;
+    return {.codepoints = codepoints, .utf16_units = codepoints + four_byte_leads};
+}
+
+std::vector<TextMetrics> index_text_metrics(std::string_view text) {
+    std::vector<TextMetrics> blocks;
+    blocks.reserve(text.size() / kMetricsBlockSize + 1);
+    blocks.push_back({});
+    for (size_t start = 0; start + kMetricsBlockSize <= text.size(); start += kMetricsBlockSize) {
+        auto block = count_text_metrics(text.substr(start, kMetricsBlockSize));
+        blocks.push_back(blocks.back() + block);
+    }
+    return blocks;
+}
+
+TextMetrics text_metrics_at(std::string_view text,
+                            std::span<const TextMetrics> blocks,
+                            size_t offset) {
+    DCHECK_LE(offset, text.size());
+    size_t block = offset / kMetricsBlockSize;
+    size_t block_start = block * kMetricsBlockSize;
+    size_t block_end = block_start + kMetricsBlockSize;
+    // Count from whichever boundary is nearer.
+    if (offset - block_start > kMetricsBlockSize / 2 && block + 1 < blocks.size() &&
+        block_end <= text.size()) {
+        return blocks[block + 1] - count_text_metrics(text.substr(offset, block_end - offset));
+    }
+    return blocks[block] + count_text_metrics(text.substr(block_start, offset - block_start));
+}
+
+size_t utf16_offset_in_text(std::string_view text,
+                            std::span<const TextMetrics> blocks,
+                            size_t first,
+                            size_t units) {
+    DCHECK_LE(first, text.size());
+    size_t target = text_metrics_at(text, blocks, first).utf16_units + units;
+
+    // No codepoint that starts before a block boundary whose prefix is within the target can
+    // overshoot it, so the scan can start at the last such boundary.
+    size_t first_block = first / kMetricsBlockSize;
+    size_t last_block = std::min(blocks.size(), text.size() / kMetricsBlockSize + 1);
+    auto it = std::upper_bound(blocks.begin() + first_block + 1, blocks.begin() + last_block,
+                               target, [](size_t target, const TextMetrics& metrics) {
+                                   return target < metrics.utf16_units;
+                               });
+    size_t block = static_cast<size_t>(it - blocks.begin()) - 1;
+    size_t offset = std::max(first, block * kMetricsBlockSize);
+    size_t count = offset == first ? target - units : blocks[block].utf16_units;
+
+    // Skip runs that end within the target, then find the codepoint that reaches it.
+    constexpr size_t kRun = 64;
+    while (offset + kRun <= text.size()) {
+        size_t run_units = count_text_metrics(text.substr(offset, kRun)).utf16_units;
+        if (count + run_units > target) break;
+        count += run_units;
+        offset += kRun;
+    }
+    for (; offset < text.size(); ++offset) {
+        uint8_t byte = static_cast<uint8_t>(text[offset]);
+        if (is_continuation(byte)) continue;
+        if (count + utf16_cost(byte) > target) return offset;
+        count += utf16_cost(byte);
+    }
+    return text.size();
+}
+
+}  // namespace editor
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+// Codepoint and UTF-16 code unit counts of a run of UTF-8 text.
+//
+// Both are derived from byte classes alone: every byte other than a continuation byte starts a
+// codepoint, and codepoints with a 4-byte lead take a surrogate pair. Counts of adjacent runs
+// therefore add up even where a boundary splits a sequence. For valid UTF-8 they match what a
+// decoder reports; a stray continuation byte counts as nothing rather than as U+FFFD.
+struct TextMetrics {
+    size_t codepoints = 0;
+    size_t utf16_units = 0;
+
+    TextMetrics& operator+=(const TextMetrics& other) {
+        codepoints += other.codepoints;
+        utf16_units += other.utf16_units;
+        return *this;
+    }
+    friend TextMetrics operator+(TextMetrics a, const TextMetrics& b) { return a += b; }
+    friend TextMetrics operator-(const TextMetrics& a, const TextMetrics& b) {
+        return {a.codepoints - b.codepoints, a.utf16_units - b.utf16_units};
+    }
+    bool operator==(const TextMetrics&) const = default;
+};
+
+TextMetrics count_text_metrics(std::string_view text);
+
+// Buffers record the metrics of their prefix at every multiple of this many bytes, so the metrics
+// at any offset cost one lookup plus a scan of at most one block.
+inline constexpr size_t kMetricsBlockSize = 4096;
+
+// Returns the metrics of `text[0, i * kMetricsBlockSize)` for every block boundary `i` within
+// `text`, starting with an empty entry for offset 0.
+std::vector<TextMetrics> index_text_metrics(std::string_view text);
+
+// The metrics of `text[0, offset)`, given the block index of `text`. Only the entries for
+// boundaries up to `offset` are read.
+TextMetrics text_metrics_at(std::string_view text,
+                            std::span<const TextMetrics> blocks,
+                            size_t offset);
+
+// The smallest offset `o` in `[first, text.size()]` such that `text[first, o)` holds at least
+// `units` UTF-16 code units, or `text.size()` if there is no such offset. A target that falls
+// between the two halves of a surrogate pair resolves to the start of that codepoint.
+size_t utf16_offset_in_text(std::string_view text,
+                            std::span<const TextMetrics> blocks,
+                            size_t first,
+                            size_t units);
+
+}  // namespace editor
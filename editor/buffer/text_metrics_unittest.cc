@@ -0,0 +1,65 @@
+#include "editor/buffer/text_metrics.h"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace editor {
+
+TEST(TextMetricsTest, CountsCodepointsAndUtf16Units) {
+    EXPECT_EQ(count_text_metrics(""), (TextMetrics{0, 0}));
+    EXPECT_EQ(count_text_metrics("abc\n"), (TextMetrics{4, 4}));
+    // 2-, 3- and 4-byte sequences.
+    EXPECT_EQ(count_text_metrics("é"), (TextMetrics{1, 1}));
+    EXPECT_EQ(count_text_metrics("€"), (TextMetrics{1, 1}));
+    EXPECT_EQ(count_text_metrics("😀"), (TextMetrics{1, 2}));
+    EXPECT_EQ(count_text_metrics("a😀b€"), (TextMetrics{4, 5}));
+}
+
+// Counts of adjacent runs add up, even where a boundary splits a sequence.
+TEST(TextMetricsTest, SplitCountsAddUp) {
+    std::string_view text = "x😀y";
+    for (size_t i = 0; i <= text.size(); ++i) {
+        EXPECT_EQ(count_text_metrics(text.substr(0, i)) + count_text_metrics(text.substr(i)),
+                  count_text_metrics(text));
+    }
+}
+
+TEST(TextMetricsTest, BlockIndex) {
+    std::string text;
+    while (text.size() < kMetricsBlockSize * 3 + 100) text += "a😀é€";
+    auto blocks = index_text_metrics(text);
+    ASSERT_EQ(blocks.size(), text.size() / kMetricsBlockSize + 1);
+
+    for (size_t offset : {size_t{0}, size_t{1}, kMetricsBlockSize - 1, kMetricsBlockSize,
+                          kMetricsBlockSize * 2 + 7, text.size()}) {
+        EXPECT_EQ(text_metrics_at(text, blocks, offset),
+                  count_text_metrics(std::string_view(text).substr(0, offset)));
+    }
+}
+
+TEST(TextMetricsTest, Utf16Offset) {
+    std::string text;
+    while (text.size() < kMetricsBlockSize * 3) text += "a😀é€";
+    auto blocks = index_text_metrics(text);
+
+    // Walk every codepoint boundary from a few starting points.
+    for (size_t first : {size_t{0}, size_t{5}, kMetricsBlockSize + 1}) {
+        size_t units = 0;
+        for (size_t offset = first; offset <= text.size(); ++offset) {
+            if (offset < text.size() && (static_cast<uint8_t>(text[offset]) & 0xC0) == 0x80) {
+                continue;
+            }
+            EXPECT_EQ(utf16_offset_in_text(text, blocks, first, units), offset);
+            if (offset == text.size()) break;
+            // Halfway through a surrogate pair resolves to the start of the codepoint.
+            if (static_cast<uint8_t>(text[offset]) >= 0xF0) {
+                EXPECT_EQ(utf16_offset_in_text(text, blocks, first, units + 1), offset);
+                units += 2;
+            } else {
+                units += 1;
+            }
+        }
+        EXPECT_EQ(utf16_offset_in_text(text, blocks, first, units + 100), text.size());
+    }
+}
+
+}  // namespace editor
@@ -301,4 +301,65 @@ TEST(TreeWalkerTest, ReverseWalkerConsistency) {
     EXPECT_EQ(codepoints, expected);
 }
 
+namespace {
+// A tree holding "0123456789" split into the pieces "012", "3456", "789".
+PieceTree make_three_piece_tree() {
+    PieceTree tree;
+    tree.insert(0, "789");
+    tree.insert(0, "3456");
+    tree.insert(0, "012");
+    return tree;
+}
+}  // namespace
+
+TEST(TreeWalkerTest, ChunkIteratorYieldsPieces) {
+    auto tree = make_three_piece_tree();
+    ChunkIterator chunks{tree};
+    EXPECT_EQ(chunks.next(), "012");
+    EXPECT_EQ(chunks.offset(), 3);
+    EXPECT_EQ(chunks.next(), "3456");
+    EXPECT_EQ(chunks.next(), "789");
+    EXPECT_TRUE(chunks.exhausted());
+    EXPECT_EQ(chunks.next(), "");
+
+    ReverseChunkIterator reverse_chunks{tree};
+    EXPECT_EQ(reverse_chunks.next(), "789");
+    EXPECT_EQ(reverse_chunks.offset(), 7);
+    EXPECT_EQ(reverse_chunks.next(), "3456");
+    EXPECT_EQ(reverse_chunks.next(), "012");
+    EXPECT_TRUE(reverse_chunks.exhausted());
+    EXPECT_EQ(reverse_chunks.next(), "");
+
+    PieceTree empty;
+    EXPECT_TRUE(ChunkIterator{empty}.exhausted());
+    EXPECT_TRUE(ReverseChunkIterator{empty}.exhausted());
+}
+
+// Every range comes back exactly, whichever pieces it starts and ends in.
+TEST(TreeWalkerTest, ChunkIteratorClipsToRange) {
+    auto tree = make_three_piece_tree();
+    const std::string str = "0123456789";
+    for (size_t first = 0; first <= str.size(); ++first) {
+        for (size_t last = first; last <= str.size() + 1; ++last) {
+            std::string forward;
+            ChunkIterator chunks{tree, first, last};
+            while (!chunks.exhausted()) {
+                auto chunk = chunks.next();
+                EXPECT_FALSE(chunk.empty());
+                forward += chunk;
+            }
+            EXPECT_EQ(forward, str.substr(first, last - first));
+
+            std::string reverse;
+            ReverseChunkIterator reverse_chunks{tree, first, last};
+            while (!reverse_chunks.exhausted()) {
+                auto chunk = reverse_chunks.next();
+                EXPECT_FALSE(chunk.empty());
+                reverse.insert(0, chunk);
+            }
+            EXPECT_EQ(reverse, str.substr(first, last - first));
+        }
+    }
+}
+
 }  // namespace editor
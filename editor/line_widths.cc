@@ -0,0 +1,187 @@
+#include "base/check.h"
+#include "base/numeric/safe_conversions.h"
+#include "editor/line_widths.h"
+#include <algorithm>
+#include <cstring>
+
+namespace editor {
+
+int LineWidths::get(size_t line) const {
+    DCHECK_LT(line, size());
+    uint32_t node = root_;
+    while (true) {
+        const auto& n = nodes_[node];
+        size_t left_size = n.left == kNil ? 0 : nodes_[n.left].size;
+        if (line < left_size) {
+            node = n.left;
+        } else if (line == left_size) {
+            return n.width;
+        } else {
+            line -= left_size + 1;
+            node = n.right;
+        }
+    }
+}
+
+void LineWidths::assign(std::span<const int> widths) {
+    nodes_.clear();
+    free_list_.clear();
+    root_ = build(widths);
+}
+
+void LineWidths::set(size_t line, int width) {
+    DCHECK_LT(line, size());
+    set_in(root_, line, width);
+}
+
+void LineWidths::replace(size_t first, size_t count, std::span<const int> widths) {
+    DCHECK_LE(first + count, size());
+    auto [left, rest] = split(root_, first);
+    auto [removed, right] = split(rest, count);
+    free_tree(removed);
+    root_ = merge(merge(left, build(widths)), right);
+}
+
+uint32_t LineWidths::new_node(int width) {
+    // xorshift32: the priorities only need to be unpredictable to the shape of the input.
+    rng_state_ ^= rng_state_ << 13;
+    rng_state_ ^= rng_state_ >> 17;
+    rng_state_ ^= rng_state_ << 5;
+    Node node{.width = width, .max = width, .size = 1, .priority = rng_state_};
+
+    if (!free_list_.empty()) {
+        uint32_t index = free_list_.back();
+        free_list_.pop_back();
+        nodes_[index] = node;
+        return index;
+    }
+    CHECK_LT(nodes_.size(), size_t{kNil});
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void LineWidths::free_tree(uint32_t node) {
+    if (node == kNil) return;
+    free_tree(nodes_[node].left);
+    free_tree(nodes_[node].right);
+    free_list_.push_back(node);
+}
+
+bool LineWidths::set_in(uint32_t node, size_t line, int width) {
+    auto& n = nodes_[node];
+    size_t left_size = n.left == kNil ? 0 : nodes_[n.left].size;
+    bool changed;
+    if (line < left_size) {
+        changed = set_in(n.left, line, width);
+    } else if (line == left_size) {
+        changed = n.width != width;
+        n.width = width;
+    } else {
+        changed = set_in(n.right, line - left_size - 1, width);
+    }
+    if (changed) update(node);
+    return changed;
+}
+
+void LineWidths::update(uint32_t node) {
+    auto& n = nodes_[node];
+    n.size = 1;
+    n.max = n.width;
+    if (n.left != kNil) {
+        n.size += nodes_[n.left].size;
+        n.max = std::max(n.max, nodes_[n.left].max);
+    }
+    if (n.right != kNil) {
+        n.size += nodes_[n.right].size;
+        n.max = std::max(n.max, nodes_[n.right].max);
+    }
+}
+
+uint32_t LineWidths::build(std::span<const int> widths) {
+    // The usual Cartesian tree construction: keep the right spine on a stack, and hang whatever
+    // a new node outranks off its left. A node leaves the spine only once both of its subtrees are
+    // final, so its size and maximum can be computed then.
+    std::vector<uint32_t> spine;
+    for (int width : widths) {
+        uint32_t node = new_node(width);
+        uint32_t last = kNil;
+        while (!spine.empty() && nodes_[spine.back()].priority < nodes_[node].priority) {
+            last = spine.back();
+            spine.pop_back();
+            update(last);
+        }
+        nodes_[node].left = last;
+        if (!spine.empty()) nodes_[spine.back()].right = node;
+        spine.push_back(node);
+    }
+    if (spine.empty()) return kNil;
+    for (auto it = spine.rbegin(); it != spine.rend(); ++it) {
+        update(*it);
+    }
+    return spine.front();
+}
+
+std::pair<uint32_t, uint32_t> LineWidths::split(uint32_t node, size_t count) {
+    if (node == kNil) return {kNil, kNil};
+    auto& n = nodes_[node];
+    size_t left_size = n.left == kNil ? 0 : nodes_[n.left].size;
+    if (count <= left_size) {
+        auto [left, right] = split(n.left, count);
+        nodes_[node].left = right;
+        update(node);
+        return {left, node};
+    } else {
+        auto [left, right] = split(n.right, count - left_size - 1);
+        nodes_[node].right = left;
+        update(node);
+        return {node, right};
+    }
+}
+
+uint32_t LineWidths::merge(uint32_t left, uint32_t right) {
+    if (left == kNil) return right;
+    if (right == kNil) return left;
+    if (nodes_[left].priority > nodes_[right].priority) {
+        nodes_[left].right = merge(nodes_[left].right, right);
+        update(left);
+        return left;
+    } else {
+        nodes_[right].left = merge(left, nodes_[right].left);
+        update(right);
+        return right;
+    }
+}
+
+std::vector<int> estimate_line_widths(const TextBuffer& buffer,
+                                      size_t first,
+                                      size_t count,
+                                      int char_width) {
+    std::vector<int> widths;
+    widths.reserve(count);
+    auto to_width = [&](size_t length) {
+        return base::saturated_cast<int>(static_cast<double>(length) * char_width);
+    };
+
+    size_t length = 0;
+    size_t offset = buffer.get_line_range(first).first;
+    buffer.for_each_chunk(offset, buffer.length(), [&](std::string_view chunk) {
+        while (widths.size() < count) {
+            const void* newline = std::memchr(chunk.data(), '\n', chunk.size());
+            if (!newline) {
+                length += chunk.size();
+                break;
+            }
+            size_t n = static_cast<size_t>(static_cast<const char*>(newline) - chunk.data());
+            widths.push_back(to_width(length + n));
+            length = 0;
+            chunk.remove_prefix(n + 1);
+        }
+        return widths.size() < count;
+    });
+    // The last line has no newline.
+    if (widths.size() < count) widths.push_back(to_width(length));
+    DCHECK_EQ(widths.size(), count);
+    return widths;
+}
+
+}  // namespace editor
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "editor/buffer/text_buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace editor {
+
+// The width of every line in a document, kept so that the widest one is known without laying out
+// every line.
+//
+// Widths are stored by line index in an implicit treap whose nodes also hold the maximum of their
+// subtree. Reading the maximum is O(1). Setting a width is O(log n), and replacing a run of lines
+// after an edit is O(log n) plus the number of lines replaced.
+class LineWidths {
+public:
+    size_t size() const { return root_ == kNil ? 0 : nodes_[root_].size; }
+    // The widest line, or 0 if there are no lines.
+    int max() const { return root_ == kNil ? 0 : nodes_[root_].max; }
+    int get(size_t line) const;
+
+    void assign(std::span<const int> widths);
+    void set(size_t line, int width);
+    // Replaces the `count` lines starting at `first` with `widths`.
+    void replace(size_t first, size_t count, std::span<const int> widths);
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Node {
+        int width;
+        int max;
+        size_t size;
+        uint32_t priority;
+        uint32_t left = kNil;
+        uint32_t right = kNil;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_list_;
+    uint32_t root_ = kNil;
+    uint32_t rng_state_ = 0x9E3779B9;
+
+    uint32_t new_node(int width);
+    void free_tree(uint32_t node);
+    // Sets the width of `line` within the subtree at `node`, and returns whether it changed.
+    bool set_in(uint32_t node, size_t line, int width);
+    void update(uint32_t node);
+    // Builds a treap over `widths` in order, in linear time.
+    uint32_t build(std::span<const int> widths);
+    // Splits `node` into its first `count` lines and the rest.
+    std::pair<uint32_t, uint32_t> split(uint32_t node, size_t count);
+    uint32_t merge(uint32_t left, uint32_t right);
+};
+
+// Estimates the width of `count` lines starting at `first` as their length in bytes, excluding
+// the newline, times `char_width`. All lines are read in a single pass over the text.
+std::vector<int> estimate_line_widths(const TextBuffer& buffer,
+                                      size_t first,
+                                      size_t count,
+                                      int char_width);
+
+}  // namespace editor
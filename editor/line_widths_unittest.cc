@@ -0,0 +1,82 @@
+#include "base/rand_util.h"
+#include "editor/buffer/piece_tree.h"
+#include "editor/line_widths.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+namespace editor {
+
+namespace {
+
+void expect_matches(const LineWidths& widths, const std::vector<int>& expected) {
+    ASSERT_EQ(widths.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(widths.get(i), expected[i]);
+    }
+    EXPECT_EQ(widths.max(), expected.empty() ? 0 : std::ranges::max(expected));
+}
+
+}  // namespace
+
+TEST(LineWidthsTest, Basic) {
+    LineWidths widths;
+    EXPECT_EQ(widths.size(), size_t{0});
+    EXPECT_EQ(widths.max(), 0);
+
+    widths.assign(std::vector{3, 9, 4});
+    expect_matches(widths, {3, 9, 4});
+
+    widths.set(1, 2);
+    expect_matches(widths, {3, 2, 4});
+
+    // Split one line into three, then join them back.
+    widths.replace(1, 1, std::vector{1, 7, 5});
+    expect_matches(widths, {3, 1, 7, 5, 4});
+    widths.replace(1, 3, std::vector{6});
+    expect_matches(widths, {3, 6, 4});
+
+    widths.replace(0, 3, {});
+    expect_matches(widths, {});
+}
+
+TEST(LineWidthsTest, RandomEdits) {
+    std::vector<int> expected(1000);
+    for (int& width : expected) width = base::rand_int(0, 1000);
+    LineWidths widths;
+    widths.assign(expected);
+
+    for (size_t i = 0; i < 2000; ++i) {
+        if (!expected.empty() && base::rand_int(0, 1) == 0) {
+            size_t line = base::rand_int(0, static_cast<int>(expected.size()) - 1);
+            int width = base::rand_int(0, 2000);
+            widths.set(line, width);
+            expected[line] = width;
+        } else {
+            int size = static_cast<int>(expected.size());
+            size_t first = base::rand_int(0, size);
+            size_t count = base::rand_int(0, std::min(3, size - static_cast<int>(first)));
+            std::vector<int> lines(base::rand_int(count == 0 ? 1 : 0, 3));
+            for (int& width : lines) width = base::rand_int(0, 2000);
+            widths.replace(first, count, lines);
+            expected.erase(expected.begin() + first, expected.begin() + first + count);
+            expected.insert(expected.begin() + first, lines.begin(), lines.end());
+        }
+        ASSERT_EQ(widths.size(), expected.size());
+        ASSERT_EQ(widths.max(), expected.empty() ? 0 : std::ranges::max(expected));
+    }
+    expect_matches(widths, expected);
+}
+
+TEST(LineWidthsTest, EstimateLineWidths) {
+    PieceTree tree{"ab\n\nabcd\nxyz"};
+    tree.insert(6, "\n12345");
+    // "ab\n\nab\n12345cd\nxyz"
+    EXPECT_EQ(estimate_line_widths(tree, 0, tree.line_count(), 10),
+              (std::vector{20, 0, 20, 70, 30}));
+    EXPECT_EQ(estimate_line_widths(tree, 2, 2, 1), (std::vector{2, 7}));
+    EXPECT_EQ(estimate_line_widths(tree, 4, 1, 1), (std::vector{3}));
+    EXPECT_EQ(estimate_line_widths(PieceTree{}, 0, 1, 1), (std::vector{0}));
+    EXPECT_EQ(estimate_line_widths(PieceTree{"a\n"}, 0, 2, 1), (std::vector{1, 0}));
+}
+
+}  // namespace editor
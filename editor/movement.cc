@@ -80,8 +80,8 @@ size_t move_to_next_glyph(const font::LineLayout& layout, size_t col) {
     }
 }
 
-size_t prev_word_start(const PieceTree& tree, size_t offset) {
-    ReverseTreeWalker reverse_walker{tree, offset};
+size_t prev_word_start(const TextBuffer& buffer, size_t offset) {
+    ReverseTextWalker reverse_walker{buffer, offset};
 
     std::optional<int32_t> prev_cp;
     size_t prev_offset = offset;
@@ -109,8 +109,8 @@ size_t prev_word_start(const PieceTree& tree, size_t offset) {
     return prev_offset;
 }
 
-size_t next_word_end(const PieceTree& tree, size_t offset) {
-    TreeWalker walker{tree, offset};
+size_t next_word_end(const TextBuffer& buffer, size_t offset) {
+    TextWalker walker{buffer, offset};
 
     std::optional<int32_t> prev_cp;
     size_t prev_offset = offset;
@@ -138,9 +138,9 @@ size_t next_word_end(const PieceTree& tree, size_t offset) {
     return prev_offset;
 }
 
-std::pair<size_t, size_t> surrounding_word(const PieceTree& tree, size_t offset) {
-    auto walker = TreeWalker{tree, offset};
-    auto reverse_walker = ReverseTreeWalker{tree, offset};
+std::pair<size_t, size_t> surrounding_word(const TextBuffer& buffer, size_t offset) {
+    auto walker = TextWalker{buffer, offset};
+    auto reverse_walker = ReverseTextWalker{buffer, offset};
 
     // TODO: Implement peek so we don't need to reset the walkers below.
     // `std::max` just means we prioritize words, then punctuation, then whitespace.
@@ -150,7 +150,7 @@ std::pair<size_t, size_t> surrounding_word(const PieceTree& tree, size_t offset)
     size_t start = offset;
     size_t end = offset;
     // TODO: Implement peek so we don't need to reset the walker here.
-    auto reverse_walker2 = ReverseTreeWalker{tree, offset};
+    auto reverse_walker2 = ReverseTextWalker{buffer, offset};
     while (!reverse_walker2.exhausted()) {
         int32_t cp = reverse_walker2.next_codepoint();
         size_t offset = reverse_walker2.offset();
@@ -163,7 +163,7 @@ std::pair<size_t, size_t> surrounding_word(const PieceTree& tree, size_t offset)
         }
     }
     // TODO: Implement peek so we don't need to reset the walker here.
-    auto walker2 = TreeWalker{tree, offset};
+    auto walker2 = TextWalker{buffer, offset};
     while (!walker2.exhausted()) {
         int32_t cp = walker2.next_codepoint();
         size_t offset = walker2.offset();
@@ -178,9 +178,9 @@ std::pair<size_t, size_t> surrounding_word(const PieceTree& tree, size_t offset)
     return {start, end};
 }
 
-bool is_inside_word(const PieceTree& tree, size_t offset) {
-    auto walker = TreeWalker{tree, offset};
-    auto reverse_walker = ReverseTreeWalker{tree, offset};
+bool is_inside_word(const TextBuffer& buffer, size_t offset) {
+    auto walker = TextWalker{buffer, offset};
+    auto reverse_walker = ReverseTextWalker{buffer, offset};
     auto prev_kind = to_kind(reverse_walker.next_codepoint());
     auto next_kind = to_kind(walker.next_codepoint());
     return prev_kind == CharKind::kWord && next_kind == CharKind::kWord;
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "editor/buffer/piece_tree.h"
+#include "editor/buffer/text_buffer.h"
 #include "font/types.h"
 #include <cstddef>
 
@@ -16,10 +16,10 @@ size_t move_to_next_glyph(const font::LineLayout& layout, size_t col);
 
 // These return *offsets*.
 // TODO: Make documentation more clear. Consider using type aliases.
-size_t prev_word_start(const PieceTree& tree, size_t offset);
-size_t next_word_end(const PieceTree& tree, size_t offset);
+size_t prev_word_start(const TextBuffer& buffer, size_t offset);
+size_t next_word_end(const TextBuffer& buffer, size_t offset);
 // TODO: Make a `Pair` type.
-std::pair<size_t, size_t> surrounding_word(const PieceTree& tree, size_t offset);
-bool is_inside_word(const PieceTree& tree, size_t offset);
+std::pair<size_t, size_t> surrounding_word(const TextBuffer& buffer, size_t offset);
+bool is_inside_word(const TextBuffer& buffer, size_t offset);
 
 }  // namespace editor
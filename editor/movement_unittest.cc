@@ -10,6 +10,14 @@ font::LineLayout CreateLayout(std::string_view str) {
     size_t font_id = rasterizer.add_system_font(32);
     return rasterizer.layout_line(font_id, str);
 }
+
+// Word movement only reads the buffer through `TextBuffer`, so it runs against every backend.
+class MovementWordTest : public testing::TestWithParam<TextBufferBackend> {
+protected:
+    std::unique_ptr<TextBuffer> make(std::string_view txt) {
+        return make_text_buffer(GetParam(), txt);
+    }
+};
 }  // namespace
 
 TEST(MovementTest, ColumnAtX) {
@@ -52,20 +60,6 @@ TEST(MovementTest, PreventMovingByGlyphAtBeginningOrEnd) {
     }
 }
 
-// Ensure moving while at the beginning/end does nothing.
-TEST(MovementTest, PreventMovingByWordAtBeginningOrEnd) {
-    PieceTree tree1{"abc🙂def"};
-    for (int i = 0; i < 10; ++i) {
-        EXPECT_EQ(prev_word_start(tree1, 0), size_t{0});
-        EXPECT_EQ(next_word_end(tree1, tree1.length()), tree1.length());
-    }
-    PieceTree tree2{""};
-    for (int i = 0; i < 10; ++i) {
-        EXPECT_EQ(prev_word_start(tree2, 0), size_t{0});
-        EXPECT_EQ(next_word_end(tree2, 0), size_t{0});
-    }
-}
-
 TEST(MovementTest, MoveToPrevGlyph) {
     auto layout = CreateLayout("abc🙂def");
     EXPECT_EQ(move_to_prev_glyph(layout, layout.length), size_t{1});      // f
@@ -90,44 +84,63 @@ TEST(MovementTest, MoveToNextGlyph) {
     EXPECT_EQ(move_to_next_glyph(layout, 10), size_t{0});
 }
 
-TEST(MovementTest, PrevWordStart1) {
-    PieceTree tree{"abc🙂def"};
-    EXPECT_EQ(prev_word_start(tree, 10), size_t{7});
-    EXPECT_EQ(prev_word_start(tree, 9), size_t{7});
-    EXPECT_EQ(prev_word_start(tree, 8), size_t{7});
-    EXPECT_EQ(prev_word_start(tree, 7), size_t{3});
-    EXPECT_EQ(prev_word_start(tree, 3), size_t{0});
-    EXPECT_EQ(prev_word_start(tree, 2), size_t{0});
-    EXPECT_EQ(prev_word_start(tree, 1), size_t{0});
-    EXPECT_EQ(prev_word_start(tree, 0), size_t{0});
+// Ensure moving while at the beginning/end does nothing.
+TEST_P(MovementWordTest, PreventMovingByWordAtBeginningOrEnd) {
+    auto buffer1 = make("abc🙂def");
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(prev_word_start(*buffer1, 0), size_t{0});
+        EXPECT_EQ(next_word_end(*buffer1, buffer1->length()), buffer1->length());
+    }
+    auto buffer2 = make("");
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(prev_word_start(*buffer2, 0), size_t{0});
+        EXPECT_EQ(next_word_end(*buffer2, 0), size_t{0});
+    }
+}
+
+TEST_P(MovementWordTest, PrevWordStart1) {
+    auto buffer = make("abc🙂def");
+    EXPECT_EQ(prev_word_start(*buffer, 10), size_t{7});
+    EXPECT_EQ(prev_word_start(*buffer, 9), size_t{7});
+    EXPECT_EQ(prev_word_start(*buffer, 8), size_t{7});
+    EXPECT_EQ(prev_word_start(*buffer, 7), size_t{3});
+    EXPECT_EQ(prev_word_start(*buffer, 3), size_t{0});
+    EXPECT_EQ(prev_word_start(*buffer, 2), size_t{0});
+    EXPECT_EQ(prev_word_start(*buffer, 1), size_t{0});
+    EXPECT_EQ(prev_word_start(*buffer, 0), size_t{0});
 }
 
-TEST(MovementTest, PrevWordStart2) {
-    PieceTree tree{"🙂🙂🙂"};
-    EXPECT_EQ(prev_word_start(tree, 0), size_t{0});
-    EXPECT_EQ(prev_word_start(tree, 4), size_t{0});
-    EXPECT_EQ(prev_word_start(tree, 8), size_t{0});
-    EXPECT_EQ(prev_word_start(tree, tree.length()), size_t{0});
+TEST_P(MovementWordTest, PrevWordStart2) {
+    auto buffer = make("🙂🙂🙂");
+    EXPECT_EQ(prev_word_start(*buffer, 0), size_t{0});
+    EXPECT_EQ(prev_word_start(*buffer, 4), size_t{0});
+    EXPECT_EQ(prev_word_start(*buffer, 8), size_t{0});
+    EXPECT_EQ(prev_word_start(*buffer, buffer->length()), size_t{0});
 }
 
-TEST(MovementTest, NextWordEnd1) {
-    PieceTree tree{"abc🙂def"};
-    EXPECT_EQ(next_word_end(tree, 0), size_t{3});
-    EXPECT_EQ(next_word_end(tree, 1), size_t{3});
-    EXPECT_EQ(next_word_end(tree, 2), size_t{3});
-    EXPECT_EQ(next_word_end(tree, 3), size_t{7});
-    EXPECT_EQ(next_word_end(tree, 7), size_t{10});
-    EXPECT_EQ(next_word_end(tree, 8), size_t{10});
-    EXPECT_EQ(next_word_end(tree, 9), size_t{10});
-    EXPECT_EQ(next_word_end(tree, 10), size_t{10});
+TEST_P(MovementWordTest, NextWordEnd1) {
+    auto buffer = make("abc🙂def");
+    EXPECT_EQ(next_word_end(*buffer, 0), size_t{3});
+    EXPECT_EQ(next_word_end(*buffer, 1), size_t{3});
+    EXPECT_EQ(next_word_end(*buffer, 2), size_t{3});
+    EXPECT_EQ(next_word_end(*buffer, 3), size_t{7});
+    EXPECT_EQ(next_word_end(*buffer, 7), size_t{10});
+    EXPECT_EQ(next_word_end(*buffer, 8), size_t{10});
+    EXPECT_EQ(next_word_end(*buffer, 9), size_t{10});
+    EXPECT_EQ(next_word_end(*buffer, 10), size_t{10});
 }
 
-TEST(MovementTest, NextWordEnd2) {
-    PieceTree tree{"🙂🙂🙂"};
-    EXPECT_EQ(next_word_end(tree, 0), tree.length());
-    EXPECT_EQ(next_word_end(tree, 4), tree.length());
-    EXPECT_EQ(next_word_end(tree, 8), tree.length());
-    EXPECT_EQ(next_word_end(tree, tree.length()), tree.length());
+TEST_P(MovementWordTest, NextWordEnd2) {
+    auto buffer = make("🙂🙂🙂");
+    EXPECT_EQ(next_word_end(*buffer, 0), buffer->length());
+    EXPECT_EQ(next_word_end(*buffer, 4), buffer->length());
+    EXPECT_EQ(next_word_end(*buffer, 8), buffer->length());
+    EXPECT_EQ(next_word_end(*buffer, buffer->length()), buffer->length());
 }
 
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         MovementWordTest,
+                         testing::Values(TextBufferBackend::kPieceTree, TextBufferBackend::kRope),
+                         [](const auto& info) { return std::string{to_string(info.param)}; });
+
 }  // namespace editor
@@ -72,7 +72,7 @@ inline bool binary_search_input(input_t* input_vect, int vect_len, input_t input
 }
 }  // namespace
 
-AhoCorasick::MatchResult AhoCorasick::match(const PieceTree& tree) const {
+AhoCorasick::MatchResult AhoCorasick::match(const TextBuffer& buffer) const {
     ACBuffer* buf = static_cast<ACBuffer*>(this->buf);
 
     unsigned char* buf_base = reinterpret_cast<unsigned char*>(buf);
@@ -80,81 +80,53 @@ AhoCorasick::MatchResult AhoCorasick::match(const PieceTree& tree) const {
     ACOffset* states_ofst_vect =
         reinterpret_cast<ACOffset*>(UNSAFE_TODO(buf_base + buf->states_ofst_ofst));
 
-    ACState* state = 0;
+    // A null state is the root, which is handled specially: leading chars that are not valid
+    // input of root-nodes are skipped.
+    ACState* state = nullptr;
     // TODO: Implement starting/stopping at a specific index.
-    TreeWalker walker{tree};
-
-    // Skip leading chars that are not valid input of root-nodes.
-    if (buf->root_goto_num != 255) [[likely]] {
-        while (!walker.exhausted()) {
-            unsigned char c = walker.next();
-            if (unsigned char kid_id = UNSAFE_TODO(root_goto[c])) {
+    MatchResult result{-1, -1, -1};
+    size_t chunk_offset = 0;
+    buffer.for_each_chunk(0, buffer.length(), [&](std::string_view chunk) {
+        size_t i = 0;
+        while (i < chunk.size()) {
+            unsigned char c = chunk[i];
+            if (!state) {
+                ++i;
+                unsigned char kid_id = UNSAFE_TODO(root_goto[c]);
+                if (!kid_id) continue;
                 state = get_state_addr(buf_base, states_ofst_vect, kid_id);
-                break;
-            }
-        }
-    } else {
-        // TODO: Is this correct? Reference the original implementation to see if we transcribed it
-        // correctly.
-        unsigned char c = walker.next();
-        state = get_state_addr(buf_base, states_ofst_vect, c);
-    }
-
-    if (state != 0) [[likely]] {
-        if (state->is_term) [[unlikely]] {
-            uint32 idx = walker.offset();
-            /* Dictionary may have string of length 1 */
-            return {
-                .match_begin = static_cast<int>(idx - state->depth),
-                .match_end = static_cast<int>(idx - 1),
-                .pattern_idx = state->is_term - 1,
-            };
-        }
-    }
-
-    while (!walker.exhausted()) {
-        unsigned char c = walker.current();
-        int res;
-        bool found;
-        found = binary_search_input(state->input_vect, state->goto_num, c, res);
-        if (found) {
-            // The "t = goto(c, current_state)" is valid, advance to state "t".
-            uint32 kid = state->first_kid + res;
-            state = get_state_addr(buf_base, states_ofst_vect, kid);
-            walker.next();
-        } else {
-            // Follow the fail-link.
-            StateID fl = state->fail_link;
-            if (fl == 0) {
-                // fail-link is root-node, which implies the root-node doesn't
-                // have 255 valid transitions (otherwise, the fail-link should
-                // points to "goto(root, c)"), so we don't need speical handling
-                // as we did before this while-loop is entered.
-                //
-                while (!walker.exhausted()) {
-                    input_t c = walker.next();
-                    if (unsigned char kid_id = UNSAFE_TODO(root_goto[c])) {
-                        state = get_state_addr(buf_base, states_ofst_vect, kid_id);
-                        break;
-                    }
-                }
             } else {
-                state = get_state_addr(buf_base, states_ofst_vect, fl);
+                int res;
+                if (binary_search_input(state->input_vect, state->goto_num, c, res)) {
+                    // The "t = goto(c, current_state)" is valid, advance to state "t".
+                    uint32 kid = state->first_kid + res;
+                    state = get_state_addr(buf_base, states_ofst_vect, kid);
+                    ++i;
+                } else {
+                    // Follow the fail-link without consuming `c`. A fail-link to the root means
+                    // the root doesn't have 255 valid transitions (otherwise, the fail-link would
+                    // point to "goto(root, c)"), so skipping leading chars is correct again.
+                    StateID fl = state->fail_link;
+                    state = fl == 0 ? nullptr : get_state_addr(buf_base, states_ofst_vect, fl);
+                    if (!state) continue;
+                }
             }
-        }
 
-        // Check to see if the state is terminal state?
-        if (state->is_term) {
-            uint32 idx = walker.offset();
-            return {
-                .match_begin = static_cast<int>(idx - state->depth),
-                .match_end = static_cast<int>(idx - 1),
-                .pattern_idx = state->is_term - 1,
-            };
+            // Check to see if the state is terminal state?
+            if (state->is_term) {
+                uint32 idx = chunk_offset + i;
+                result = {
+                    .match_begin = static_cast<int>(idx - state->depth),
+                    .match_end = static_cast<int>(idx - 1),
+                    .pattern_idx = state->is_term - 1,
+                };
+                return false;
+            }
         }
-    }
-
-    return {-1, -1, -1};
+        chunk_offset += chunk.size();
+        return true;
+    });
+    return result;
 }
 
 }  // namespace editor
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "editor/buffer/piece_tree.h"
+#include "editor/buffer/text_buffer.h"
 #include <string>
 #include <vector>
 
@@ -25,7 +25,7 @@ public:
         int pattern_idx;
     };
 
-    MatchResult match(const PieceTree& tree) const;
+    MatchResult match(const TextBuffer& buffer) const;
 
 private:
     void* buf;
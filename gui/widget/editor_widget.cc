@@ -1,10 +1,25 @@
-#include "base/files/file_reader.h"
+#include "base/files/memory_mapped_file.h"
+#include "editor/buffer/piece_tree.h"
 #include "gui/renderer/renderer.h"
 #include "gui/widget/editor_widget.h"
 #include "gui/widget/padding_widget.h"
+#include <spdlog/spdlog.h>
+
+#if BUILDFLAG(IS_WIN)
+#include "base/strings/sys_string_conversions.h"
+#endif
 
 namespace gui {
 
+namespace {
+
+// Files at least this large are opened in the piece tree's large-file mode, which keeps only about
+// `kLargeFileResidentBudget` bytes of them in memory.
+constexpr size_t kLargeFileThreshold = 1024 * 1024 * 1024;
+constexpr size_t kLargeFileResidentBudget = 256 * 1024 * 1024;
+
+}  // namespace
+
 EditorWidget::EditorWidget(size_t main_font_id, size_t ui_font_size, size_t panel_close_image_id)
     : main_font_id(main_font_id),
       multi_view(new MultiViewWidget<TextEditWidget>()),
@@ -46,7 +61,11 @@ void EditorWidget::last_index() {
 size_t EditorWidget::get_current_index() { return multi_view->index(); }
 
 void EditorWidget::add_tab(std::string_view tab_name, std::string_view text) {
-    multi_view->add_tab(std::make_unique<TextEditWidget>(text, main_font_id));
+    add_tab(tab_name, editor::make_text_buffer(editor::kDefaultTextBufferBackend, text));
+}
+
+void EditorWidget::add_tab(std::string_view tab_name, std::unique_ptr<editor::TextBuffer> buffer) {
+    multi_view->add_tab(std::make_unique<TextEditWidget>(std::move(buffer), main_font_id));
     tab_bar->add_tab(tab_name);
     layout();
 }
@@ -58,8 +77,25 @@ void EditorWidget::remove_tab(size_t index) {
 }
 
 void EditorWidget::open_file(std::string_view path) {
-    std::string contents = base::ReadFile(path);
-    add_tab(path, contents);
+#if BUILDFLAG(IS_WIN)
+    base::FilePath file_path{base::sys_utf8_to_wide(path)};
+#else
+    base::FilePath file_path{path};
+#endif
+
+    // Map the file instead of reading it so a piece tree can use the file's pages directly.
+    auto file = std::make_unique<base::MemoryMappedFile>();
+    if (!file->Initialize(file_path)) {
+        spdlog::error("EditorWidget::open_file() error: could not open {}", path);
+        return;
+    }
+    // Always page large files through a piece tree. The rope would copy them into memory.
+    if (file->length() >= kLargeFileThreshold) {
+        add_tab(path,
+                std::make_unique<editor::PieceTree>(std::move(file), kLargeFileResidentBudget));
+        return;
+    }
+    add_tab(path, editor::make_text_buffer(editor::kDefaultTextBufferBackend, std::move(file)));
 }
 
 // TODO: Refactor this.
@@ -18,6 +18,7 @@ public:
     void last_index();
     size_t get_current_index();
     void add_tab(std::string_view tab_name, std::string_view text);
+    void add_tab(std::string_view tab_name, std::unique_ptr<editor::TextBuffer> buffer);
     void remove_tab(size_t index);
     void open_file(std::string_view path);
     // TODO: Refactor this.
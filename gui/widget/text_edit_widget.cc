@@ -4,6 +4,7 @@
 #include "editor/movement.h"
 #include "gui/renderer/renderer.h"
 #include "gui/widget/text_edit_widget.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <format>
@@ -11,16 +12,23 @@
 namespace gui {
 
 TextEditWidget::TextEditWidget(std::string_view str8, size_t font_id)
-    : font_id(font_id), tree(str8) {
+    : TextEditWidget(editor::make_text_buffer(editor::kDefaultTextBufferBackend, str8), font_id) {}
+
+TextEditWidget::TextEditWidget(std::unique_ptr<editor::TextBuffer> buffer, size_t font_id)
+    : font_id(font_id), buffer(std::move(buffer)) {
+    estimate_all_line_widths();
     update_max_scroll();
 }
 
-void TextEditWidget::select_all() { selection.set_range(0, tree.length()); }
+void TextEditWidget::select_all() { selection.set_range(0, buffer->length()); }
 
 void TextEditWidget::move(MoveBy by, bool forward, bool extend) {
     auto p = base::Profiler{"TextViewWidget::move()"};
 
-    auto [line, col] = tree.line_column_at(selection.end);
+    // Typing after moving the caret starts a new undo entry, even if it lands back in place.
+    buffer->break_undo_coalescing();
+
+    auto [line, col] = buffer->line_column_at(selection.end);
     const auto& layout = layout_at(line);
 
     switch (by) {
@@ -46,7 +54,7 @@ void TextEditWidget::move(MoveBy by, bool forward, bool extend) {
             if (delta == 0 && line > 0) {
                 const auto& prev_layout = layout_at(line - 1);
                 size_t index =
-                    tree.offset_at(line - 1, base::sub_sat(prev_layout.length, size_t{1}));
+                    buffer->offset_at(line - 1, base::sub_sat(prev_layout.length, size_t{1}));
                 selection.set_index(index, extend);
             }
         }
@@ -54,19 +62,19 @@ void TextEditWidget::move(MoveBy by, bool forward, bool extend) {
     }
     case MoveBy::kLines: {
         size_t new_line = forward ? line + 1 : line - 1;
-        if (0 <= new_line && new_line < tree.line_count()) {
+        if (0 <= new_line && new_line < buffer->line_count()) {
             int x = editor::x_at_column(layout, col);
             size_t new_col = editor::column_at_x(layout_at(new_line), x);
-            size_t index = tree.offset_at(new_line, new_col);
+            size_t index = buffer->offset_at(new_line, new_col);
             selection.set_index(index, extend);
         }
         break;
     }
     case MoveBy::kWords: {
         if (forward) {
-            selection.end = editor::next_word_end(tree, selection.end);
+            selection.end = editor::next_word_end(*buffer, selection.end);
         } else {
-            selection.end = editor::prev_word_start(tree, selection.end);
+            selection.end = editor::prev_word_start(*buffer, selection.end);
         }
         if (!extend) {
             selection.start = selection.end;
@@ -79,21 +87,23 @@ void TextEditWidget::move(MoveBy by, bool forward, bool extend) {
 void TextEditWidget::move_to(MoveTo to, bool extend) {
     auto p = base::Profiler{"TextViewWidget::moveTo()"};
 
+    buffer->break_undo_coalescing();
+
     switch (to) {
     case MoveTo::kBOL:
     case MoveTo::kHardBOL: {
-        size_t line = tree.line_at(selection.end);
+        size_t line = buffer->line_at(selection.end);
         const auto& layout = layout_at(line);
         size_t new_col = editor::column_at_x(layout, 0);
-        selection.set_index(tree.offset_at(line, new_col), extend);
+        selection.set_index(buffer->offset_at(line, new_col), extend);
         break;
     }
     case MoveTo::kEOL:
     case MoveTo::kHardEOL: {
-        size_t line = tree.line_at(selection.end);
+        size_t line = buffer->line_at(selection.end);
         const auto& layout = layout_at(line);
         size_t new_col = editor::column_at_x(layout, layout.width);
-        selection.set_index(tree.offset_at(line, new_col), extend);
+        selection.set_index(buffer->offset_at(line, new_col), extend);
         break;
     }
     case MoveTo::kBOF: {
@@ -101,19 +111,24 @@ void TextEditWidget::move_to(MoveTo to, bool extend) {
         break;
     }
     case MoveTo::kEOF: {
-        selection.set_index(tree.length(), extend);
+        selection.set_index(buffer->length(), extend);
         break;
     }
     }
 }
 
 void TextEditWidget::insert_text(std::string_view str8) {
-    if (!selection.empty()) {
+    // Replacing the selection undoes as a single step. Plain typing is left alone so that it
+    // keeps coalescing.
+    bool replace = !selection.empty();
+    if (replace) {
+        buffer->begin_transaction();
         left_delete();
     }
 
     size_t i = selection.end;
-    tree.insert(i, str8);
+    insert_at(i, str8);
+    if (replace) buffer->end_transaction();
     selection.increment(str8.length(), false);
 
     // TODO: Do we update caret `max_x` too?
@@ -125,7 +140,7 @@ void TextEditWidget::left_delete() {
     auto p = base::Profiler{"TextViewWidget::leftDelete()"};
 
     if (selection.empty()) {
-        auto [line, col] = tree.line_column_at(selection.end);
+        auto [line, col] = buffer->line_column_at(selection.end);
         const auto& layout = layout_at(line);
 
         size_t delta = editor::move_to_prev_glyph(layout, col);
@@ -138,10 +153,10 @@ void TextEditWidget::left_delete() {
         }
 
         size_t i = selection.end;
-        tree.erase(i, delta);
+        erase_at(i, delta);
     } else {
         auto [start, end] = selection.range();
-        tree.erase(start, end - start);
+        erase_at(start, end - start);
         selection.collapse_left();
     }
 
@@ -152,15 +167,15 @@ void TextEditWidget::right_delete() {
     auto p = base::Profiler{"TextViewWidget::rightDelete()"};
 
     if (selection.empty()) {
-        auto [line, col] = tree.line_column_at(selection.end);
+        auto [line, col] = buffer->line_column_at(selection.end);
         const auto& layout = layout_at(line);
 
         size_t delta = editor::move_to_next_glyph(layout, col);
         size_t i = selection.end;
-        tree.erase(i, delta);
+        erase_at(i, delta);
     } else {
         auto [start, end] = selection.range();
-        tree.erase(start, end - start);
+        erase_at(start, end - start);
         selection.collapse_left();
     }
 
@@ -175,18 +190,18 @@ void TextEditWidget::delete_word(bool forward) {
         size_t prev_offset = selection.end;
         size_t offset, delta;
         if (forward) {
-            offset = editor::next_word_end(tree, prev_offset);
+            offset = editor::next_word_end(*buffer, prev_offset);
             delta = offset - prev_offset;
-            tree.erase(prev_offset, delta);
+            erase_at(prev_offset, delta);
 
             // TODO: Clean up selection/caret code.
             // TODO: After clean up, move this out of TextViewWidget.
             selection.end = prev_offset;
             selection.start = selection.end;
         } else {
-            offset = editor::prev_word_start(tree, prev_offset);
+            offset = editor::prev_word_start(*buffer, prev_offset);
             delta = prev_offset - offset;
-            tree.erase(offset, delta);
+            erase_at(offset, delta);
 
             // TODO: Clean up selection/caret code.
             // TODO: After clean up, move this out of TextViewWidget.
@@ -195,22 +210,33 @@ void TextEditWidget::delete_word(bool forward) {
         }
     } else {
         auto [start, end] = selection.range();
-        tree.erase(start, end - start);
+        erase_at(start, end - start);
         selection.collapse_left();
     }
 }
 
 std::string TextEditWidget::get_selection_text() {
     auto [start, end] = selection.range();
-    return tree.substr(start, end - start);
+    return buffer->substr(start, end - start);
 }
 
-void TextEditWidget::undo() { tree.undo(); }
+// Undo and redo don't report what they changed, so every line is re-estimated.
+void TextEditWidget::undo() {
+    if (buffer->undo()) {
+        estimate_all_line_widths();
+        update_max_scroll();
+    }
+}
 
-void TextEditWidget::redo() { tree.redo(); }
+void TextEditWidget::redo() {
+    if (buffer->redo()) {
+        estimate_all_line_widths();
+        update_max_scroll();
+    }
+}
 
 void TextEditWidget::find(std::string_view str8) {
-    std::optional<size_t> result = tree.find(str8);
+    std::optional<size_t> result = buffer->find(str8);
     if (result) {
         size_t offset = *result;
         selection.set_range(offset, offset + str8.length());
@@ -220,14 +246,14 @@ void TextEditWidget::find(std::string_view str8) {
 // TODO: Use a struct type for clarity.
 std::pair<size_t, size_t> TextEditWidget::get_line_column() {
     size_t offset = selection.end;
-    auto cursor = tree.line_column_at(offset);
-    return {cursor.line, cursor.column};
+    return {buffer->line_at(offset), buffer->codepoint_column_at(offset)};
 }
 
 size_t TextEditWidget::get_selection_length() { return selection.length(); }
 
 void TextEditWidget::update_font_id(size_t font_id) {
     this->font_id = font_id;
+    estimate_all_line_widths();
     update_max_scroll();
 }
 
@@ -245,23 +271,30 @@ void TextEditWidget::draw() {
     // Render two lines before start and after end. This ensures no sudden cutoff.
     start_line = base::sub_sat(start_line, size_t{2});
     end_line = base::add_sat(end_line, size_t{2});
-    start_line = std::clamp(start_line, size_t{0}, tree.line_count());
-    end_line = std::clamp(end_line, size_t{0}, tree.line_count());
+    start_line = std::clamp(start_line, size_t{0}, buffer->line_count());
+    end_line = std::clamp(end_line, size_t{0}, buffer->line_count());
+
+    // Fetch all visible lines in one pass. `layout_at()` reads them from here while drawing.
+    buffer->get_lines(start_line, end_line - start_line, drawn_lines);
 
     render_text(main_line_height, start_line, end_line);
     render_selections(main_line_height, start_line, end_line);
     // Render caret first so scroll bar draws over it.
     render_caret(main_line_height);
     render_scroll_bars(main_line_height);
+
+    drawn_lines.clear();
 }
 
 void TextEditWidget::left_mouse_down(const Point& mouse_pos,
                                      ModifierKey modifiers,
                                      ClickType click_type) {
+    buffer->break_undo_coalescing();
+
     Point coords = mouse_pos - text_offset();
     size_t line = line_at_y(coords.y);
     size_t col = editor::column_at_x(layout_at(line), coords.x);
-    size_t offset = tree.offset_at(line, col);
+    size_t offset = buffer->offset_at(line, col);
 
     switch (click_type) {
     case ClickType::kSingleClick: {
@@ -270,14 +303,14 @@ void TextEditWidget::left_mouse_down(const Point& mouse_pos,
         break;
     }
     case ClickType::kDoubleClick: {
-        auto [left, right] = editor::surrounding_word(tree, offset);
+        auto [left, right] = editor::surrounding_word(*buffer, offset);
         selection.set_range(left, right);
         old_selection = selection;
         break;
     }
     case ClickType::kTripleClick: {
         // TODO: Implement extending.
-        auto [left, right] = tree.get_line_range_with_newline(line);
+        auto [left, right] = buffer->get_line_range_with_newline(line);
         selection.set_range(left, right);
         break;
     }
@@ -290,7 +323,7 @@ void TextEditWidget::left_mouse_drag(const Point& mouse_pos,
     Point coords = mouse_pos - text_offset();
     size_t line = line_at_y(coords.y);
     size_t col = editor::column_at_x(layout_at(line), coords.x);
-    size_t offset = tree.offset_at(line, col);
+    size_t offset = buffer->offset_at(line, col);
 
     switch (click_type) {
     case ClickType::kSingleClick: {
@@ -298,8 +331,8 @@ void TextEditWidget::left_mouse_drag(const Point& mouse_pos,
         break;
     }
     case ClickType::kDoubleClick: {
-        if (editor::is_inside_word(tree, offset)) {
-            auto [left, right] = editor::surrounding_word(tree, offset);
+        if (editor::is_inside_word(*buffer, offset)) {
+            auto [left, right] = editor::surrounding_word(*buffer, offset);
             left = std::min(left, old_selection.start);
             right = std::max(right, old_selection.end);
             selection.set_range(left, right);
@@ -310,7 +343,7 @@ void TextEditWidget::left_mouse_drag(const Point& mouse_pos,
         break;
     }
     case ClickType::kTripleClick: {
-        auto [left, right] = tree.get_line_range_with_newline(line);
+        auto [left, right] = buffer->get_line_range_with_newline(line);
         selection.set_index(right, true);
         break;
     }
@@ -323,9 +356,34 @@ void TextEditWidget::update_max_scroll() {
     const auto& font_rasterizer = font::FontRasterizer::instance();
     const auto& metrics = font_rasterizer.metrics(font_id);
 
-    // NOTE: We update the max width when iterating over visible lines, not here.
+    max_scroll_offset.x = line_widths.max();
+    max_scroll_offset.y = base::checked_cast<int>(buffer->line_count()) * metrics.line_height;
+}
 
-    max_scroll_offset.y = base::checked_cast<int>(tree.line_count()) * metrics.line_height;
+void TextEditWidget::insert_at(size_t offset, std::string_view str8) {
+    size_t line = buffer->line_at(offset);
+    buffer->insert(offset, str8);
+    estimate_line_widths(line, 1, 1 + static_cast<size_t>(std::ranges::count(str8, '\n')));
+}
+
+void TextEditWidget::erase_at(size_t offset, size_t count) {
+    size_t first_line = buffer->line_at(offset);
+    size_t last_line = buffer->line_at(offset + count);
+    buffer->erase(offset, count);
+    estimate_line_widths(first_line, last_line - first_line + 1, 1);
+}
+
+// Replaces the widths of the `old_count` lines at `first` with estimates for the `new_count`
+// lines now there.
+void TextEditWidget::estimate_line_widths(size_t first, size_t old_count, size_t new_count) {
+    int char_width = font::FontRasterizer::instance().layout_line(font_id, "0").width;
+    line_widths.replace(first, old_count,
+                        editor::estimate_line_widths(*buffer, first, new_count, char_width));
+}
+
+void TextEditWidget::estimate_all_line_widths() {
+    line_widths.assign({});
+    estimate_line_widths(0, 0, buffer->line_count());
 }
 
 size_t TextEditWidget::line_at_y(int y) const {
@@ -337,13 +395,22 @@ size_t TextEditWidget::line_at_y(int y) const {
     const auto& metrics = font_rasterizer.metrics(font_id);
 
     size_t line = y / metrics.line_height;
-    return std::clamp(line, size_t{0}, tree.line_count() - 1);
+    return std::clamp(line, size_t{0}, buffer->line_count() - 1);
 }
 
 inline const font::LineLayout& TextEditWidget::layout_at(size_t line) {
     auto& line_layout_cache = Renderer::instance().line_layout_cache();
-    std::string line_str = tree.get_line_content_for_layout_use(line);
-    return line_layout_cache.get(font_id, line_str);
+    const font::LineLayout* layout;
+    if (drawn_lines.contains(line)) {
+        layout = &line_layout_cache.get(
+            font_id, drawn_lines.line_for_layout_use(line - drawn_lines.first_line()));
+    } else {
+        std::string line_str = buffer->get_line_content_for_layout_use(line);
+        layout = &line_layout_cache.get(font_id, line_str);
+    }
+    // The real width replaces the estimate.
+    if (line < line_widths.size()) line_widths.set(line, layout->width);
+    return *layout;
 }
 
 inline constexpr Point TextEditWidget::text_offset() {
@@ -359,7 +426,7 @@ inline constexpr int TextEditWidget::gutter_width() {
 inline int TextEditWidget::line_number_width() {
     auto& line_layout_cache = Renderer::instance().line_layout_cache();
     int digit_width = line_layout_cache.get(font_id, "0").width;
-    int log = std::log10(tree.line_count());
+    int log = std::log10(buffer->line_count());
     return digit_width * std::max(log + 1, 2);
 }
 
@@ -369,7 +436,7 @@ void TextEditWidget::render_text(int main_line_height, size_t start_line, size_t
     auto& line_layout_cache = Renderer::instance().line_layout_cache();
 
     // TODO: Refactor code in draw() to only fetch caret [line, col] once.
-    size_t selection_line = tree.line_at(selection.end);
+    size_t selection_line = buffer->line_at(selection.end);
 
     auto p = base::Profiler{"TextViewWidget::renderText()"};
 
@@ -398,19 +465,9 @@ void TextEditWidget::render_text(int main_line_height, size_t start_line, size_t
         .y = position().y + size().height,
     };
 
-    // We set the max horizontal scroll to the max width out of each *visible* line. This means the
-    // max horizontal scroll changes dynamically as the user scrolls through the buffer, but this
-    // is better than computing it up front and having to update it.
-    //
-    // As long as the user can scroll to the section vertically and then scroll horizontally once
-    // there, it shouldn't be confusing or limiting at all in my opinion.
-    int max_layout_width = 0;
-
     for (size_t line = start_line; line < end_line; ++line) {
         const auto& layout = layout_at(line);
 
-        max_layout_width = std::max(layout.width, max_layout_width);
-
         Point coords = text_offset();
         coords.y += static_cast<int>(line) * main_line_height;
         coords.x += kBorderThickness;  // Match Sublime Text.
@@ -453,14 +510,15 @@ void TextEditWidget::render_text(int main_line_height, size_t start_line, size_t
                                          max_gutter_coords, line_number_highlight_callback);
     }
 
-    max_scroll_offset.x = max_layout_width;
+    // Laying out the visible lines may have refined the widest line.
+    max_scroll_offset.x = line_widths.max();
 }
 
 void TextEditWidget::render_selections(int main_line_height, size_t start_line, size_t end_line) {
     auto& selection_renderer = Renderer::instance().selection_renderer();
     auto [start, end] = selection.range();
-    auto [c1_line, c1_col] = tree.line_column_at(start);
-    auto [c2_line, c2_col] = tree.line_column_at(end);
+    auto [c1_line, c1_col] = buffer->line_column_at(start);
+    auto [c2_line, c2_col] = buffer->line_column_at(end);
 
     const auto& c1_layout = layout_at(c1_line);
     const auto& c2_layout = layout_at(c2_line);
@@ -508,9 +566,9 @@ void TextEditWidget::render_scroll_bars(int main_line_height) {
 
     // Add vertical scroll bar.
     // TODO: Consider subtracting 1 from the line count.
-    if (tree.line_count() > 0) {
+    if (buffer->line_count() > 0) {
         int vbar_width = kScrollBarThickness;
-        double max_scrollbar_y = size().height + tree.line_count() * main_line_height;
+        double max_scrollbar_y = size().height + buffer->line_count() * main_line_height;
         double vbar_height_percent = static_cast<double>(size().height) / max_scrollbar_y;
         int vbar_height = size().height * vbar_height_percent;
         vbar_height = std::max(kMinScrollBarHeight, vbar_height);
@@ -551,7 +609,7 @@ void TextEditWidget::render_caret(int main_line_height) {
 
     int caret_height = main_line_height + kExtraPadding * 2;
 
-    auto [line, col] = tree.line_column_at(selection.end);
+    auto [line, col] = buffer->line_column_at(selection.end);
     int end_caret_x = editor::x_at_column(layout_at(line), col);
 
     Point caret_pos = {
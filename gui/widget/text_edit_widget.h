@@ -1,6 +1,7 @@
 #pragma once
 
-#include "editor/buffer/piece_tree.h"
+#include "editor/buffer/text_buffer.h"
+#include "editor/line_widths.h"
 #include "editor/selection.h"
 #include "gui/renderer/types.h"
 #include "gui/types.h"
@@ -11,6 +12,7 @@ namespace gui {
 class TextEditWidget : public ScrollableWidget {
 public:
     TextEditWidget(std::string_view str8, size_t font_id);
+    TextEditWidget(std::unique_ptr<editor::TextBuffer> buffer, size_t font_id);
 
     // Editing methods.
     void select_all();
@@ -24,6 +26,7 @@ public:
     void redo();
     void find(std::string_view str8);
     // TODO: Use a struct type for clarity.
+    // The column counts codepoints.
     std::pair<size_t, size_t> get_line_column();
     size_t get_selection_length();
 
@@ -71,7 +74,13 @@ private:
 
     size_t font_id;
 
-    editor::PieceTree tree{};
+    // Never null.
+    std::unique_ptr<editor::TextBuffer> buffer;
+    // The lines being drawn. Only filled in during `draw()`, since any edit invalidates it.
+    editor::LineBlock drawn_lines;
+    // The width of every line, estimated from its length until it is laid out. Edits only
+    // re-estimate the lines they touch, and the widest line sets the horizontal scroll range.
+    editor::LineWidths line_widths;
 
     Selection selection{};
     Selection old_selection{};
@@ -79,6 +88,12 @@ private:
     static constexpr int kGutterLeftPadding = 18 * 2;
     static constexpr int kGutterRightPadding = 8 * 2;
 
+    // Edit the buffer and keep `line_widths` in sync.
+    void insert_at(size_t offset, std::string_view str8);
+    void erase_at(size_t offset, size_t count);
+    void estimate_line_widths(size_t first, size_t old_count, size_t new_count);
+    void estimate_all_line_widths();
+
     size_t line_at_y(int y) const;
     inline const font::LineLayout& layout_at(size_t line);
     inline constexpr Point text_offset();
@@ -0,0 +1,307 @@
+#!/usr/bin/env python3
+"""Generates the edit traces that editor/buffer/edit_trace_perftest.cc replays.
+
+Each trace simulates one editing session on C++-like source: typing with typos and backspacing,
+moving the caret around, deleting and duplicating lines, pasting blocks and rename passes. The
+output is deterministic, so rerunning this script reproduces the checked-in traces byte for byte.
+
+The format is documented in editor/buffer/edit_trace.h.
+
+Usage: scripts/generate_edit_traces.py [output directory]
+"""
+
+import os
+import random
+import sys
+
+DEFAULT_OUTPUT_DIR = os.path.join(os.path.dirname(__file__), "..", "editor", "buffer",
+                                  "edit_traces")
+
+KEYWORDS = ["auto", "const", "return", "if", "for", "while", "size_t", "int", "bool", "void",
+            "std::string", "std::vector", "static", "constexpr", "else", "break", "nullptr"]
+COMMENT_WORDS = ["the", "a", "of", "to", "is", "in", "and", "this", "when", "so", "that", "it",
+                 "we", "can", "not", "buffer", "line", "offset", "caret", "cache", "before",
+                 "after", "every", "only", "keeps", "returns", "café", "naïve", "→", "😄", "über"]
+
+
+def make_identifiers(rng, count):
+    syllables = ["ba", "co", "de", "fi", "gu", "ka", "lo", "me", "no", "pa", "ri", "se", "ta",
+                 "vu", "xe", "zo", "str", "len", "idx", "buf", "pos", "node", "tree", "line",
+                 "col"]
+    names = set()
+    while len(names) < count:
+        parts = ["".join(rng.choice(syllables) for _ in range(rng.randint(1, 3)))
+                 for _ in range(rng.randint(1, 3))]
+        names.add("_".join(parts))
+    return sorted(names)
+
+
+class Session:
+    def __init__(self, seed):
+        self.rng = random.Random(seed)
+        self.identifiers = make_identifiers(self.rng, 400)
+        self.doc = bytearray()
+        self.caret = 0
+        self.edits = []
+
+    # Edits.
+
+    def edit(self, offset, erase, text=b""):
+        if erase == 0 and not text:
+            return
+        self.doc[offset:offset + erase] = text
+        self.edits.append((offset, erase, text))
+
+    def type_text(self, text):
+        """Types `text` one codepoint at a time, sometimes making and fixing a typo."""
+        for ch in text:
+            if ch not in "\n " and self.rng.random() < 0.03:
+                typo = "".join(self.rng.choice("asdfghjkl") for _ in range(self.rng.randint(1, 3)))
+                self.type_text_exactly(typo)
+                self.backspace(len(typo))
+            self.type_text_exactly(ch)
+
+    def type_text_exactly(self, text):
+        for ch in text:
+            data = ch.encode()
+            self.edit(self.caret, 0, data)
+            self.caret += len(data)
+
+    def backspace(self, count):
+        for _ in range(count):
+            if self.caret == 0:
+                return
+            start = self.caret - 1
+            while start > 0 and self.doc[start] & 0xC0 == 0x80:
+                start -= 1
+            self.edit(start, self.caret - start)
+            self.caret = start
+
+    def paste(self, text):
+        data = text.encode() if isinstance(text, str) else bytes(text)
+        self.edit(self.caret, 0, data)
+        self.caret += len(data)
+
+    # Lines.
+
+    def line_start(self, offset):
+        return self.doc.rfind(b"\n", 0, offset) + 1
+
+    def line_end(self, offset):
+        end = self.doc.find(b"\n", offset)
+        return len(self.doc) if end == -1 else end
+
+    def lines_from(self, offset, count):
+        """Returns the range of `count` whole lines starting at the line containing `offset`."""
+        start = self.line_start(offset)
+        end = start
+        for _ in range(count):
+            if end >= len(self.doc):
+                break
+            end = self.line_end(end) + 1
+        return start, min(end, len(self.doc))
+
+    # Movement.
+
+    def snap(self, offset):
+        while 0 < offset < len(self.doc) and self.doc[offset] & 0xC0 == 0x80:
+            offset += 1
+        return offset
+
+    def jump(self, far_chance):
+        if not self.doc:
+            self.caret = 0
+            return
+        if self.rng.random() < far_chance:
+            target = self.rng.randint(0, len(self.doc))
+        else:
+            # Scroll a few lines up or down.
+            target = self.caret
+            for _ in range(self.rng.randint(0, 20)):
+                if self.rng.random() < 0.5:
+                    target = max(self.line_start(target) - 1, 0)
+                else:
+                    target = min(self.line_end(target) + 1, len(self.doc))
+        choice = self.rng.random()
+        if choice < 0.45:
+            target = self.line_end(target)
+        elif choice < 0.6:
+            target = self.line_start(target)
+        self.caret = self.snap(target)
+
+    # Content.
+
+    def identifier(self):
+        return self.rng.choice(self.identifiers)
+
+    def code_line(self, indent):
+        rng = self.rng
+        kind = rng.random()
+        pad = " " * indent
+        if kind < 0.15:
+            words = [rng.choice(COMMENT_WORDS) for _ in range(rng.randint(3, 12))]
+            return f"{pad}// {' '.join(words)}."
+        if kind < 0.55:
+            args = ", ".join(self.identifier() for _ in range(rng.randint(0, 3)))
+            name = self.identifier()
+            return f"{pad}{rng.choice(KEYWORDS)} {name} = {self.identifier()}({args});"
+        if kind < 0.75:
+            return f"{pad}{self.identifier()}.{self.identifier()}({rng.randint(0, 4096)});"
+        if kind < 0.9:
+            lhs = self.identifier()
+            return f"{pad}if ({lhs} > {self.identifier()}) return {rng.randint(0, 9)};"
+        return ""
+
+    def code_block(self, line_count):
+        lines = []
+        indent = 0
+        for _ in range(line_count):
+            if indent < 12 and self.rng.random() < 0.08:
+                lines.append(" " * indent + f"for (size_t {self.identifier()} : "
+                             f"{self.identifier()}) {{")
+                indent += 4
+            elif indent > 0 and self.rng.random() < 0.08:
+                indent -= 4
+                lines.append(" " * indent + "}")
+            else:
+                lines.append(self.code_line(indent))
+        return "\n".join(lines) + "\n"
+
+    def current_indent(self):
+        start = self.line_start(self.caret)
+        indent = 0
+        while start + indent < len(self.doc) and self.doc[start + indent] == ord(" "):
+            indent += 1
+        return indent
+
+    # Sessions.
+
+    def compose(self, edit_count):
+        """Writes a new file from scratch, mostly at the end, sometimes going back to add lines."""
+        while len(self.edits) < edit_count:
+            choice = self.rng.random()
+            if choice < 0.85:
+                self.caret = self.line_end(self.caret)
+                self.type_text("\n" + self.code_line(self.current_indent()))
+            elif choice < 0.92:
+                self.jump(far_chance=0.3)
+            elif choice < 0.97:
+                self.backspace(self.rng.randint(1, 12))
+            else:
+                self.caret = len(self.doc)
+
+    def revise(self, edit_count):
+        """Edits an existing file all over: small fixes, line moves, pastes and deletions."""
+        while len(self.edits) < edit_count:
+            choice = self.rng.random()
+            if choice < 0.25:
+                self.jump(far_chance=0.15)
+            elif choice < 0.55:
+                words = " ".join(self.identifier() for _ in range(self.rng.randint(1, 3)))
+                self.type_text(words)
+            elif choice < 0.7:
+                self.caret = self.line_end(self.caret)
+                self.type_text("\n" + self.code_line(self.current_indent()))
+            elif choice < 0.82:
+                self.backspace(self.rng.randint(1, 20))
+            elif choice < 0.88:
+                start, end = self.lines_from(self.caret, self.rng.randint(1, 3))
+                self.edit(start, end - start)
+                self.caret = self.snap(min(start, len(self.doc)))
+            elif choice < 0.93:
+                # Duplicate or copy lines from nearby.
+                start, end = self.lines_from(self.caret, self.rng.randint(1, 40))
+                block = self.doc[start:end]
+                self.caret = self.line_start(self.caret)
+                self.paste(block)
+            elif choice < 0.97:
+                self.caret = self.line_start(self.caret)
+                self.paste(self.code_block(self.rng.randint(5, 60)))
+            else:
+                start, end = self.lines_from(self.caret, self.rng.randint(5, 60))
+                self.edit(start, end - start)
+                self.caret = self.snap(min(start, len(self.doc)))
+
+    def refactor(self, edit_count):
+        """Renames identifiers across the file and reindents ranges of lines, front to back."""
+        while len(self.edits) < edit_count:
+            if self.rng.random() < 0.8:
+                old = self.identifier().encode()
+                new = make_identifiers(self.rng, 1)[0].encode()
+                offset = self.doc.find(old)
+                while offset != -1 and len(self.edits) < edit_count:
+                    before = self.doc[offset - 1:offset] if offset > 0 else b" "
+                    after = self.doc[offset + len(old):offset + len(old) + 1] or b" "
+                    in_word = any(c.isalnum() or c == b"_" for c in (before, after))
+                    if not in_word:
+                        self.edit(offset, len(old), new)
+                        offset += len(new)
+                    else:
+                        offset += len(old)
+                    offset = self.doc.find(old, offset)
+                self.identifiers.remove(old.decode())
+                self.identifiers.append(new.decode())
+            else:
+                self.caret = self.snap(self.rng.randint(0, len(self.doc)))
+                start = self.line_start(self.caret)
+                indent = self.rng.random() < 0.5
+                for _ in range(self.rng.randint(5, 200)):
+                    if start >= len(self.doc):
+                        break
+                    if indent:
+                        self.edit(start, 0, b"    ")
+                    elif self.doc[start:start + 4] == b"    ":
+                        self.edit(start, 4)
+                    start = self.line_end(start) + 1
+
+
+def fnv1a(data):
+    """64-bit FNV-1a, as in editor::edit_trace_hash()."""
+    result = 0xCBF29CE484222325
+    for byte in data:
+        result = ((result ^ byte) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return result
+
+
+def escape(text):
+    return (text.decode().replace("\\", "\\\\").replace("\n", "\\n").replace("\r", "\\r")
+            .replace("\t", "\\t"))
+
+
+def write_trace(path, description, session):
+    with open(path, "w", encoding="utf-8", newline="\n") as out:
+        out.write("# Generated by scripts/generate_edit_traces.py. Do not edit.\n")
+        out.write(f"# {description}\n")
+        line_feeds = session.doc.count(b"\n")
+        out.write(f"final {len(session.doc)} {line_feeds} {fnv1a(session.doc):016x}\n")
+        for offset, erase, text in session.edits:
+            out.write(f"{offset} {erase} {escape(text)}\n")
+    print(f"{path}: {len(session.edits)} edits, {len(session.doc)} bytes")
+
+
+def main():
+    output_dir = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_OUTPUT_DIR
+    os.makedirs(output_dir, exist_ok=True)
+
+    typing = Session(seed=1)
+    typing.compose(260_000)
+    write_trace(os.path.join(output_dir, "compose.txt"),
+                "Writes a source file from scratch, typing one codepoint at a time.", typing)
+
+    editing = Session(seed=2)
+    editing.paste(editing.code_block(6_000))
+    editing.revise(200_000)
+    write_trace(os.path.join(output_dir, "revise.txt"),
+                "Pastes a source file, then makes small edits, line moves and pastes all over it.",
+                editing)
+
+    refactoring = Session(seed=3)
+    refactoring.paste(refactoring.code_block(12_000))
+    refactoring.refactor(100_000)
+    write_trace(os.path.join(output_dir, "refactor.txt"),
+                "Pastes a source file, then renames identifiers and reindents blocks.",
+                refactoring)
+
+
+if __name__ == "__main__":
+    main()